@@ -0,0 +1,21 @@
+#!/bin/sh
+# Builds the headless runner (benchmarks and batch tools) on Linux/macOS.
+set -e
+
+Profile=${1:-debug}
+
+case "$Profile" in
+    debug)   ProfileCompileFlags="-g -O0 -DDEBUG" ;;
+    release) ProfileCompileFlags="-O2 -DNDEBUG" ;;
+    *)
+        echo "ERROR: You should either specify debug or release as the first argument."
+        exit 1
+        ;;
+esac
+
+# Extra defines such as -DUSE_OP_COUNTERS can be passed in EXTRA_FLAGS.
+CompileFlags="-I./include -DPLATFORM_HEADLESS -std=c++14"
+Compiler=${CXX:-c++}
+
+mkdir -p bin/$Profile
+$Compiler src/main.cpp $CompileFlags $ProfileCompileFlags $EXTRA_FLAGS -o bin/$Profile/main_headless
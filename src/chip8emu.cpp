@@ -1,6 +1,21 @@
 #include "imgui.h"
 #include "chip8emu.h"
 #include "chip8emu_platform.h"
+#include "chip8emu_rewind.h"
+#include "chip8emu_movie.h"
+#include "chip8emu_profile.h"
+#include "chip8emu_perf.h"
+#include "chip8emu_trace.h"
+#include "chip8emu_debugger.h"
+#include "chip8emu_writelog.h"
+#include "chip8emu_expr.h"
+#include "chip8emu_breakpoints.h"
+#include "chip8emu_disasm.h"
+#include "chip8emu_memview.h"
+#include "chip8emu_search.h"
+#include "chip8emu_coverage.h"
+#include "chip8emu_zones.h"
+#include "chip8emu_probes.h"
 #include <stdio.h>
 
 namespace c8e
@@ -10,6 +25,7 @@ static inline void execute_op(uint16_t op);
 
 void load_rom(plat::FilePath path)
 {
+    C8E_ZONE("load_rom");
     plat::FileContents contents = plat::load_entire_file(path);
     if(!contents.data)
     {
@@ -23,6 +39,7 @@ void load_rom(plat::FilePath path)
     memset(c8.rom, 0, (MEMORY_SIZE - PROGRAM_OFFSET)*sizeof(*c8.rom));
     memcpy((c8.rom), contents.data, contents.len);
     c8.loaded = false;
+    C8E_PROBE1(load_rom, contents.len);
 
 error:
     plat::unload_file(contents);
@@ -30,9 +47,12 @@ error:
 
 void reset()
 {
+    C8E_ZONE("reset");
+    C8E_PROBE(reset);
+    debugger.frame_ops_left = 0;
     memset(c8.keys, 0, 16*sizeof(*c8.keys));
     memset(c8.stack, 0, 16*sizeof(*c8.stack));
-    memset(c8.display, 0, 2048*sizeof(*c8.display));
+    memset(c8.display, 0, 32*sizeof(*c8.display));
     memset(c8.v, 0, 16*sizeof(*c8.v));
     memset(c8.memory, 0, MEMORY_SIZE*sizeof(*c8.memory));
 
@@ -47,9 +67,17 @@ void reset()
     c8.vd = 0;
     c8.vs = 0;
     c8.sp = 0;
+    c8.frame = 0;
+    c8.cycle = 0;
+    c8.frame_carry = 0;
+    c8.rng = c8.seed ? c8.seed : DEFAULT_SEED;
 
     memcpy((c8.memory + FONT_OFFSET), FONT, 5*16);
     memcpy((c8.memory + PROGRAM_OFFSET), (c8.rom), MEMORY_SIZE - PROGRAM_OFFSET);
+    invalidate_hashes();
+    disasm_invalidate();
+    if(write_log.enabled)
+        write_log_resync(&write_log);
 }
 
 void initialize(ImGuiIO& io)
@@ -76,10 +104,11 @@ void imgui_generic()
             if(ImGui::MenuItem("Open"))
             {   
                 plat::FilePath path = {0};
-                if(plat::show_file_prompt(&path))
+                if(plat::show_file_prompt(&path, "ch8"))
                 {
                     load_rom(path);
                     reset();
+                    rewind_clear(&rewind_history);
                     c8.loaded = true;
                 }
                 else
@@ -93,6 +122,7 @@ void imgui_generic()
                 if(c8.loaded)
                 {
                     reset();
+                    rewind_clear(&rewind_history);
                     c8.loaded = true;
                 }
                 else
@@ -102,8 +132,44 @@ void imgui_generic()
             }
             ImGui::EndMenu();
         }
+        imgui_rewind(&rewind_history);
+        imgui_movie(&movie_state);
+        if(ImGui::BeginMenu("View"))
+        {
+            imgui_profile_menu();
+            ImGui::Separator();
+            imgui_perf_menu();
+            ImGui::EndMenu();
+        }
+        imgui_trace_menu();
+        imgui_debugger_menu();
+        imgui_write_log_menu();
+        imgui_breakpoints_menu();
+        imgui_watch_menu();
+        imgui_disasm_menu();
+        imgui_memview_menu();
+        imgui_search_menu();
+        imgui_coverage_menu();
+        if(ImGui::BeginMenu("Run-ahead"))
+        {
+            ImGui::SliderInt("Frames", &run_ahead_state.frames, 0, 4);
+            ImGui::Text("Extra cost: %.1f us, %.0f instructions per frame", run_ahead_state.cost_us_per_frame, run_ahead_state.ops_per_frame);
+            ImGui::EndMenu();
+        }
         ImGui::EndMainMenuBar();
     }
+
+    imgui_profile_windows();
+    imgui_perf_overlay();
+    imgui_trace_windows();
+    imgui_debugger_windows();
+    imgui_write_log_windows();
+    imgui_breakpoints_windows();
+    imgui_watch_windows();
+    imgui_disasm_windows();
+    imgui_memview_windows();
+    imgui_search_windows();
+    imgui_coverage_windows();
 }
 #else
 #define imgui_generic(...)
@@ -111,30 +177,368 @@ void imgui_generic()
 
 void next_op()
 {
-    uint16_t op = (c8.memory[c8.pc] << 8) | (c8.memory[c8.pc+1]);
+    uint16_t pc = c8.pc;
+    // A jump to 0xFFF leaves no room for the second byte.
+    C8E_ASSERT(pc+1 < MEMORY_SIZE);
+    uint16_t op = (c8.memory[pc] << 8) | (c8.memory[pc+1]);
+    // History the debugger re-runs is in the trace already; recording it again would send the
+    // cycles backwards.
+    TraceEvent* trace_event = tracer.enabled && !debugger.replaying ? trace_begin(op) : 0;
+#ifdef USE_OP_COUNTERS
+    count_op(op);
+#else
     execute_op(op);
+#endif
+    if(trace_event)
+        trace_end(trace_event);
+    if(coverage.enabled)
+        coverage_record(&coverage, pc, op);
     c8.pc+=2;
-    assert(c8.pc < MEMORY_SIZE);
+    c8.cycle++;
+    C8E_ASSERT(c8.pc < MEMORY_SIZE);
 }
 
 void update_timers()
 {
+    C8E_ZONE("update_timers");
     if(c8.vd > 0)
+    {
         c8.vd--;
+        if(c8.vd == 0)
+            C8E_PROBE2(timer_expired, 0, c8.frame);
+    }
     if(c8.vs > 0)
+    {
         c8.vs--;
+        if(c8.vs == 0)
+            C8E_PROBE2(timer_expired, 1, c8.frame);
+    }
+}
+
+// A frame is begin_frame, next_op as many times as it returns, then end_frame. run_frame does
+// it in one go; the debugger steps through it an instruction at a time.
+int begin_frame()
+{
+    if(debugger.enabled && !c8.speculating)
+        debug_frame_begin();
+    update_timers();
+
+    int ops = (int)(c8.ips / 60);
+    c8.frame_carry += c8.ips % 60;
+    if(c8.frame_carry >= 60)
+    {
+        c8.frame_carry -= 60;
+        ops++;
+    }
+    C8E_PROBE2(frame_start, c8.frame, ops);
+    return ops;
+}
+
+void end_frame(int ops)
+{
+    C8E_ZONE_COUNTER("ops", ops);
+    C8E_PROBE2(frame_end, c8.frame, ops);
+    if(tracer.enabled)
+        trace_drain();
+    if(watches.count && !c8.speculating)
+        watch_sample();
+
+    c8.frame++;
+}
+
+// Runs one 60 Hz tick: the timers, then ips/60 instructions. Returns the number of instructions run.
+int run_frame()
+{
+    C8E_ZONE("run_frame");
+    int ops = begin_frame();
+    if(breakpoints.armed && !c8.speculating)
+    {
+        // Checked an instruction at a time. A hit leaves the rest of the frame to the debugger.
+        int ran = break_run(ops);
+        if(ran < ops)
+        {
+            debugger.frame_ops = ops;
+            debugger.frame_ops_left = ops - ran;
+            return ran;
+        }
+        end_frame(ops);
+        return ops;
+    }
+
+    for(int n = 0; n < ops; n++)
+    {
+        next_op();
+    }
+    end_frame(ops);
+    return ops;
+}
+
+void display_to_rgba(const uint64_t* display, uint32_t* pixels, size_t pitch)
+{
+    // pitch is in pixels
+    for(int y = 0; y < c8.display_h; y++)
+    {
+        uint32_t* row = pixels + y*pitch;
+        uint64_t bits = display[y];
+        for(int x = 0; x < c8.display_w; x++)
+        {
+            row[x] = 0u - (uint32_t)((bits >> (63 - x)) & 1);
+        }
+    }
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Word-at-a-time multiply/rotate hash with a murmur3 finalizer. Fast, not cryptographic.
+uint64_t hash64(const void* data, size_t size, uint64_t seed)
+{
+    const uint64_t K1 = 0x9E3779B97F4A7C15ull;
+    const uint64_t K2 = 0xC2B2AE3D27D4EB4Full;
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t h = seed ^ (size * K1);
+
+    while(size >= 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h ^= w * K2;
+        h = rotl64(h, 31) * K1;
+        p += 8;
+        size -= 8;
+    }
+    if(size)
+    {
+        uint64_t w = 0;
+        memcpy(&w, p, size);
+        h ^= w * K2;
+        h = rotl64(h, 31) * K1;
+    }
+    return mix64(h);
+}
+
+void invalidate_hashes()
+{
+    memset(c8.row_hash, 0, 32*sizeof(*c8.row_hash));
+    memset(c8.page_hash, 0, 16*sizeof(*c8.page_hash));
+    c8.display_hash = 0;
+    c8.memory_hash = 0;
+    c8.dirty_rows = 0xFFFFFFFF;
+    c8.dirty_pages = 0xFFFF;
+}
+
+// Anything that writes c8.memory outside of execute_op must call this.
+void mark_memory_written(uint16_t addr, uint16_t count)
+{
+    if(!count)
+        return;
+    uint16_t last = (addr + count - 1) % MEMORY_SIZE;
+    for(int page = addr >> 8; ; page = (page + 1) & 0xF)
+    {
+        c8.dirty_pages |= (uint16_t)(1 << page);
+        if(page == last >> 8)
+            break;
+    }
+    if(write_log.enabled && !c8.speculating)
+        write_log_record(&write_log, addr, count);
+    if(disasm.valid && !disasm.dirty)
+        disasm_note_write(addr, count);
+}
+
+// The display hash is the XOR of per-row hashes salted with the row number, so a frame
+// only pays for the rows drawn since the last call.
+uint64_t hash_display()
+{
+    if(c8.dirty_rows)
+    {
+        for(int y = 0; y < 32; y++)
+        {
+            if(!(c8.dirty_rows & (1u << y)))
+                continue;
+            uint64_t h = mix64(c8.display[y] ^ ((y + 1) * 0x9E3779B97F4A7C15ull));
+            c8.display_hash ^= c8.row_hash[y] ^ h;
+            c8.row_hash[y] = h;
+        }
+        c8.dirty_rows = 0;
+    }
+    return c8.display_hash;
+}
+
+// Everything that affects what the machine does next: display, memory, registers, stack,
+// timers, keys and RNG. The frame and cycle counters are left out so identical states
+// reached at different times hash the same.
+uint64_t hash_state()
+{
+    if(c8.dirty_pages)
+    {
+        for(int page = 0; page < 16; page++)
+        {
+            if(!(c8.dirty_pages & (1u << page)))
+                continue;
+            uint64_t h = hash64(c8.memory + page*256, 256, page + 1);
+            c8.memory_hash ^= c8.page_hash[page] ^ h;
+            c8.page_hash[page] = h;
+        }
+        c8.dirty_pages = 0;
+    }
+
+    struct
+    {
+        uint16_t stack[16];
+        uint8_t v[16];
+        uint32_t rng;
+        uint16_t keys;
+        uint16_t i;
+        uint16_t pc;
+        uint8_t vd;
+        uint8_t vs;
+        uint8_t sp;
+        uint8_t frame_carry;
+        uint8_t reserved[2];
+    } registers;
+    memcpy(registers.stack, c8.stack, 16*sizeof(*c8.stack));
+    memcpy(registers.v, c8.v, 16*sizeof(*c8.v));
+    registers.rng = c8.rng;
+    registers.keys = 0;
+    for(int k = 0; k < 16; k++)
+    {
+        registers.keys |= (uint16_t)((c8.keys[k] != 0) << k);
+    }
+    registers.i = c8.i;
+    registers.pc = c8.pc;
+    registers.vd = c8.vd;
+    registers.vs = c8.vs;
+    registers.sp = c8.sp;
+    registers.frame_carry = c8.frame_carry;
+    registers.reserved[0] = 0;
+    registers.reserved[1] = 0;
+
+    return hash64(&registers, sizeof(registers), hash_display() ^ rotl64(c8.memory_hash, 17));
+}
+
+uint64_t hash_rom()
+{
+    return hash64(c8.rom, (MEMORY_SIZE - PROGRAM_OFFSET)*sizeof(*c8.rom), 0);
+}
+
+const uint64_t* presented_display()
+{
+    return run_ahead_state.valid ? run_ahead_state.display : c8.display;
+}
+
+// Emulates run_ahead->frames frames with the current input, keeps that display for presenting,
+// then puts the machine back. Returns the number of extra instructions run.
+int run_ahead(RunAhead* run_ahead)
+{
+    C8E_ZONE("run_ahead");
+    if(run_ahead->frames <= 0)
+    {
+        run_ahead->valid = false;
+        return 0;
+    }
+
+    save_snapshot(&run_ahead->saved);
+    // Keep the speculative frames out of the debugger history, the instruction trace and coverage.
+    bool tracing = tracer.enabled;
+    bool covering = coverage.enabled;
+    tracer.enabled = false;
+    coverage.enabled = false;
+    c8.speculating = true;
+    int ops = 0;
+    for(int f = 0; f < run_ahead->frames; f++)
+    {
+        ops += run_frame();
+    }
+    c8.speculating = false;
+    tracer.enabled = tracing;
+    coverage.enabled = covering;
+    memcpy(run_ahead->display, c8.display, 32*sizeof(*c8.display));
+    load_snapshot(&run_ahead->saved);
+
+    run_ahead->valid = true;
+    return ops;
+}
+
+void save_snapshot(Snapshot* snapshot)
+{
+    memcpy(snapshot->memory, c8.memory, MEMORY_SIZE*sizeof(*c8.memory));
+    memcpy(snapshot->display, c8.display, 32*sizeof(*c8.display));
+    memcpy(snapshot->stack, c8.stack, 16*sizeof(*c8.stack));
+    memcpy(snapshot->v, c8.v, 16*sizeof(*c8.v));
+
+    uint16_t keys = 0;
+    for(int k = 0; k < 16; k++)
+    {
+        keys |= (uint16_t)((c8.keys[k] != 0) << k);
+    }
+    snapshot->keys = keys;
+
+    snapshot->i = c8.i;
+    snapshot->pc = c8.pc;
+    snapshot->vd = c8.vd;
+    snapshot->vs = c8.vs;
+    snapshot->sp = c8.sp;
+    snapshot->rng = c8.rng;
+    snapshot->frame = c8.frame;
+    snapshot->cycle = c8.cycle;
+    snapshot->frame_carry = c8.frame_carry;
+    snapshot->reserved[0] = 0;
+    snapshot->reserved[1] = 0;
+}
+
+void load_snapshot(const Snapshot* snapshot)
+{
+    memcpy(c8.memory, snapshot->memory, MEMORY_SIZE*sizeof(*c8.memory));
+    memcpy(c8.display, snapshot->display, 32*sizeof(*c8.display));
+    memcpy(c8.stack, snapshot->stack, 16*sizeof(*c8.stack));
+    memcpy(c8.v, snapshot->v, 16*sizeof(*c8.v));
+
+    for(int k = 0; k < 16; k++)
+    {
+        c8.keys[k] = (snapshot->keys >> k) & 1;
+    }
+
+    c8.i = snapshot->i;
+    c8.pc = snapshot->pc;
+    c8.vd = snapshot->vd;
+    c8.vs = snapshot->vs;
+    c8.sp = snapshot->sp;
+    c8.rng = snapshot->rng;
+    c8.frame = snapshot->frame;
+    c8.cycle = snapshot->cycle;
+    c8.frame_carry = snapshot->frame_carry;
+    c8.update_display = true;
+    debugger.frame_ops_left = 0; // snapshots are taken at frame boundaries
+    invalidate_hashes();
+    disasm_invalidate();
+    if(write_log.enabled)
+        write_log_resync(&write_log);
 }
 
 static inline void op_cls()
 {
-    memset(c8.display, 0, 64*32*sizeof(*c8.display));
+    memset(c8.display, 0, 32*sizeof(*c8.display));
+    c8.dirty_rows = 0xFFFFFFFF;
     c8.update_display = true;
+    C8E_PROBE2(display_update, c8.pc, c8.frame);
 }
 
 static inline void op_ret()
 {
     // See op_call comment, the same is true here. Cowgod says what should actually be the opposite, unless Cowgod knows something I don't
-    assert(c8.sp > 0);
+    C8E_ASSERT(c8.sp > 0);
     c8.pc = c8.stack[--c8.sp];
     //c8.pc-=2;
 }
@@ -149,7 +553,7 @@ static inline void op_call(uint16_t addr)
 {
     // Cowgod says to increment BEFORE placing on the stack, but that doesn't make any sense to me. 
     // If we increment first, then the 0th index is not used.
-    assert(c8.sp < 16);
+    C8E_ASSERT(c8.sp < 16);
     c8.stack[c8.sp++] = c8.pc;
     op_jp(addr);
 }
@@ -252,14 +656,25 @@ static inline void op_st_i(uint16_t addr)
     c8.i = addr;
 }
 
-static inline void op_jp_v0(uint8_t addr)
+static inline void op_jp_v0(uint16_t addr)
 {
     op_jp(addr + c8.v[0]);
 }
 
+static inline uint32_t next_random()
+{
+    // xorshift32. Unlike rand(), the state lives in c8 so snapshots and replays stay deterministic.
+    uint32_t r = c8.rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    c8.rng = r;
+    return r;
+}
+
 static inline void op_rnd(uint8_t x, uint8_t byte)
 {
-    c8.v[x] = rand() & byte;
+    c8.v[x] = next_random() & byte;
 }
 
 static inline void op_drw(uint8_t x, uint8_t y, uint8_t nibble)
@@ -268,39 +683,29 @@ static inline void op_drw(uint8_t x, uint8_t y, uint8_t nibble)
     uint8_t y_coord = c8.v[y] % c8.display_h;
     c8.v[0xF] = 0;
 
-    for(uint8_t i = 0; i < nibble; i++)
+    // Sprites are clipped at the right and bottom edges. Shifting the sprite into place drops
+    // the columns that fall off the right side.
+    for(uint8_t i = 0; i < nibble && y_coord+i < c8.display_h; i++)
     {
-        uint8_t sprite_data = c8.memory[c8.i+i];
-        for(int j = 0; j < 8; j++)
+        uint64_t sprite_row = ((uint64_t)c8.memory[c8.i+i] << 56) >> x_coord;
+        uint64_t* row = &c8.display[y_coord+i];
+        if(*row & sprite_row)
         {
-            if((sprite_data & 0x80) && c8.display[x_coord+j + (y_coord+i)*c8.display_w])
-            {
-                c8.v[0xF] = 1;
-            }
-
-            c8.display[x_coord+j + (y_coord+i)*c8.display_w] ^= (sprite_data & 0x80) ? 0xFFFFFFFF : 0x00000000;
-
-            sprite_data <<= 1;
-
-            if(x_coord+j >= c8e::c8.display_w)
-            {
-                break;
-            }
-        }
-        if(y_coord+i >= c8e::c8.display_h)
-        {
-            break;
+            c8.v[0xF] = 1;
         }
+        *row ^= sprite_row;
+        c8.dirty_rows |= 1u << (y_coord+i);
     }
 
     c8.update_display = true;
+    C8E_PROBE2(display_update, c8.pc, c8.frame);
 }
 
 static inline void op_skp(uint8_t x)
 {
     // TODO: I am skeptical of whether or not the index is vx or just x...
     //plat::update_input();
-    if(c8.keys[c8.v[x]])
+    if(c8.keys[c8.v[x] & 0xF])
     {
         c8.pc+=2;
     }
@@ -310,7 +715,7 @@ static inline void op_sknp(uint8_t x)
 {
     // TODO: I am skeptical of whether or not the index is vx or just x...
     //plat::update_input();
-    if(!c8.keys[c8.v[x]])
+    if(!c8.keys[c8.v[x] & 0xF])
     {
         c8.pc+=2;
     }
@@ -321,6 +726,10 @@ static inline void op_ld_vd(uint8_t x)
     c8.v[x] = c8.vd;
 }
 
+#ifdef USE_PROBES
+static bool g_key_wait_blocked = false; // only edges are probed, not every spin of Fx0A
+#endif
+
 static inline void op_ld_key(uint8_t x)
 {
     //plat::update_input();
@@ -329,9 +738,23 @@ static inline void op_ld_key(uint8_t x)
         if(c8.keys[i])
         {
             c8.v[x] = i;
+#ifdef USE_PROBES
+            if(g_key_wait_blocked)
+            {
+                g_key_wait_blocked = false;
+                C8E_PROBE2(key_wait_unblock, c8.pc, i);
+            }
+#endif
             return;
         }
     }
+#ifdef USE_PROBES
+    if(!g_key_wait_blocked)
+    {
+        g_key_wait_blocked = true;
+        C8E_PROBE2(key_wait_block, c8.pc, x);
+    }
+#endif
     c8.pc -= 2; // TODO: This is hacky. A better way may be to return a flag to tell the virtual CPU to update the program counter
 }
 
@@ -358,7 +781,7 @@ static inline void op_ld_f(uint8_t x)
 
 static inline void op_ld_b(uint8_t x)
 {
-    assert(c8.i+2 < MEMORY_SIZE && c8.i < MEMORY_SIZE);
+    C8E_ASSERT(c8.i+2 < MEMORY_SIZE && c8.i < MEMORY_SIZE);
 
     int hundreds = c8.v[x] / 100;
     int tens = (c8.v[x] / 10) % 10;
@@ -367,22 +790,24 @@ static inline void op_ld_b(uint8_t x)
     c8.memory[c8.i] = hundreds;
     c8.memory[c8.i+1] = tens;
     c8.memory[c8.i+2] = ones;
+    mark_memory_written(c8.i, 3);
 }
 
 static inline void op_ld_v(uint8_t x)
 {
-    assert(c8.i+x < MEMORY_SIZE && c8.i < MEMORY_SIZE);
+    C8E_ASSERT(c8.i+x < MEMORY_SIZE && c8.i < MEMORY_SIZE);
 
     for(int i = 0; i <= x; i++)
     {
         c8.memory[c8.i + i] = c8.v[i];
     }
+    mark_memory_written(c8.i, x + 1);
     //c8.i += x + 1;
 }
 
 static inline void op_st_v(uint8_t x)
 {
-    assert(c8.i+x < MEMORY_SIZE && c8.i < MEMORY_SIZE);
+    C8E_ASSERT(c8.i+x < MEMORY_SIZE && c8.i < MEMORY_SIZE);
     
     for(int i = 0; i <= x; i++)
     {
@@ -397,6 +822,114 @@ static inline void op_st_v(uint8_t x)
 #define op_kk(kk) (kk & 0xFF)
 #define op_n(n) (n & 0xF)
 
+OpClass op_class(uint16_t op)
+{
+    switch(op & 0xF000)
+    {
+        case 0x0000:
+            if(op == 0x00E0) return OP_CLS;
+            if(op == 0x00EE) return OP_RET;
+            return OP_SYS;
+        case 0x1000: return OP_JP;
+        case 0x2000: return OP_CALL;
+        case 0x3000: return OP_SE_IMM;
+        case 0x4000: return OP_SNE_IMM;
+        case 0x5000: return OP_SE;
+        case 0x6000: return OP_LD_IMM;
+        case 0x7000: return OP_ADD_IMM;
+        case 0x8000:
+            switch(op & 0xF)
+            {
+                case 0: return OP_LD;
+                case 1: return OP_OR;
+                case 2: return OP_AND;
+                case 3: return OP_XOR;
+                case 4: return OP_ADD;
+                case 5: return OP_SUB;
+                case 6: return OP_SHR;
+                case 7: return OP_SUBN;
+                case 0xE: return OP_SHL;
+            }
+            return OP_UNKNOWN;
+        case 0x9000: return OP_SNE;
+        case 0xA000: return OP_ST_I;
+        case 0xB000: return OP_JP_V0;
+        case 0xC000: return OP_RND;
+        case 0xD000: return OP_DRW;
+        case 0xE000:
+            switch(op & 0xFF)
+            {
+                case 0x9E: return OP_SKP;
+                case 0xA1: return OP_SKNP;
+            }
+            return OP_UNKNOWN;
+        case 0xF000:
+            switch(op & 0xFF)
+            {
+                case 0x07: return OP_LD_VD;
+                case 0x0A: return OP_LD_KEY;
+                case 0x15: return OP_ST_VD;
+                case 0x18: return OP_ST_VS;
+                case 0x1E: return OP_ADD_I;
+                case 0x29: return OP_LD_F;
+                case 0x33: return OP_LD_B;
+                case 0x55: return OP_LD_V;
+                case 0x65: return OP_ST_V;
+            }
+            return OP_UNKNOWN;
+    }
+    return OP_UNKNOWN;
+}
+
+// Cowgod's mnemonics.
+void disassemble(uint16_t op, char* buf, int size)
+{
+    int x = op_x(op);
+    int y = op_y(op);
+    int kk = op_kk(op);
+    int nnn = op_nnn(op);
+
+    switch(op_class(op))
+    {
+        case OP_CLS:     snprintf(buf, size, "CLS"); break;
+        case OP_RET:     snprintf(buf, size, "RET"); break;
+        case OP_SYS:     snprintf(buf, size, "SYS %03X", nnn); break;
+        case OP_JP:      snprintf(buf, size, "JP %03X", nnn); break;
+        case OP_CALL:    snprintf(buf, size, "CALL %03X", nnn); break;
+        case OP_SE_IMM:  snprintf(buf, size, "SE V%X, %02X", x, kk); break;
+        case OP_SNE_IMM: snprintf(buf, size, "SNE V%X, %02X", x, kk); break;
+        case OP_SE:      snprintf(buf, size, "SE V%X, V%X", x, y); break;
+        case OP_LD_IMM:  snprintf(buf, size, "LD V%X, %02X", x, kk); break;
+        case OP_ADD_IMM: snprintf(buf, size, "ADD V%X, %02X", x, kk); break;
+        case OP_LD:      snprintf(buf, size, "LD V%X, V%X", x, y); break;
+        case OP_OR:      snprintf(buf, size, "OR V%X, V%X", x, y); break;
+        case OP_AND:     snprintf(buf, size, "AND V%X, V%X", x, y); break;
+        case OP_XOR:     snprintf(buf, size, "XOR V%X, V%X", x, y); break;
+        case OP_ADD:     snprintf(buf, size, "ADD V%X, V%X", x, y); break;
+        case OP_SUB:     snprintf(buf, size, "SUB V%X, V%X", x, y); break;
+        case OP_SHR:     snprintf(buf, size, "SHR V%X", x); break;
+        case OP_SUBN:    snprintf(buf, size, "SUBN V%X, V%X", x, y); break;
+        case OP_SHL:     snprintf(buf, size, "SHL V%X", x); break;
+        case OP_SNE:     snprintf(buf, size, "SNE V%X, V%X", x, y); break;
+        case OP_ST_I:    snprintf(buf, size, "LD I, %03X", nnn); break;
+        case OP_JP_V0:   snprintf(buf, size, "JP V0, %03X", nnn); break;
+        case OP_RND:     snprintf(buf, size, "RND V%X, %02X", x, kk); break;
+        case OP_DRW:     snprintf(buf, size, "DRW V%X, V%X, %X", x, y, op_n(op)); break;
+        case OP_SKP:     snprintf(buf, size, "SKP V%X", x); break;
+        case OP_SKNP:    snprintf(buf, size, "SKNP V%X", x); break;
+        case OP_LD_VD:   snprintf(buf, size, "LD V%X, DT", x); break;
+        case OP_LD_KEY:  snprintf(buf, size, "LD V%X, K", x); break;
+        case OP_ST_VD:   snprintf(buf, size, "LD DT, V%X", x); break;
+        case OP_ST_VS:   snprintf(buf, size, "LD ST, V%X", x); break;
+        case OP_ADD_I:   snprintf(buf, size, "ADD I, V%X", x); break;
+        case OP_LD_F:    snprintf(buf, size, "LD F, V%X", x); break;
+        case OP_LD_B:    snprintf(buf, size, "LD B, V%X", x); break;
+        case OP_LD_V:    snprintf(buf, size, "LD [I], V%X", x); break;
+        case OP_ST_V:    snprintf(buf, size, "LD V%X, [I]", x); break;
+        default:         snprintf(buf, size, "DW %04X", op); break;
+    }
+}
+
 static inline void execute_op(uint16_t op)
 {
     switch(op & 0xF000)
@@ -487,7 +1020,7 @@ static inline void execute_op(uint16_t op)
                     op_skp(op_x(op));
                     break;
                 case 0xA1:
-                    op_skp(op_x(op));
+                    op_sknp(op_x(op));
                     break;
             }
             break;
@@ -1,7 +1,13 @@
 #pragma once
+#include <assert.h>
 #include <stdint.h>
 #include "chip8emu_platform.h"
 
+// For the checks a ROM can trip: stack underflow and overflow, I or the pc past the end of memory.
+// They are plain asserts unless assert_handler is set, which is then called in every build. The
+// headless fuzzer sets one that longjmps out of the frame.
+#define C8E_ASSERT(expr) do { if(!(expr) && c8e::assert_handler) c8e::assert_handler(#expr, __FILE__, __LINE__); assert(expr); } while(0)
+
 namespace c8e
 {
 
@@ -35,7 +41,7 @@ struct Chip8
 
 	int keys[16];
 	uint16_t stack[16];
-	uint32_t display[2048]; // bools
+	uint64_t display[32]; // one row per word, leftmost pixel in the top bit
 	uint8_t memory[MEMORY_SIZE];
 	uint8_t rom[MEMORY_SIZE - PROGRAM_OFFSET];
 	uint8_t v[16]; // general-purpose registers
@@ -47,15 +53,157 @@ struct Chip8
 
 	bool loaded;
 	bool update_display;
+	bool speculating; // inside run-ahead frames, which the debugging tools must not record
 
 	long long ips;
+	uint64_t frame; // frames run since reset
+	uint64_t cycle; // instructions run since reset
+	uint8_t frame_carry; // accumulates ips % 60 so each second runs exactly ips instructions
+
+	uint32_t seed; // 0 means DEFAULT_SEED
+	uint32_t rng;  // xorshift32 state, so runs are reproducible from a snapshot
+
+	// Hash caches, see hash_display and hash_state. Rows and 256-byte memory pages are
+	// rehashed only after something writes to them.
+	uint32_t dirty_rows;
+	uint16_t dirty_pages;
+	uint64_t row_hash[32];
+	uint64_t page_hash[16];
+	uint64_t display_hash;
+	uint64_t memory_hash;
 
 } c8; // TODO: this is a global for now.
 
+const uint32_t DEFAULT_SEED = 0x2545F491;
+
+typedef void (*AssertHandler)(const char* expression, const char* file, int line);
+AssertHandler assert_handler;
+
+// Only the state that changes while a program runs. The ROM is left out, since it only changes in load_rom.
+// Keep this free of padding: the rewind buffer diffs snapshots byte by byte.
+struct Snapshot
+{
+	uint8_t memory[MEMORY_SIZE];
+	uint64_t display[32];
+	uint64_t frame;
+	uint64_t cycle;
+	uint16_t stack[16];
+	uint32_t rng;
+	uint16_t keys; // one bit per key
+	uint16_t i;
+	uint16_t pc;
+	uint8_t v[16];
+	uint8_t vd;
+	uint8_t vs;
+	uint8_t sp;
+	uint8_t frame_carry;
+	uint8_t reserved[2];
+};
+
+// One per handler in execute_op.
+enum OpClass
+{
+	OP_CLS, OP_RET, OP_SYS,
+	OP_JP, OP_CALL, OP_SE_IMM, OP_SNE_IMM, OP_SE, OP_LD_IMM, OP_ADD_IMM,
+	OP_LD, OP_OR, OP_AND, OP_XOR, OP_ADD, OP_SUB, OP_SHR, OP_SUBN, OP_SHL,
+	OP_SNE, OP_ST_I, OP_JP_V0, OP_RND, OP_DRW, OP_SKP, OP_SKNP,
+	OP_LD_VD, OP_LD_KEY, OP_ST_VD, OP_ST_VS, OP_ADD_I, OP_LD_F, OP_LD_B, OP_LD_V, OP_ST_V,
+	OP_UNKNOWN,
+	OP_CLASS_COUNT,
+};
+
+const char* const OP_CLASS_NAMES[OP_CLASS_COUNT] =
+{
+	"CLS", "RET", "SYS",
+	"JP", "CALL", "SE Vx,kk", "SNE Vx,kk", "SE Vx,Vy", "LD Vx,kk", "ADD Vx,kk",
+	"LD Vx,Vy", "OR", "AND", "XOR", "ADD Vx,Vy", "SUB", "SHR", "SUBN", "SHL",
+	"SNE Vx,Vy", "LD I", "JP V0", "RND", "DRW", "SKP", "SKNP",
+	"LD Vx,DT", "LD Vx,K", "LD DT", "LD ST", "ADD I", "LD F", "LD B", "LD [I]", "LD Vx,[I]",
+	"???",
+};
+
+OpClass op_class(uint16_t op);
+void disassemble(uint16_t op, char* buf, int size);
+
 void load_rom(plat::FilePath path);
 void reset();
 void initialize();
 void imgui_generic();
 void next_op();
 void update_timers();
+int begin_frame();
+void end_frame(int ops);
+int run_frame();
+
+// Hides the game's own input lag by presenting a frame emulated ahead of the real one.
+struct RunAhead
+{
+	int frames; // how far ahead, 0 disables
+	bool valid; // display holds a speculative frame
+	uint64_t display[32];
+	Snapshot saved;
+
+	// Filled in by the platform once per second.
+	float cost_us_per_frame;
+	float ops_per_frame;
+};
+
+RunAhead run_ahead_state;
+
+void display_to_rgba(const uint64_t* display, uint32_t* pixels, size_t pitch);
+const uint64_t* presented_display();
+int run_ahead(RunAhead* run_ahead);
+
+void save_snapshot(Snapshot* snapshot);
+void load_snapshot(const Snapshot* snapshot);
+
+uint64_t hash64(const void* data, size_t size, uint64_t seed);
+uint64_t hash_display();
+uint64_t hash_state();
+uint64_t hash_rom();
+void invalidate_hashes();
+void mark_memory_written(uint16_t addr, uint16_t count);
+
+// LEB128 varints, used by the rewind buffer and the file formats.
+static inline uint8_t* write_varint(uint8_t* out, uint64_t value)
+{
+	while(value >= 0x80)
+	{
+		*out++ = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = (uint8_t)value;
+	return out;
+}
+
+static inline const uint8_t* read_varint(const uint8_t* in, uint64_t* value)
+{
+	uint64_t result = 0;
+	int shift = 0;
+	while(*in & 0x80)
+	{
+		result |= (uint64_t)(*in++ & 0x7F) << shift;
+		shift += 7;
+	}
+	result |= (uint64_t)(*in++) << shift;
+	*value = result;
+	return in;
+}
+
+// For data from files: 0 if the varint runs past end or is too long.
+static inline const uint8_t* read_varint_bounded(const uint8_t* in, const uint8_t* end, uint64_t* value)
+{
+	uint64_t result = 0;
+	for(int shift = 0; in < end && shift < 64; shift += 7)
+	{
+		uint8_t byte = *in++;
+		result |= (uint64_t)(byte & 0x7F) << shift;
+		if(!(byte & 0x80))
+		{
+			*value = result;
+			return in;
+		}
+	}
+	return 0;
+}
 };
\ No newline at end of file
@@ -0,0 +1,614 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_breakpoints.h"
+#include "chip8emu_debugger.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace c8e
+{
+
+static const char* BREAK_REGISTER_NAMES[BREAK_REG_COUNT] =
+{
+    "V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7", "V8", "V9", "VA", "VB", "VC", "VD", "VE", "VF",
+    "I", "DT", "ST", "SP",
+};
+
+static const char* BREAK_COMPARE_NAMES[BREAK_COMPARE_COUNT] = {"==", "!=", "<", "<=", ">", ">="};
+
+void breakpoints_update()
+{
+    Breakpoints* b = &breakpoints;
+    b->pc_count = 0;
+    for(int word = 0; word < MEMORY_SIZE / 64; word++)
+    {
+        for(uint64_t bits = b->pc[word]; bits; bits &= bits - 1)
+            b->pc_count++;
+    }
+    b->others = false;
+    for(int w = 0; w < b->watch_count; w++)
+        b->others |= b->watches[w].enabled;
+    for(int o = 0; o < b->opcode_count; o++)
+        b->others |= b->opcodes[o].enabled;
+    for(int c = 0; c < b->condition_count; c++)
+        b->others |= b->conditions[c].enabled;
+    for(int e = 0; e < b->expression_count; e++)
+        b->others |= b->expressions[e].enabled;
+    b->armed = b->pc_count > 0 || b->others;
+}
+
+void break_toggle_pc(uint16_t pc)
+{
+    pc %= MEMORY_SIZE;
+    breakpoints.pc[pc / 64] ^= 1ull << (pc % 64);
+    if(!break_has_pc(pc))
+        break_set_pc_condition(pc, "");
+    breakpoints_update();
+}
+
+bool break_has_pc(uint16_t pc)
+{
+    pc %= MEMORY_SIZE;
+    return (breakpoints.pc[pc / 64] >> (pc % 64)) & 1;
+}
+
+bool break_add_watch(uint16_t first, uint16_t last, uint8_t access)
+{
+    if(breakpoints.watch_count == BREAK_MAX_WATCHES || first > last || !access)
+        return false;
+    MemoryWatch* watch = &breakpoints.watches[breakpoints.watch_count++];
+    watch->enabled = true;
+    watch->access = access;
+    watch->first = first;
+    watch->last = last;
+    breakpoints_update();
+    return true;
+}
+
+bool break_add_opcode(uint16_t mask, uint16_t value)
+{
+    if(breakpoints.opcode_count == BREAK_MAX_OPCODES)
+        return false;
+    OpcodeBreak* opcode = &breakpoints.opcodes[breakpoints.opcode_count++];
+    opcode->enabled = true;
+    opcode->mask = mask;
+    opcode->value = value & mask;
+    breakpoints_update();
+    return true;
+}
+
+bool break_add_condition(uint8_t reg, uint8_t compare, uint16_t value)
+{
+    if(breakpoints.condition_count == BREAK_MAX_CONDITIONS || reg >= BREAK_REG_COUNT || compare >= BREAK_COMPARE_COUNT)
+        return false;
+    RegisterBreak* condition = &breakpoints.conditions[breakpoints.condition_count++];
+    condition->enabled = true;
+    condition->was_true = false; // already true counts as becoming true
+    condition->reg = reg;
+    condition->compare = compare;
+    condition->value = value;
+    breakpoints_update();
+    return true;
+}
+
+bool break_add_expression(const char* text)
+{
+    if(breakpoints.expression_count == BREAK_MAX_EXPRESSIONS)
+        return false;
+    ExprBreak* expression = &breakpoints.expressions[breakpoints.expression_count];
+    if(!expr_compile(&expression->expr, text))
+        return false;
+    snprintf(expression->text, sizeof(expression->text), "%s", text);
+    expression->enabled = true;
+    expression->was_true = false;
+    breakpoints.expression_count++;
+    breakpoints_update();
+    return true;
+}
+
+const PcCondition* break_pc_condition(uint16_t pc)
+{
+    for(int c = 0; c < breakpoints.pc_condition_count; c++)
+    {
+        if(breakpoints.pc_conditions[c].pc == pc)
+            return &breakpoints.pc_conditions[c];
+    }
+    return 0;
+}
+
+bool break_set_pc_condition(uint16_t pc, const char* text)
+{
+    pc %= MEMORY_SIZE;
+    PcCondition* condition = (PcCondition*)break_pc_condition(pc);
+    if(!text[0])
+    {
+        if(condition)
+            *condition = breakpoints.pc_conditions[--breakpoints.pc_condition_count];
+        return true;
+    }
+
+    if(!condition)
+    {
+        if(breakpoints.pc_condition_count == BREAK_MAX_PC_CONDITIONS)
+            return false;
+        condition = &breakpoints.pc_conditions[breakpoints.pc_condition_count];
+    }
+    Expr expr;
+    if(!expr_compile(&expr, text))
+        return false;
+    if(condition == &breakpoints.pc_conditions[breakpoints.pc_condition_count])
+        breakpoints.pc_condition_count++;
+    condition->pc = pc;
+    condition->expr = expr;
+    snprintf(condition->text, sizeof(condition->text), "%s", text);
+    breakpoints.pc[pc / 64] |= 1ull << (pc % 64);
+    breakpoints_update();
+    return true;
+}
+
+static bool pc_condition_holds(uint16_t pc)
+{
+    for(int c = 0; c < breakpoints.pc_condition_count; c++)
+    {
+        if(breakpoints.pc_conditions[c].pc == pc)
+            return expr_eval(&breakpoints.pc_conditions[c].expr) != 0;
+    }
+    return true;
+}
+
+static uint16_t register_value(uint8_t reg)
+{
+    switch(reg)
+    {
+        case BREAK_REG_I: return c8.i;
+        case BREAK_REG_DT: return c8.vd;
+        case BREAK_REG_ST: return c8.vs;
+        case BREAK_REG_SP: return c8.sp;
+        default: return c8.v[reg & 0xF];
+    }
+}
+
+static bool condition_holds(const RegisterBreak* condition)
+{
+    uint16_t value = register_value(condition->reg);
+    switch(condition->compare)
+    {
+        case BREAK_EQ: return value == condition->value;
+        case BREAK_NE: return value != condition->value;
+        case BREAK_LT: return value < condition->value;
+        case BREAK_LE: return value <= condition->value;
+        case BREAK_GT: return value > condition->value;
+        default: return value >= condition->value;
+    }
+}
+
+// The bytes op is about to read or write, besides its own fetch.
+static bool op_memory_access(uint16_t op, uint16_t* first, uint16_t* last, uint8_t* access)
+{
+    uint8_t x = (op >> 8) & 0xF;
+    switch(op & 0xF0FF)
+    {
+        case 0xF033: *first = c8.i; *last = c8.i + 2; *access = BREAK_WRITE; return true;
+        case 0xF055: *first = c8.i; *last = c8.i + x; *access = BREAK_WRITE; return true;
+        case 0xF065: *first = c8.i; *last = c8.i + x; *access = BREAK_READ; return true;
+    }
+    if((op & 0xF000) == 0xD000 && (op & 0xF))
+    {
+        *first = c8.i;
+        *last = c8.i + (op & 0xF) - 1;
+        *access = BREAK_READ;
+        return true;
+    }
+    return false;
+}
+
+// Watches and opcodes; the index of the first match, found in *kind.
+static int match_watches_and_opcodes(uint16_t op, uint8_t* kind)
+{
+    uint16_t first, last;
+    uint8_t access;
+    if(breakpoints.watch_count && op_memory_access(op, &first, &last, &access))
+    {
+        for(int w = 0; w < breakpoints.watch_count; w++)
+        {
+            const MemoryWatch* watch = &breakpoints.watches[w];
+            if(watch->enabled && (watch->access & access) && first <= watch->last && last >= watch->first)
+            {
+                *kind = BREAK_WATCH;
+                return w;
+            }
+        }
+    }
+    for(int o = 0; o < breakpoints.opcode_count; o++)
+    {
+        const OpcodeBreak* opcode = &breakpoints.opcodes[o];
+        if(opcode->enabled && (op & opcode->mask) == opcode->value)
+        {
+            *kind = BREAK_OPCODE;
+            return o;
+        }
+    }
+    return -1;
+}
+
+// Keeps the edges of every condition and expression current, and returns the first one that
+// just became true (its kind in *kind).
+static int fired_condition(uint8_t* kind)
+{
+    int fired = -1;
+    for(int c = 0; c < breakpoints.condition_count; c++)
+    {
+        RegisterBreak* condition = &breakpoints.conditions[c];
+        if(!condition->enabled)
+            continue;
+        bool holds = condition_holds(condition);
+        if(holds && !condition->was_true && fired < 0)
+        {
+            fired = c;
+            *kind = BREAK_CONDITION;
+        }
+        condition->was_true = holds;
+    }
+    for(int e = 0; e < breakpoints.expression_count; e++)
+    {
+        ExprBreak* expression = &breakpoints.expressions[e];
+        if(!expression->enabled)
+            continue;
+        bool holds = expr_eval(&expression->expr) != 0;
+        if(holds && !expression->was_true && fired < 0)
+        {
+            fired = e;
+            *kind = BREAK_EXPRESSION;
+        }
+        expression->was_true = holds;
+    }
+    return fired;
+}
+
+static bool break_check()
+{
+    uint16_t pc = c8.pc;
+    BreakHit hit = {BREAK_NONE, 0, pc, c8.cycle};
+    if(((breakpoints.pc[pc / 64] >> (pc % 64)) & 1) && pc_condition_holds(pc))
+    {
+        hit.kind = BREAK_PC;
+        hit.index = pc;
+    }
+    if(breakpoints.others)
+    {
+        uint8_t kind;
+        int condition = fired_condition(&kind);
+        if(hit.kind == BREAK_NONE && condition >= 0)
+        {
+            hit.kind = kind;
+            hit.index = condition;
+        }
+        if(hit.kind == BREAK_NONE)
+        {
+            uint16_t op = (c8.memory[pc] << 8) | c8.memory[(pc + 1) % MEMORY_SIZE];
+            hit.index = match_watches_and_opcodes(op, &hit.kind);
+        }
+    }
+    if(hit.kind == BREAK_NONE)
+        return false;
+    breakpoints.hit = hit;
+    return true;
+}
+
+// Runs up to count instructions of the current frame and returns how many ran. Stops before
+// an instruction that hits a breakpoint and pauses the debugger.
+int break_run(int count)
+{
+    int n = 0;
+    if(breakpoints.resuming && count > 0)
+    {
+        breakpoints.resuming = false;
+        uint8_t kind;
+        if(breakpoints.others)
+            fired_condition(&kind);
+        next_op();
+        n++;
+    }
+    for(; n < count; n++)
+    {
+        if(break_check())
+        {
+            debugger.paused = true;
+            return n;
+        }
+        next_op();
+    }
+    return count;
+}
+
+// For going backwards, conditions count for as long as they hold.
+bool break_matches(void* user)
+{
+    (void)user;
+    uint16_t pc = c8.pc;
+    if(((breakpoints.pc[pc / 64] >> (pc % 64)) & 1) && pc_condition_holds(pc))
+        return true;
+    if(!breakpoints.others)
+        return false;
+    for(int c = 0; c < breakpoints.condition_count; c++)
+    {
+        if(breakpoints.conditions[c].enabled && condition_holds(&breakpoints.conditions[c]))
+            return true;
+    }
+    for(int e = 0; e < breakpoints.expression_count; e++)
+    {
+        if(breakpoints.expressions[e].enabled && expr_eval(&breakpoints.expressions[e].expr) != 0)
+            return true;
+    }
+    uint8_t kind;
+    uint16_t op = (c8.memory[pc] << 8) | c8.memory[(pc + 1) % MEMORY_SIZE];
+    return match_watches_and_opcodes(op, &kind) >= 0;
+}
+
+void break_describe(const BreakHit* hit, char* text, int size)
+{
+    switch(hit->kind)
+    {
+        case BREAK_PC:
+            snprintf(text, size, "breakpoint at %03X", hit->pc);
+            break;
+        case BREAK_WATCH:
+        {
+            const MemoryWatch* watch = &breakpoints.watches[hit->index];
+            snprintf(text, size, "%s %03X-%03X at %03X", watch->access == BREAK_READ ? "read of" :
+                     watch->access == BREAK_WRITE ? "write to" : "access to", watch->first, watch->last, hit->pc);
+            break;
+        }
+        case BREAK_OPCODE:
+        {
+            const OpcodeBreak* opcode = &breakpoints.opcodes[hit->index];
+            snprintf(text, size, "opcode & %04X == %04X at %03X", opcode->mask, opcode->value, hit->pc);
+            break;
+        }
+        case BREAK_CONDITION:
+        {
+            const RegisterBreak* condition = &breakpoints.conditions[hit->index];
+            snprintf(text, size, "%s %s %X at %03X", BREAK_REGISTER_NAMES[condition->reg],
+                     BREAK_COMPARE_NAMES[condition->compare], condition->value, hit->pc);
+            break;
+        }
+        case BREAK_EXPRESSION:
+            snprintf(text, size, "%s at %03X", breakpoints.expressions[hit->index].text, hit->pc);
+            break;
+        default:
+            snprintf(text, size, "none");
+    }
+}
+
+#ifdef USE_IMGUI
+static bool g_show_breakpoints = false;
+
+void imgui_breakpoints_menu()
+{
+    if(ImGui::BeginMenu("Debug"))
+    {
+        ImGui::MenuItem("Breakpoints", 0, &g_show_breakpoints);
+        ImGui::EndMenu();
+    }
+}
+
+// Removes element index of an array of count elements.
+static void remove_at(void* items, int* count, int index, size_t size)
+{
+    uint8_t* bytes = (uint8_t*)items;
+    memmove(bytes + index*size, bytes + (index + 1)*size, (*count - index - 1)*size);
+    (*count)--;
+}
+
+static bool hex_input(const char* label, uint16_t* value, float width)
+{
+    ImGui::SetNextItemWidth(width);
+    return ImGui::InputScalar(label, ImGuiDataType_U16, value, 0, 0, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+}
+
+void imgui_breakpoints_windows()
+{
+    if(!g_show_breakpoints)
+        return;
+
+    Breakpoints* b = &breakpoints;
+    bool changed = false;
+    ImGui::SetNextWindowSize(ImVec2(360, 420), ImGuiCond_FirstUseEver);
+    if(ImGui::Begin("Breakpoints", &g_show_breakpoints))
+    {
+        char text[64];
+        break_describe(&b->hit, text, sizeof(text));
+        ImGui::Text("Last stop: %s", text);
+        if(b->hit.kind != BREAK_NONE)
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(cycle %llu)", (unsigned long long)b->hit.cycle);
+        }
+
+        ImGui::Separator();
+        ImGui::Text("PC");
+        static uint16_t pc = PROGRAM_OFFSET;
+        static char pc_condition[EXPR_MAX_TEXT];
+        static Expr pc_condition_check;
+        static bool pc_condition_failed = false;
+        hex_input("##pc", &pc, 50);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(-70);
+        ImGui::InputTextWithHint("##pc condition", "if (optional)", pc_condition, sizeof(pc_condition));
+        ImGui::SameLine();
+        if(ImGui::Button(break_has_pc(pc) ? "Remove##pc" : "Add##pc"))
+        {
+            pc_condition_failed = false;
+            if(break_has_pc(pc) || !pc_condition[0])
+                break_toggle_pc(pc);
+            else if(expr_compile(&pc_condition_check, pc_condition))
+                break_set_pc_condition(pc, pc_condition);
+            else
+                pc_condition_failed = true;
+        }
+        if(pc_condition_failed)
+        {
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "column %d: %s", pc_condition_check.error_at + 1, pc_condition_check.error);
+        }
+        for(int word = 0; word < MEMORY_SIZE / 64; word++)
+        {
+            for(int bit = 0; b->pc[word] >> bit; bit++)
+            {
+                if(!((b->pc[word] >> bit) & 1))
+                    continue;
+                uint16_t at = (uint16_t)(word*64 + bit);
+                ImGui::PushID(at);
+                if(ImGui::SmallButton("x"))
+                    break_toggle_pc(at);
+                ImGui::SameLine();
+                const PcCondition* condition = break_pc_condition(at);
+                if(condition)
+                    ImGui::Text("%03X if %s", at, condition->text);
+                else
+                    ImGui::Text("%03X", at);
+                ImGui::PopID();
+            }
+        }
+
+        ImGui::Separator();
+        ImGui::Text("Memory");
+        static uint16_t first = 0x200;
+        static uint16_t last = 0x200;
+        static bool on_read = false;
+        static bool on_write = true;
+        hex_input("##first", &first, 50);
+        ImGui::SameLine();
+        hex_input("##last", &last, 50);
+        ImGui::SameLine();
+        ImGui::Checkbox("R", &on_read);
+        ImGui::SameLine();
+        ImGui::Checkbox("W", &on_write);
+        ImGui::SameLine();
+        if(ImGui::Button("Add##watch"))
+        {
+            break_add_watch(first, last, (on_read ? BREAK_READ : 0) | (on_write ? BREAK_WRITE : 0));
+        }
+        for(int w = 0; w < b->watch_count; w++)
+        {
+            MemoryWatch* watch = &b->watches[w];
+            ImGui::PushID(w);
+            if(ImGui::SmallButton("x"))
+            {
+                remove_at(b->watches, &b->watch_count, w, sizeof(*watch));
+                changed = true;
+                ImGui::PopID();
+                break;
+            }
+            ImGui::SameLine();
+            changed |= ImGui::Checkbox("##on", &watch->enabled);
+            ImGui::SameLine();
+            ImGui::Text("%03X-%03X %s%s", watch->first, watch->last,
+                        (watch->access & BREAK_READ) ? "R" : "", (watch->access & BREAK_WRITE) ? "W" : "");
+            ImGui::PopID();
+        }
+
+        ImGui::Separator();
+        ImGui::Text("Opcode");
+        static uint16_t mask = 0xF0FF;
+        static uint16_t value = 0xF033;
+        ImGui::SetNextItemWidth(50);
+        ImGui::InputScalar("&##mask", ImGuiDataType_U16, &mask, 0, 0, "%04X", ImGuiInputTextFlags_CharsHexadecimal);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(50);
+        ImGui::InputScalar("==##value", ImGuiDataType_U16, &value, 0, 0, "%04X", ImGuiInputTextFlags_CharsHexadecimal);
+        ImGui::SameLine();
+        if(ImGui::Button("Add##opcode"))
+        {
+            break_add_opcode(mask, value);
+        }
+        for(int o = 0; o < b->opcode_count; o++)
+        {
+            OpcodeBreak* opcode = &b->opcodes[o];
+            ImGui::PushID(100 + o);
+            if(ImGui::SmallButton("x"))
+            {
+                remove_at(b->opcodes, &b->opcode_count, o, sizeof(*opcode));
+                changed = true;
+                ImGui::PopID();
+                break;
+            }
+            ImGui::SameLine();
+            changed |= ImGui::Checkbox("##on", &opcode->enabled);
+            ImGui::SameLine();
+            ImGui::Text("op & %04X == %04X", opcode->mask, opcode->value);
+            ImGui::PopID();
+        }
+
+        ImGui::Separator();
+        ImGui::Text("Register");
+        static int reg = 0;
+        static int compare = BREAK_EQ;
+        static uint16_t compare_to = 0;
+        ImGui::SetNextItemWidth(50);
+        ImGui::Combo("##reg", &reg, BREAK_REGISTER_NAMES, BREAK_REG_COUNT);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(50);
+        ImGui::Combo("##compare", &compare, BREAK_COMPARE_NAMES, BREAK_COMPARE_COUNT);
+        ImGui::SameLine();
+        hex_input("##compare_to", &compare_to, 50);
+        ImGui::SameLine();
+        if(ImGui::Button("Add##condition"))
+        {
+            break_add_condition((uint8_t)reg, (uint8_t)compare, compare_to);
+        }
+        for(int c = 0; c < b->condition_count; c++)
+        {
+            RegisterBreak* condition = &b->conditions[c];
+            ImGui::PushID(200 + c);
+            if(ImGui::SmallButton("x"))
+            {
+                remove_at(b->conditions, &b->condition_count, c, sizeof(*condition));
+                changed = true;
+                ImGui::PopID();
+                break;
+            }
+            ImGui::SameLine();
+            changed |= ImGui::Checkbox("##on", &condition->enabled);
+            ImGui::SameLine();
+            ImGui::Text("%s %s %X", BREAK_REGISTER_NAMES[condition->reg], BREAK_COMPARE_NAMES[condition->compare], condition->value);
+            ImGui::PopID();
+        }
+
+        ImGui::Separator();
+        ImGui::Text("Expression");
+        static char expression_text[EXPR_MAX_TEXT];
+        static Expr expression_check;
+        if(imgui_expr_input("expression", expression_text, sizeof(expression_text), &expression_check) &&
+           break_add_expression(expression_text))
+        {
+            expression_text[0] = 0;
+        }
+        for(int e = 0; e < b->expression_count; e++)
+        {
+            ExprBreak* expression = &b->expressions[e];
+            ImGui::PushID(300 + e);
+            if(ImGui::SmallButton("x"))
+            {
+                remove_at(b->expressions, &b->expression_count, e, sizeof(*expression));
+                changed = true;
+                ImGui::PopID();
+                break;
+            }
+            ImGui::SameLine();
+            changed |= ImGui::Checkbox("##on", &expression->enabled);
+            ImGui::SameLine();
+            ImGui::TextUnformatted(expression->text);
+            ImGui::PopID();
+        }
+    }
+    ImGui::End();
+
+    if(changed)
+        breakpoints_update();
+}
+#else
+#define imgui_breakpoints_menu(...)
+#define imgui_breakpoints_windows(...)
+#endif
+
+};
@@ -0,0 +1,137 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+#include "chip8emu_expr.h"
+
+namespace c8e
+{
+// Breakpoints on pc, memory access, opcodes, register conditions and expressions. run_frame only looks at
+// them when armed is set, once per frame, so nothing is paid per instruction otherwise. When
+// armed, each instruction costs a bit test in the pc bitmap, plus a walk over the other lists
+// when there are any.
+//
+// Everything stops *before* the instruction: memory watches are checked against what the
+// instruction is about to access (Fx55 and Fx33 write, Fx65 and Dxyn read). Register
+// conditions and expressions fire when they become true, not for as long as they stay true.
+// A pc breakpoint can have a condition, an expression checked only when the pc matches.
+const int BREAK_MAX_WATCHES = 16;
+const int BREAK_MAX_OPCODES = 16;
+const int BREAK_MAX_CONDITIONS = 16;
+const int BREAK_MAX_EXPRESSIONS = 16;
+const int BREAK_MAX_PC_CONDITIONS = 16;
+
+enum BreakAccess
+{
+	BREAK_READ = 1 << 0,
+	BREAK_WRITE = 1 << 1,
+};
+
+// 0-15 are V0-VF.
+enum BreakRegister
+{
+	BREAK_REG_I = 16,
+	BREAK_REG_DT,
+	BREAK_REG_ST,
+	BREAK_REG_SP,
+	BREAK_REG_COUNT,
+};
+
+enum BreakCompare
+{
+	BREAK_EQ, BREAK_NE, BREAK_LT, BREAK_LE, BREAK_GT, BREAK_GE,
+	BREAK_COMPARE_COUNT,
+};
+
+enum BreakKind
+{
+	BREAK_NONE, BREAK_PC, BREAK_WATCH, BREAK_OPCODE, BREAK_CONDITION, BREAK_EXPRESSION,
+};
+
+struct MemoryWatch
+{
+	bool enabled;
+	uint8_t access; // BreakAccess
+	uint16_t first;
+	uint16_t last; // inclusive
+};
+
+struct OpcodeBreak
+{
+	bool enabled;
+	uint16_t mask;
+	uint16_t value;
+};
+
+struct RegisterBreak
+{
+	bool enabled;
+	bool was_true;
+	uint8_t reg; // BreakRegister
+	uint8_t compare; // BreakCompare
+	uint16_t value;
+};
+
+struct ExprBreak
+{
+	bool enabled;
+	bool was_true;
+	Expr expr;
+	char text[EXPR_MAX_TEXT];
+};
+
+struct PcCondition
+{
+	uint16_t pc;
+	Expr expr;
+	char text[EXPR_MAX_TEXT];
+};
+
+struct BreakHit
+{
+	uint8_t kind; // BreakKind
+	int index;
+	uint16_t pc;
+	uint64_t cycle;
+};
+
+struct Breakpoints
+{
+	bool armed; // anything enabled, see breakpoints_update
+	bool resuming; // set by debug_continue: the instruction stopped at runs without a check
+
+	uint64_t pc[MEMORY_SIZE / 64];
+	int pc_count;
+	MemoryWatch watches[BREAK_MAX_WATCHES];
+	int watch_count;
+	OpcodeBreak opcodes[BREAK_MAX_OPCODES];
+	int opcode_count;
+	RegisterBreak conditions[BREAK_MAX_CONDITIONS];
+	int condition_count;
+	ExprBreak expressions[BREAK_MAX_EXPRESSIONS];
+	int expression_count;
+	PcCondition pc_conditions[BREAK_MAX_PC_CONDITIONS];
+	int pc_condition_count;
+
+	bool others; // any enabled watch, opcode, condition or expression
+	BreakHit hit; // the last one
+};
+
+Breakpoints breakpoints;
+
+void breakpoints_update(); // after changing anything above
+void break_toggle_pc(uint16_t pc);
+bool break_has_pc(uint16_t pc);
+bool break_add_watch(uint16_t first, uint16_t last, uint8_t access);
+bool break_add_opcode(uint16_t mask, uint16_t value);
+bool break_add_condition(uint8_t reg, uint8_t compare, uint16_t value);
+bool break_add_expression(const char* text);
+bool break_set_pc_condition(uint16_t pc, const char* text); // sets the breakpoint too; "" removes the condition
+const PcCondition* break_pc_condition(uint16_t pc);
+
+int break_run(int count);
+bool break_matches(void* user); // a DebugPredicate for debug_run_back
+void break_describe(const BreakHit* hit, char* text, int size);
+
+void imgui_breakpoints_menu();
+void imgui_breakpoints_windows();
+};
@@ -0,0 +1,282 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_coverage.h"
+#include "chip8emu_disasm.h"
+#include "chip8emu_platform.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace c8e
+{
+
+// After execute_op and before the pc moves on, so a skip that was taken has moved it by 2 already.
+static inline void coverage_record(Coverage* cov, uint16_t pc, uint16_t op)
+{
+    uint64_t bit = 1ull << (pc % 64);
+    cov->executed[pc / 64] |= bit;
+    uint16_t high = op >> 12;
+    if(high == 0x3 || high == 0x4 || high == 0x5 || high == 0x9 ||
+       (high == 0xE && ((op & 0xFF) == 0x9E || (op & 0xFF) == 0xA1)))
+    {
+        if(c8.pc != pc)
+            cov->skipped[pc / 64] |= bit;
+        else
+            cov->fell_through[pc / 64] |= bit;
+    }
+}
+
+void coverage_clear(Coverage* cov)
+{
+    memset(cov->executed, 0, sizeof(cov->executed));
+    memset(cov->skipped, 0, sizeof(cov->skipped));
+    memset(cov->fell_through, 0, sizeof(cov->fell_through));
+}
+
+void coverage_merge(Coverage* into, const Coverage* from)
+{
+    for(int word = 0; word < MEMORY_SIZE / 64; word++)
+    {
+        into->executed[word] |= from->executed[word];
+        into->skipped[word] |= from->skipped[word];
+        into->fell_through[word] |= from->fell_through[word];
+    }
+}
+
+bool coverage_has(const uint64_t* bits, uint16_t addr)
+{
+    return (bits[addr / 64] >> (addr % 64)) & 1;
+}
+
+static bool coverage_is_skip(uint16_t op)
+{
+    OpClass cls = op_class(op);
+    return cls == OP_SE_IMM || cls == OP_SNE_IMM || cls == OP_SE || cls == OP_SNE || cls == OP_SKP || cls == OP_SKNP;
+}
+
+static bool coverage_found(const Coverage* cov, int addr)
+{
+    return (disasm.flags[addr] & DISASM_CODE) || coverage_has(cov->executed, (uint16_t)addr);
+}
+
+void coverage_stats(const Coverage* cov, CoverageStats* stats)
+{
+    disasm_update();
+    memset(stats, 0, sizeof(*stats));
+    for(int addr = 0; addr < MEMORY_SIZE - 1; addr++)
+    {
+        if(!coverage_found(cov, addr))
+            continue;
+        bool ran = coverage_has(cov->executed, (uint16_t)addr);
+        stats->instructions++;
+        stats->executed += ran;
+        if(coverage_is_skip((uint16_t)((c8.memory[addr] << 8) | c8.memory[addr + 1])))
+        {
+            bool skipped = coverage_has(cov->skipped, (uint16_t)addr);
+            bool fell_through = coverage_has(cov->fell_through, (uint16_t)addr);
+            stats->skips++;
+            stats->skips_both_ways += skipped && fell_through;
+            stats->skips_one_way += skipped != fell_through;
+        }
+        if(disasm.flags[addr] & DISASM_CALL_TARGET)
+        {
+            stats->subroutines++;
+            stats->subroutines_called += ran;
+        }
+    }
+}
+
+struct CoverageWriter
+{
+    plat::FileHandle file;
+    bool failed;
+    int size;
+    char buffer[16384];
+};
+
+static void coverage_flush(CoverageWriter* writer)
+{
+    if(writer->size && !writer->failed)
+        writer->failed = !plat::write_file(writer->file, writer->buffer, writer->size);
+    writer->size = 0;
+}
+
+static void coverage_printf(CoverageWriter* writer, const char* format, ...)
+{
+    if(writer->size > (int)sizeof(writer->buffer) - 256)
+        coverage_flush(writer);
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(writer->buffer + writer->size, sizeof(writer->buffer) - writer->size, format, args);
+    va_end(args);
+    if(length > 0)
+        writer->size += length;
+}
+
+// One record, for the machine's memory as it is now. Bitmaps have no counts, so a hit is 1.
+bool coverage_write_lcov(const Coverage* cov, plat::FileHandle file, const char* test_name, const char* listing_path)
+{
+    disasm_update();
+    static CoverageWriter writer;
+    writer.file = file;
+    writer.failed = false;
+    writer.size = 0;
+
+    coverage_printf(&writer, "TN:%s\nSF:%s\n", test_name, listing_path);
+    int functions = 0;
+    int functions_hit = 0;
+    for(int addr = 0; addr < MEMORY_SIZE - 1; addr++)
+    {
+        if(!(disasm.flags[addr] & DISASM_CALL_TARGET) || !coverage_found(cov, addr))
+            continue;
+        bool ran = coverage_has(cov->executed, (uint16_t)addr);
+        coverage_printf(&writer, "FN:%d,sub_%03X\nFNDA:%d,sub_%03X\n", addr + 1, addr, ran, addr);
+        functions++;
+        functions_hit += ran;
+    }
+    coverage_printf(&writer, "FNF:%d\nFNH:%d\n", functions, functions_hit);
+
+    int branches = 0;
+    int branches_hit = 0;
+    for(int addr = 0; addr < MEMORY_SIZE - 1; addr++)
+    {
+        if(!coverage_found(cov, addr) || !coverage_is_skip((uint16_t)((c8.memory[addr] << 8) | c8.memory[addr + 1])))
+            continue;
+        if(!coverage_has(cov->executed, (uint16_t)addr))
+        {
+            coverage_printf(&writer, "BRDA:%d,0,0,-\nBRDA:%d,0,1,-\n", addr + 1, addr + 1);
+        }
+        else
+        {
+            bool fell_through = coverage_has(cov->fell_through, (uint16_t)addr);
+            bool skipped = coverage_has(cov->skipped, (uint16_t)addr);
+            coverage_printf(&writer, "BRDA:%d,0,0,%d\nBRDA:%d,0,1,%d\n", addr + 1, fell_through, addr + 1, skipped);
+            branches_hit += fell_through + skipped;
+        }
+        branches += 2;
+    }
+    coverage_printf(&writer, "BRF:%d\nBRH:%d\n", branches, branches_hit);
+
+    int lines = 0;
+    int lines_hit = 0;
+    for(int addr = 0; addr < MEMORY_SIZE - 1; addr++)
+    {
+        if(!coverage_found(cov, addr))
+            continue;
+        bool ran = coverage_has(cov->executed, (uint16_t)addr);
+        coverage_printf(&writer, "DA:%d,%d\n", addr + 1, ran);
+        lines++;
+        lines_hit += ran;
+    }
+    coverage_printf(&writer, "LF:%d\nLH:%d\nend_of_record\n", lines, lines_hit);
+    coverage_flush(&writer);
+    return !writer.failed;
+}
+
+// Line n is address n - 1, so the lcov line numbers are addresses.
+bool coverage_write_listing(plat::FilePath path)
+{
+    disasm_update();
+    static CoverageWriter writer;
+    writer.file = plat::open_file_for_writing(path);
+    writer.failed = false;
+    writer.size = 0;
+    if(!writer.file)
+        return false;
+
+    for(int addr = 0; addr < MEMORY_SIZE; addr++)
+    {
+        if(addr < MEMORY_SIZE - 1 && (disasm.flags[addr] & DISASM_CODE))
+        {
+            uint16_t op = (uint16_t)((c8.memory[addr] << 8) | c8.memory[addr + 1]);
+            char label[16];
+            char text[32];
+            disasm_label((uint16_t)addr, label, sizeof(label));
+            disassemble(op, text, sizeof(text));
+            coverage_printf(&writer, "%03X  %04X  %-10s %s\n", addr, op, label[0] ? label : "", text);
+        }
+        else
+        {
+            coverage_printf(&writer, "%03X  %02X\n", addr, c8.memory[addr]);
+        }
+    }
+    coverage_flush(&writer);
+    plat::close_file(writer.file);
+    return !writer.failed;
+}
+
+#ifdef USE_IMGUI
+static bool g_show_coverage = false;
+
+void imgui_coverage_menu()
+{
+    if(ImGui::BeginMenu("Debug"))
+    {
+        ImGui::MenuItem("Coverage", 0, &g_show_coverage);
+        if(ImGui::MenuItem("Record coverage", 0, coverage.enabled))
+            coverage.enabled = !coverage.enabled;
+        ImGui::EndMenu();
+    }
+}
+
+// A map of memory, a cell per address: ran, found but never ran, or not code.
+void imgui_coverage_windows()
+{
+    if(!g_show_coverage)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(300, 420), ImGuiCond_FirstUseEver);
+    if(ImGui::Begin("Coverage", &g_show_coverage))
+    {
+        ImGui::Checkbox("Record", &coverage.enabled);
+        ImGui::SameLine();
+        if(ImGui::Button("Clear"))
+            coverage_clear(&coverage);
+
+        CoverageStats stats;
+        coverage_stats(&coverage, &stats);
+        ImGui::Text("Instructions %d/%d (%.1f%%)", stats.executed, stats.instructions,
+                    stats.instructions ? 100.0 * stats.executed / stats.instructions : 0.0);
+        ImGui::Text("Skips both ways %d, one way %d, of %d", stats.skips_both_ways, stats.skips_one_way, stats.skips);
+        ImGui::Text("Subroutines called %d/%d", stats.subroutines_called, stats.subroutines);
+
+        const int columns = 64;
+        const float cell = 4.0f;
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        ImDrawList* draw = ImGui::GetWindowDrawList();
+        for(int addr = 0; addr < MEMORY_SIZE; addr++)
+        {
+            ImU32 color;
+            if(coverage_has(coverage.executed, (uint16_t)addr))
+                color = IM_COL32(80, 200, 120, 255);
+            else if(disasm.flags[addr] & DISASM_CODE)
+                color = IM_COL32(200, 70, 70, 255);
+            else
+                continue;
+            ImVec2 min = ImVec2(origin.x + (addr % columns) * cell, origin.y + (addr / columns) * cell);
+            draw->AddRectFilled(min, ImVec2(min.x + cell, min.y + cell), color);
+        }
+        ImVec2 size = ImVec2(columns * cell, (MEMORY_SIZE / columns) * cell);
+        draw->AddRect(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(90, 90, 90, 255));
+        ImGui::InvisibleButton("map", size);
+        if(ImGui::IsItemHovered())
+        {
+            ImVec2 mouse = ImGui::GetMousePos();
+            int addr = (int)((mouse.y - origin.y) / cell) * columns + (int)((mouse.x - origin.x) / cell);
+            if(addr >= 0 && addr < MEMORY_SIZE)
+            {
+                char text[32];
+                disassemble((uint16_t)((c8.memory[addr] << 8) | c8.memory[(addr + 1) % MEMORY_SIZE]), text, sizeof(text));
+                ImGui::SetTooltip("%03X  %s%s", addr, (disasm.flags[addr] & DISASM_CODE) ? text : "data",
+                                  coverage_has(coverage.executed, (uint16_t)addr) ? " (ran)" : "");
+            }
+        }
+    }
+    ImGui::End();
+}
+#else
+#define imgui_coverage_menu(...)
+#define imgui_coverage_windows(...)
+#endif
+
+};
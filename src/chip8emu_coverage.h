@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+#include "chip8emu_platform.h"
+
+namespace c8e
+{
+// Code coverage as bitmaps: the addresses instructions ran from, and for the skip instructions
+// (3xkk, 4xkk, 5xy0, 9xy0, Ex9E, ExA1) which ways they went. next_op records into coverage
+// while enabled, a few bit operations per instruction. Run-ahead frames are left out. Bitmaps
+// of separate runs are ORed together with coverage_merge.
+//
+// The lcov export treats the ROM as a source file with one line per address (line = address + 1),
+// written by coverage_write_listing, so genhtml can render it. The lines found are the
+// instructions the disassembler reaches plus anything that ran; the skips become branches.
+struct Coverage
+{
+	bool enabled;
+	uint64_t executed[MEMORY_SIZE / 64];
+	uint64_t skipped[MEMORY_SIZE / 64]; // a skip here skipped
+	uint64_t fell_through[MEMORY_SIZE / 64]; // a skip here did not
+};
+
+struct CoverageStats
+{
+	int instructions; // found, see above
+	int executed;
+	int skips; // skip instructions found
+	int skips_one_way; // ran, but only ever went one way
+	int skips_both_ways;
+	int subroutines;
+	int subroutines_called;
+};
+
+Coverage coverage;
+
+static inline void coverage_record(Coverage* cov, uint16_t pc, uint16_t op);
+void coverage_clear(Coverage* cov);
+void coverage_merge(Coverage* into, const Coverage* from);
+bool coverage_has(const uint64_t* bits, uint16_t addr);
+void coverage_stats(const Coverage* cov, CoverageStats* stats); // against the disassembly of memory as it is now
+
+bool coverage_write_lcov(const Coverage* cov, plat::FileHandle file, const char* test_name, const char* listing_path);
+bool coverage_write_listing(plat::FilePath path);
+
+void imgui_coverage_menu();
+void imgui_coverage_windows();
+};
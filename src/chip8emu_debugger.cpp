@@ -0,0 +1,432 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_debugger.h"
+#include "chip8emu_writelog.h"
+#include "chip8emu_breakpoints.h"
+#include "chip8emu_platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace c8e
+{
+
+bool debug_init(Debugger* debugger, uint32_t budget)
+{
+    debug_free(debugger);
+
+    // A quarter of the budget for the input log, 2 bytes a frame.
+    debugger->max_keyframes = (int)((budget - budget / 4) / sizeof(Snapshot));
+    debugger->max_input = budget / 4 / sizeof(uint16_t);
+    debugger->keyframes = (Snapshot*)malloc((size_t)debugger->max_keyframes * sizeof(Snapshot));
+    debugger->input_log = (uint16_t*)malloc((size_t)debugger->max_input * sizeof(uint16_t));
+    if(!debugger->keyframes || !debugger->input_log || debugger->max_keyframes < 4)
+    {
+        debug_free(debugger);
+        return false;
+    }
+
+    debugger->replay_cycles_per_ms = 20000.0; // conservative until measured
+    debugger->keyframe_spacing = (uint64_t)(debugger->replay_cycles_per_ms * DEBUG_TARGET_REPLAY_MS);
+    debugger->next_frame = c8.frame;
+    debugger->enabled = true;
+    return true;
+}
+
+// Only the history goes; pausing and stepping keep working without it.
+void debug_free(Debugger* debugger)
+{
+    free(debugger->keyframes);
+    free(debugger->input_log);
+    debugger->keyframes = 0;
+    debugger->input_log = 0;
+    debugger->max_keyframes = 0;
+    debugger->max_input = 0;
+    debugger->enabled = false;
+    debug_clear(debugger);
+}
+
+void debug_clear(Debugger* debugger)
+{
+    debugger->keyframe_count = 0;
+    debugger->input_count = 0;
+    debugger->replaying = false;
+}
+
+// Keeps the oldest keyframe and the newer half, and every other one in between.
+static void thin_keyframes(Debugger* debugger)
+{
+    int half = debugger->keyframe_count / 2;
+    int out = 1;
+    for(int k = 1; k < debugger->keyframe_count; k++)
+    {
+        if(k >= half || k % 2 == 0)
+        {
+            if(out != k)
+                memcpy(&debugger->keyframes[out], &debugger->keyframes[k], sizeof(Snapshot));
+            out++;
+        }
+    }
+    debugger->keyframe_count = out;
+}
+
+// The input log is full: forget the older half of the history.
+static void drop_oldest_history(Debugger* debugger)
+{
+    int drop = debugger->keyframe_count / 2;
+    if(drop == 0)
+    {
+        debug_clear(debugger);
+        return;
+    }
+    memmove(debugger->keyframes, debugger->keyframes + drop, (size_t)(debugger->keyframe_count - drop) * sizeof(Snapshot));
+    debugger->keyframe_count -= drop;
+
+    uint64_t dropped_frames = debugger->keyframes[0].frame - debugger->input_first_frame;
+    memmove(debugger->input_log, debugger->input_log + dropped_frames, (size_t)(debugger->input_count - dropped_frames) * sizeof(uint16_t));
+    debugger->input_first_frame += dropped_frames;
+    debugger->input_count -= dropped_frames;
+}
+
+// Called by begin_frame before the timers, with the machine at a frame boundary.
+void debug_frame_begin()
+{
+    Debugger* d = &debugger;
+    if(c8.frame != d->next_frame)
+    {
+        debug_clear(d);
+    }
+    d->next_frame = c8.frame + 1;
+
+    if(d->replaying && c8.frame >= d->input_first_frame && c8.frame < d->input_first_frame + d->input_count)
+    {
+        uint16_t keys = d->input_log[c8.frame - d->input_first_frame];
+        for(int k = 0; k < 16; k++)
+        {
+            c8.keys[k] = (keys >> k) & 1;
+        }
+        return;
+    }
+
+    // Live from here on: whatever history lay ahead of this frame is gone.
+    if(d->replaying)
+    {
+        d->replaying = false;
+        if(write_log.enabled)
+            write_log_resync(&write_log);
+    }
+    while(d->keyframe_count > 0 && d->keyframes[d->keyframe_count - 1].frame >= c8.frame)
+    {
+        d->keyframe_count--;
+    }
+    if(d->keyframe_count > 0)
+    {
+        d->input_count = c8.frame - d->input_first_frame;
+    }
+
+    if(d->keyframe_count == 0 || c8.cycle - d->keyframes[d->keyframe_count - 1].cycle >= d->keyframe_spacing)
+    {
+        if(d->keyframe_count == d->max_keyframes)
+        {
+            thin_keyframes(d);
+        }
+        save_snapshot(&d->keyframes[d->keyframe_count++]);
+        if(d->keyframe_count == 1)
+        {
+            d->input_first_frame = c8.frame;
+            d->input_count = 0;
+        }
+    }
+
+    if(d->input_count == d->max_input)
+    {
+        drop_oldest_history(d);
+    }
+    uint16_t keys = 0;
+    for(int k = 0; k < 16; k++)
+    {
+        keys |= (uint16_t)((c8.keys[k] != 0) << k);
+    }
+    d->input_log[d->input_count++] = keys;
+}
+
+// One instruction, opening and closing frames around it like run_frame does.
+static bool debug_execute_instruction()
+{
+    if(c8.ips <= 0)
+        return false;
+    while(debugger.frame_ops_left == 0)
+    {
+        debugger.frame_ops = begin_frame();
+        debugger.frame_ops_left = debugger.frame_ops;
+        if(debugger.frame_ops == 0)
+            end_frame(0);
+    }
+    next_op();
+    if(--debugger.frame_ops_left == 0)
+    {
+        end_frame(debugger.frame_ops);
+    }
+    return true;
+}
+
+// The newest keyframe at or before cycle, -1 if there is none.
+static int find_keyframe(uint64_t cycle)
+{
+    int low = 0;
+    int high = debugger.keyframe_count;
+    while(low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if(debugger.keyframes[mid].cycle <= cycle)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low - 1;
+}
+
+static void load_keyframe(int k)
+{
+    debugger.replaying = true; // before the load, so the write log keeps what lies ahead
+    load_snapshot(&debugger.keyframes[k]);
+    debugger.frame_ops_left = 0;
+    debugger.next_frame = c8.frame;
+}
+
+void debug_pause()
+{
+    debugger.paused = true;
+}
+
+void debug_continue()
+{
+    debugger.paused = false;
+    breakpoints.resuming = true;
+    if(debugger.replaying)
+    {
+        debugger.replaying = false;
+        if(write_log.enabled)
+            write_log_resync(&write_log);
+    }
+}
+
+void debug_step()
+{
+    debugger.paused = true;
+    debug_execute_instruction();
+}
+
+// Puts the machine right before the instruction at cycle, replaying from the nearest keyframe
+// (or from here, when going forward past no keyframe).
+bool debug_seek(uint64_t cycle)
+{
+    int k = find_keyframe(cycle);
+    if(!debugger.enabled || k < 0)
+        return false;
+
+    uint64_t start = plat::get_ticks();
+    debugger.paused = true;
+    if(cycle < c8.cycle || debugger.keyframes[k].cycle > c8.cycle)
+    {
+        load_keyframe(k);
+    }
+    debugger.replaying = true;
+    uint64_t replayed = 0;
+    while(c8.cycle < cycle && debug_execute_instruction())
+    {
+        replayed++;
+    }
+
+    // Adapt the spacing to how fast replays really are.
+    double ms = (plat::get_ticks() - start) * 1000.0 / plat::get_ticks_per_second();
+    debugger.last_seek_ms = ms;
+    debugger.last_seek_cycles = replayed;
+    if(replayed >= 10000 && ms > 0.0)
+    {
+        debugger.replay_cycles_per_ms = debugger.replay_cycles_per_ms*0.75 + (replayed / ms)*0.25;
+        debugger.keyframe_spacing = (uint64_t)(debugger.replay_cycles_per_ms * DEBUG_TARGET_REPLAY_MS);
+    }
+    return c8.cycle == cycle;
+}
+
+bool debug_step_back()
+{
+    if(c8.cycle == 0)
+        return false;
+    return debug_seek(c8.cycle - 1);
+}
+
+// Goes back to the last instruction before the current one at which predicate held. Each
+// keyframe interval is replayed newest first until one has a hit.
+bool debug_run_back(DebugPredicate predicate, void* user)
+{
+    if(!debugger.enabled || c8.cycle == 0)
+        return false;
+
+    uint64_t origin = c8.cycle;
+    uint64_t end = origin;
+    for(int k = find_keyframe(origin - 1); k >= 0; k--)
+    {
+        load_keyframe(k);
+        uint64_t found = UINT64_MAX;
+        while(c8.cycle < end)
+        {
+            if(predicate(user))
+                found = c8.cycle;
+            if(!debug_execute_instruction())
+                break;
+        }
+        if(found != UINT64_MAX)
+        {
+            return debug_seek(found);
+        }
+        end = debugger.keyframes[k].cycle;
+    }
+    debug_seek(origin);
+    return false;
+}
+
+// Runs what is left of a frame the debugger stopped inside of, up to the next breakpoint.
+// Returns how many instructions ran.
+int debug_finish_frame()
+{
+    int ran = debugger.frame_ops_left;
+    if(breakpoints.armed && !c8.speculating)
+    {
+        ran = break_run(debugger.frame_ops_left);
+    }
+    else
+    {
+        for(int n = 0; n < ran; n++)
+        {
+            next_op();
+        }
+    }
+    debugger.frame_ops_left -= ran;
+    if(debugger.frame_ops_left == 0)
+    {
+        end_frame(debugger.frame_ops);
+    }
+    return ran;
+}
+
+#ifdef USE_IMGUI
+static bool g_show_debugger = false;
+
+static bool pc_is(void* user)
+{
+    return c8.pc == *(uint16_t*)user;
+}
+
+void imgui_debugger_menu()
+{
+    if(ImGui::BeginMenu("Debug"))
+    {
+        ImGui::MenuItem("Debugger", 0, &g_show_debugger);
+        if(ImGui::MenuItem("Record history", 0, debugger.enabled))
+        {
+            if(debugger.enabled)
+                debug_free(&debugger);
+            else
+                debug_init(&debugger, DEBUG_DEFAULT_BUDGET);
+        }
+        ImGui::EndMenu();
+    }
+}
+
+void imgui_debugger_windows()
+{
+    if(!g_show_debugger)
+        return;
+
+    if(ImGui::Begin("Debugger", &g_show_debugger))
+    {
+        if(debugger.paused ? ImGui::Button("Continue") : ImGui::Button("Pause"))
+        {
+            if(debugger.paused)
+                debug_continue();
+            else
+                debug_pause();
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Step"))
+        {
+            debug_step();
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Step frame"))
+        {
+            debug_step();
+            while(debugger.frame_ops_left > 0)
+                debug_step();
+        }
+        ImGui::BeginDisabled(!debugger.enabled);
+        ImGui::SameLine();
+        if(ImGui::Button("Step back"))
+        {
+            debug_step_back();
+        }
+        ImGui::SameLine();
+        if(ImGui::Button("Run back to breakpoint"))
+        {
+            debug_run_back(break_matches, 0);
+        }
+        static uint16_t run_back_pc = PROGRAM_OFFSET;
+        if(ImGui::Button("Run back to PC"))
+        {
+            debug_run_back(pc_is, &run_back_pc);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(50);
+        ImGui::InputScalar("##run back pc", ImGuiDataType_U16, &run_back_pc, 0, 0, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+        ImGui::EndDisabled();
+
+        char text[32];
+        uint16_t op = (c8.memory[c8.pc] << 8) | c8.memory[(c8.pc + 1) % MEMORY_SIZE];
+        disassemble(op, text, sizeof(text));
+        ImGui::Separator();
+        ImGui::Text("Frame %llu, cycle %llu%s", (unsigned long long)c8.frame, (unsigned long long)c8.cycle,
+                    debugger.frame_ops_left ? " (inside the frame)" : "");
+        ImGui::Text("PC %03X  %04X  %s", c8.pc, op, text);
+        if(debugger.paused && breakpoints.hit.kind != BREAK_NONE && breakpoints.hit.cycle == c8.cycle)
+        {
+            char reason[64];
+            break_describe(&breakpoints.hit, reason, sizeof(reason));
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "stopped: %s", reason);
+        }
+        ImGui::Text("I  %03X   DT %02X  ST %02X  SP %X", c8.i, c8.vd, c8.vs, c8.sp);
+        for(int x = 0; x < 16; x++)
+        {
+            if(x % 8)
+                ImGui::SameLine();
+            ImGui::Text("V%X %02X", x, c8.v[x]);
+        }
+        ImGui::Text("Stack");
+        for(int s = 0; s < c8.sp && s < 16; s++)
+        {
+            ImGui::SameLine();
+            ImGui::Text("%03X", c8.stack[s]);
+        }
+
+        ImGui::Separator();
+        if(debugger.enabled && debugger.keyframe_count > 0)
+        {
+            ImGui::Text("History from cycle %llu: %d/%d keyframes every %llu cycles, %llu frames of input",
+                        (unsigned long long)debugger.keyframes[0].cycle, debugger.keyframe_count, debugger.max_keyframes,
+                        (unsigned long long)debugger.keyframe_spacing, (unsigned long long)debugger.input_count);
+            ImGui::Text("Last seek: %llu instructions replayed in %.2f ms", (unsigned long long)debugger.last_seek_cycles, debugger.last_seek_ms);
+        }
+        else if(!debugger.enabled)
+        {
+            ImGui::Text("History is off (Debug > Record history)");
+        }
+    }
+    ImGui::End();
+}
+#else
+#define imgui_debugger_menu(...)
+#define imgui_debugger_windows(...)
+#endif
+
+};
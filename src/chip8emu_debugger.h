@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+
+namespace c8e
+{
+// Reverse debugging. While enabled, begin_frame keeps a keyframe (a Snapshot at a frame
+// boundary) every keyframe_spacing cycles and logs each frame's keys. Execution is
+// deterministic given those (the RNG state is in the snapshot), so any earlier instruction is
+// reached by loading the keyframe before it and stepping forward.
+//
+// keyframe_spacing follows the measured replay speed so a step back replays about
+// DEBUG_TARGET_REPLAY_MS worth of instructions. When the keyframe budget fills up, every other
+// keyframe in the older half is dropped: recent history stays dense, old history gets sparser.
+const uint32_t DEBUG_DEFAULT_BUDGET = 32 << 20; // bytes for keyframes and the input log
+const double DEBUG_TARGET_REPLAY_MS = 2.0;
+
+typedef bool (*DebugPredicate)(void* user); // checked before each instruction
+
+struct Debugger
+{
+	bool enabled;
+	bool paused;
+
+	// Set while stepping through a frame an instruction at a time, 0 at frame boundaries.
+	int frame_ops;
+	int frame_ops_left;
+
+	Snapshot* keyframes; // oldest first
+	int keyframe_count;
+	int max_keyframes;
+	uint64_t keyframe_spacing; // cycles
+
+	// Keys of every frame since the oldest keyframe, one bit per key.
+	uint16_t* input_log;
+	uint64_t input_first_frame;
+	uint64_t input_count;
+	uint64_t max_input;
+
+	// begin_frame sees this frame next unless something else moved the machine (reset,
+	// rewind, snapshot load), which throws the history away.
+	uint64_t next_frame;
+	bool replaying; // stepping through recorded history: keys come from the log
+
+	double replay_cycles_per_ms;
+	double last_seek_ms;
+	uint64_t last_seek_cycles;
+};
+
+Debugger debugger;
+
+bool debug_init(Debugger* debugger, uint32_t budget);
+void debug_free(Debugger* debugger);
+void debug_clear(Debugger* debugger);
+void debug_frame_begin();
+
+void debug_pause();
+void debug_continue();
+void debug_step();
+bool debug_step_back();
+bool debug_seek(uint64_t cycle);
+bool debug_run_back(DebugPredicate predicate, void* user);
+int debug_finish_frame();
+
+void imgui_debugger_menu();
+void imgui_debugger_windows();
+};
@@ -0,0 +1,511 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_disasm.h"
+#include "chip8emu_breakpoints.h"
+#include "chip8emu_platform.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace c8e
+{
+
+static inline uint16_t disasm_read(int addr)
+{
+    return (uint16_t)((c8.memory[addr] << 8) | c8.memory[addr + 1]);
+}
+
+static bool disasm_is_skip(OpClass cls)
+{
+    return cls == OP_SE_IMM || cls == OP_SNE_IMM || cls == OP_SE || cls == OP_SNE || cls == OP_SKP || cls == OP_SKNP;
+}
+
+static bool disasm_ends_block(OpClass cls)
+{
+    return cls == OP_JP || cls == OP_CALL || cls == OP_RET || cls == OP_JP_V0 || disasm_is_skip(cls);
+}
+
+struct DisasmWork
+{
+    uint16_t stack[MEMORY_SIZE];
+    int count;
+    uint64_t queued[MEMORY_SIZE / 64];
+};
+
+static void disasm_target(DisasmWork* work, int addr, uint8_t flag)
+{
+    if(addr >= MEMORY_SIZE - 1)
+        return;
+    disasm.flags[addr] |= flag | DISASM_BLOCK;
+    if((work->queued[addr / 64] >> (addr % 64)) & 1)
+        return;
+    work->queued[addr / 64] |= 1ull << (addr % 64);
+    work->stack[work->count++] = (uint16_t)addr;
+}
+
+// A jump table is taken to be the run of JP instructions at nnn, unless V0 was loaded with a
+// constant right before.
+static void disasm_jump_table(DisasmWork* work, int at, uint16_t op, uint16_t prev)
+{
+    Disassembly* d = &disasm;
+    JumpTable table;
+    table.at = (uint16_t)at;
+    table.base = op & 0xFFF;
+    table.count = 0;
+    if((prev & 0xFF00) == 0x6000)
+    {
+        table.base = (uint16_t)(table.base + (prev & 0xFF));
+        table.count = table.base < MEMORY_SIZE - 1;
+    }
+    else
+    {
+        while(table.count < DISASM_MAX_TABLE_ENTRIES && table.base + table.count*2 < MEMORY_SIZE - 1)
+        {
+            int entry = table.base + table.count*2;
+            d->flags[entry] |= DISASM_READ;
+            d->flags[entry + 1] |= DISASM_READ;
+            if(op_class(disasm_read(entry)) != OP_JP)
+                break;
+            table.count++;
+        }
+        if(table.count == 0 && table.base < MEMORY_SIZE - 1)
+            table.count = 1;
+    }
+    for(int e = 0; e < table.count; e++)
+    {
+        disasm_target(work, table.base + e*2, DISASM_TABLE_ENTRY);
+    }
+    if(d->table_count < DISASM_MAX_TABLES)
+        d->tables[d->table_count++] = table;
+}
+
+static void disasm_blocks()
+{
+    Disassembly* d = &disasm;
+    d->block_count = 0;
+    d->instruction_count = 0;
+    d->subroutine_count = 0;
+    memset(d->block_of, 0xFF, sizeof(d->block_of));
+    for(int start = 0; start < MEMORY_SIZE - 1; start++)
+    {
+        if(!(d->flags[start] & DISASM_CODE) || d->block_of[start] >= 0)
+            continue;
+        int index = d->block_count++;
+        int pc = start;
+        OpClass cls;
+        for(;;)
+        {
+            d->block_of[pc] = (int16_t)index;
+            d->instruction_count++;
+            cls = op_class(disasm_read(pc));
+            int next = pc + 2;
+            if(disasm_ends_block(cls) || next >= MEMORY_SIZE - 1 || !(d->flags[next] & DISASM_CODE) ||
+               (d->flags[next] & DISASM_BLOCK) || d->block_of[next] >= 0)
+                break;
+            pc = next;
+        }
+
+        DisasmBlock* block = &d->blocks[index];
+        uint16_t op = disasm_read(pc);
+        block->start = (uint16_t)start;
+        block->end = (uint16_t)(pc + 2);
+        block->exit = (uint8_t)cls;
+        block->next_count = 0;
+        block->table = -1;
+        switch(cls)
+        {
+            case OP_RET:
+                break;
+            case OP_JP:
+                block->next[block->next_count++] = op & 0xFFF;
+                break;
+            case OP_CALL:
+                block->next[block->next_count++] = op & 0xFFF;
+                block->next[block->next_count++] = (uint16_t)(pc + 2);
+                break;
+            case OP_JP_V0:
+                for(int t = 0; t < d->table_count; t++)
+                {
+                    if(d->tables[t].at == pc)
+                        block->table = (int16_t)t;
+                }
+                break;
+            default:
+                block->next[block->next_count++] = (uint16_t)(pc + 2);
+                if(disasm_is_skip(cls))
+                    block->next[block->next_count++] = (uint16_t)(pc + 4);
+                break;
+        }
+        if(d->flags[start] & DISASM_CALL_TARGET)
+            d->subroutine_count++;
+    }
+}
+
+// One row per instruction. Data rows end at DISASM_DATA_ROW boundaries so the addresses line up.
+static void disasm_layout()
+{
+    Disassembly* d = &disasm;
+    d->row_count = 0;
+    int addr = 0;
+    while(addr < MEMORY_SIZE)
+    {
+        int row = d->row_count++;
+        d->rows[row] = (uint16_t)addr;
+        if((d->flags[addr] & DISASM_CODE) && addr < MEMORY_SIZE - 1)
+        {
+            d->row_of[addr] = (uint16_t)row;
+            d->row_of[addr + 1] = (uint16_t)row;
+            addr += 2;
+            continue;
+        }
+        do
+        {
+            d->row_of[addr++] = (uint16_t)row;
+        }
+        while(addr < MEMORY_SIZE && addr % DISASM_DATA_ROW && !(d->flags[addr] & DISASM_CODE));
+    }
+}
+
+static void disasm_walk()
+{
+    Disassembly* d = &disasm;
+    uint64_t start_ticks = plat::get_ticks();
+    static DisasmWork work;
+    work.count = 0;
+    memset(work.queued, 0, sizeof(work.queued));
+    memset(d->flags, 0, sizeof(d->flags));
+    d->table_count = 0;
+
+    for(int word = 0; word < MEMORY_SIZE / 64; word++)
+    {
+        for(uint64_t bits = d->entries[word]; bits; bits &= bits - 1)
+        {
+            int bit = 0;
+            while(!((bits >> bit) & 1))
+                bit++;
+            disasm_target(&work, word*64 + bit, DISASM_ENTRY);
+        }
+    }
+
+    while(work.count)
+    {
+        int pc = work.stack[--work.count];
+        uint16_t prev = 0;
+        while(pc < MEMORY_SIZE - 1 && !(d->flags[pc] & DISASM_CODE))
+        {
+            uint16_t op = disasm_read(pc);
+            OpClass cls = op_class(op);
+            // The walk depends on every word it decoded, including the ones it stopped at.
+            d->flags[pc] |= DISASM_READ;
+            d->flags[pc + 1] |= DISASM_READ;
+            if(cls == OP_UNKNOWN || op == 0x0000)
+                break;
+            d->flags[pc] |= DISASM_CODE;
+            if(cls == OP_JP)
+            {
+                disasm_target(&work, op & 0xFFF, DISASM_JUMP_TARGET);
+                break;
+            }
+            if(cls == OP_CALL)
+            {
+                disasm_target(&work, op & 0xFFF, DISASM_CALL_TARGET);
+                disasm_target(&work, pc + 2, 0);
+                break;
+            }
+            if(cls == OP_RET)
+                break;
+            if(cls == OP_JP_V0)
+            {
+                disasm_jump_table(&work, pc, op, prev);
+                break;
+            }
+            if(disasm_is_skip(cls))
+            {
+                disasm_target(&work, pc + 2, 0);
+                disasm_target(&work, pc + 4, 0);
+                break;
+            }
+            prev = op;
+            pc += 2;
+        }
+    }
+
+    d->read_chunks = 0;
+    for(int addr = 0; addr < MEMORY_SIZE; addr++)
+    {
+        if(d->flags[addr] & DISASM_READ)
+            d->read_chunks |= 1ull << (addr / 64);
+    }
+
+    memcpy(d->analyzed, c8.memory, sizeof(d->analyzed));
+    disasm_blocks();
+    disasm_layout();
+    d->walks++;
+    d->last_walk_us = (plat::get_ticks() - start_ticks) * 1000000.0 / plat::get_ticks_per_second();
+}
+
+void disasm_invalidate()
+{
+    disasm.dirty = true;
+}
+
+// Called by mark_memory_written once the cache is valid.
+void disasm_note_write(uint16_t addr, uint16_t count)
+{
+    uint64_t chunks = 0;
+    int last = (addr + count - 1) % MEMORY_SIZE / 64;
+    for(int chunk = addr % MEMORY_SIZE / 64; ; chunk = (chunk + 1) % 64)
+    {
+        chunks |= 1ull << chunk;
+        if(chunk == last)
+            break;
+    }
+    if(!(chunks & disasm.read_chunks))
+        return;
+
+    for(uint16_t n = 0; n < count; n++)
+    {
+        if(disasm.flags[(addr + n) % MEMORY_SIZE] & DISASM_READ)
+        {
+            disasm.dirty = true;
+            return;
+        }
+    }
+}
+
+void disasm_add_entry(uint16_t pc)
+{
+    Disassembly* d = &disasm;
+    pc %= MEMORY_SIZE;
+    if((d->entries[pc / 64] >> (pc % 64)) & 1)
+        return;
+    d->entries[pc / 64] |= 1ull << (pc % 64);
+    if(d->valid)
+        disasm_walk();
+}
+
+void disasm_update()
+{
+    Disassembly* d = &disasm;
+    if(d->valid && !d->dirty)
+        return;
+    d->dirty = false;
+
+    uint64_t rom = hash_rom();
+    if(!d->valid || rom != d->rom_hash)
+    {
+        memset(d->entries, 0, sizeof(d->entries));
+        d->entries[PROGRAM_OFFSET / 64] |= 1ull << (PROGRAM_OFFSET % 64);
+        d->rom_hash = rom;
+        d->valid = true;
+        disasm_walk();
+        return;
+    }
+    for(int addr = 0; addr < MEMORY_SIZE; addr++)
+    {
+        if((d->flags[addr] & DISASM_READ) && d->analyzed[addr] != c8.memory[addr])
+        {
+            disasm_walk();
+            return;
+        }
+    }
+}
+
+void disasm_label(uint16_t addr, char* text, int size)
+{
+    uint8_t flags = addr < MEMORY_SIZE ? disasm.flags[addr] : 0;
+    text[0] = 0;
+    if(!(flags & DISASM_CODE))
+        return;
+    if(flags & DISASM_CALL_TARGET)
+        snprintf(text, size, "sub_%03X", addr);
+    else if(flags & DISASM_TABLE_ENTRY)
+        snprintf(text, size, "case_%03X", addr);
+    else if(flags & DISASM_JUMP_TARGET)
+        snprintf(text, size, "loc_%03X", addr);
+    else if(flags & DISASM_ENTRY)
+        snprintf(text, size, addr == PROGRAM_OFFSET ? "start" : "entry_%03X", addr);
+}
+
+const DisasmBlock* disasm_block_at(uint16_t addr)
+{
+    if(addr >= MEMORY_SIZE || disasm.block_of[addr] < 0)
+        return 0;
+    return &disasm.blocks[disasm.block_of[addr]];
+}
+
+#ifdef USE_IMGUI
+static bool g_show_disasm = false;
+
+void imgui_disasm_menu()
+{
+    if(ImGui::BeginMenu("Debug"))
+    {
+        ImGui::MenuItem("Disassembly", 0, &g_show_disasm);
+        ImGui::EndMenu();
+    }
+}
+
+static void imgui_disasm_block_tooltip(const DisasmBlock* block)
+{
+    Disassembly* d = &disasm;
+    ImGui::BeginTooltip();
+    ImGui::Text("Block %03X-%03X, ends in %s", block->start, block->end - 2, OP_CLASS_NAMES[block->exit]);
+    if(block->next_count)
+    {
+        ImGui::Text("Next:");
+        for(int n = 0; n < block->next_count; n++)
+        {
+            char label[16];
+            disasm_label(block->next[n], label, sizeof(label));
+            if(!label[0])
+                snprintf(label, sizeof(label), "%03X", block->next[n]);
+            ImGui::SameLine();
+            ImGui::TextUnformatted(label);
+        }
+    }
+    if(block->table >= 0)
+    {
+        const JumpTable* table = &d->tables[block->table];
+        ImGui::Text("Jump table at %03X, %d entries", table->base, table->count);
+    }
+    int from = 0;
+    for(int b = 0; b < d->block_count; b++)
+    {
+        for(int n = 0; n < d->blocks[b].next_count; n++)
+            from += d->blocks[b].next[n] == block->start;
+    }
+    ImGui::Text("Reached from %d blocks", from);
+    ImGui::EndTooltip();
+}
+
+void imgui_disasm_windows()
+{
+    if(!g_show_disasm)
+        return;
+
+    static bool follow_pc = true;
+    static uint16_t goto_addr = PROGRAM_OFFSET;
+    static int scroll_to_row = -1;
+    static int last_pc_row = -1;
+
+    ImGui::SetNextWindowSize(ImVec2(460, 480), ImGuiCond_FirstUseEver);
+    if(ImGui::Begin("Disassembly", &g_show_disasm))
+    {
+        Disassembly* d = &disasm;
+        disasm_update();
+        if(!(d->flags[c8.pc] & DISASM_CODE))
+            disasm_add_entry(c8.pc);
+
+        ImGui::Checkbox("Follow PC", &follow_pc);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(50);
+        ImGui::InputScalar("##goto", ImGuiDataType_U16, &goto_addr, 0, 0, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+        ImGui::SameLine();
+        if(ImGui::Button("Go to"))
+        {
+            follow_pc = false;
+            scroll_to_row = d->row_of[goto_addr % MEMORY_SIZE];
+        }
+        ImGui::Text("%d instructions, %d blocks, %d subroutines, %d jump tables", d->instruction_count,
+                    d->block_count, d->subroutine_count, d->table_count);
+        ImGui::TextDisabled("Walked %llu times, last in %.1f us. Double-click a row for a breakpoint",
+                            (unsigned long long)d->walks, d->last_walk_us);
+
+        ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersV;
+        if(ImGui::BeginTable("disassembly", 4, flags))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Addr", ImGuiTableColumnFlags_WidthFixed, 48);
+            ImGui::TableSetupColumn("Bytes", ImGuiTableColumnFlags_WidthFixed, 110);
+            ImGui::TableSetupColumn("Label", ImGuiTableColumnFlags_WidthFixed, 72);
+            ImGui::TableSetupColumn("Instruction");
+            ImGui::TableHeadersRow();
+
+            float row_height = ImGui::GetTextLineHeight() + ImGui::GetStyle().CellPadding.y * 2.0f;
+            int pc_row = d->row_of[c8.pc];
+            if(follow_pc && pc_row != last_pc_row)
+            {
+                float y = pc_row * row_height;
+                float visible = ImGui::GetWindowHeight() - 2.0f * row_height;
+                if(y < ImGui::GetScrollY() || y > ImGui::GetScrollY() + visible)
+                    ImGui::SetScrollY(y - visible / 2);
+            }
+            last_pc_row = pc_row;
+            if(scroll_to_row >= 0)
+            {
+                ImGui::SetScrollY(scroll_to_row * row_height);
+                scroll_to_row = -1;
+            }
+
+            ImGuiListClipper clipper;
+            clipper.Begin(d->row_count, row_height);
+            while(clipper.Step())
+            {
+                for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+                {
+                    uint16_t addr = d->rows[row];
+                    bool code = (d->flags[addr] & DISASM_CODE) != 0;
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    if(code && break_has_pc(addr))
+                        ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg1, IM_COL32(140, 40, 40, 160));
+                    char label[32];
+                    snprintf(label, sizeof(label), "%03X##%d", addr, row);
+                    if(ImGui::Selectable(label, row == pc_row, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick) &&
+                       ImGui::IsMouseDoubleClicked(0) && code)
+                    {
+                        break_toggle_pc(addr);
+                    }
+                    if(code && ImGui::IsItemHovered() && disasm_block_at(addr))
+                        imgui_disasm_block_tooltip(disasm_block_at(addr));
+
+                    ImGui::TableNextColumn();
+                    if(code)
+                    {
+                        ImGui::Text("%02X %02X", c8.memory[addr], c8.memory[addr + 1]);
+                        ImGui::TableNextColumn();
+                        disasm_label(addr, label, sizeof(label));
+                        ImGui::TextUnformatted(label);
+                        ImGui::TableNextColumn();
+
+                        uint16_t op = disasm_read(addr);
+                        char text[32];
+                        disassemble(op, text, sizeof(text));
+                        ImGui::TextUnformatted(text);
+                        OpClass cls = op_class(op);
+                        if(cls == OP_JP || cls == OP_CALL)
+                        {
+                            disasm_label(op & 0xFFF, label, sizeof(label));
+                            ImGui::SameLine();
+                            ImGui::TextDisabled("; %s", label);
+                        }
+                        else if(cls == OP_JP_V0 && disasm_block_at(addr) && disasm_block_at(addr)->table >= 0)
+                        {
+                            ImGui::SameLine();
+                            ImGui::TextDisabled("; table of %d", d->tables[disasm_block_at(addr)->table].count);
+                        }
+                    }
+                    else
+                    {
+                        char bytes[DISASM_DATA_ROW*3 + 1];
+                        int length = 0;
+                        for(int a = addr; a < MEMORY_SIZE && d->row_of[a] == row; a++)
+                            length += snprintf(bytes + length, sizeof(bytes) - length, "%02X ", c8.memory[a]);
+                        ImGui::TextDisabled("%s", bytes);
+                        ImGui::TableNextColumn();
+                        ImGui::TableNextColumn();
+                        ImGui::TextDisabled("data");
+                    }
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+#else
+#define imgui_disasm_menu(...)
+#define imgui_disasm_windows(...)
+#endif
+
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+
+namespace c8e
+{
+// Disassembly by following control flow from the entry points, so data between routines is not
+// decoded as code. The entry points are the program start and every address the pc was seen at
+// that the analysis had not reached (computed jumps it could not resolve, code copied to RAM).
+// The result is cached: a basic-block graph, labels for call and jump targets, the jump tables
+// behind JP V0, and the listing layout, one row per instruction and up to DISASM_DATA_ROW bytes
+// per row of data.
+//
+// mark_memory_written tells disasm_note_write about every write; only one that lands on a word the
+// walk decoded marks the cache dirty. A bitmap of the 64-byte chunks the walk read turns away
+// writes to data elsewhere before the bytes are looked at. disasm_update then compares those bytes against the ones
+// analyzed and re-walks only if one really changed. Data rows are drawn from live memory and
+// never need it.
+const int DISASM_DATA_ROW = 8;
+const int DISASM_MAX_TABLES = 64;
+const int DISASM_MAX_TABLE_ENTRIES = 128; // V0 is a byte, entries are 2 bytes
+
+enum DisasmFlags
+{
+	DISASM_CODE = 1 << 0, // an instruction starts here
+	DISASM_BLOCK = 1 << 1, // a basic block starts here
+	DISASM_CALL_TARGET = 1 << 2,
+	DISASM_JUMP_TARGET = 1 << 3,
+	DISASM_TABLE_ENTRY = 1 << 4, // a target of JP V0
+	DISASM_ENTRY = 1 << 5, // the program start, or somewhere the pc was seen
+	DISASM_READ = 1 << 6, // the walk decoded the word here, so writing it can change the result
+};
+
+struct DisasmBlock
+{
+	uint16_t start;
+	uint16_t end; // exclusive
+	uint16_t next[2]; // successors, next_count of them; a JP V0 block has its table instead
+	uint8_t next_count;
+	uint8_t exit; // OpClass of the last instruction
+	int16_t table; // index into tables, -1 for none
+};
+
+struct JumpTable
+{
+	uint16_t at; // the JP V0
+	uint16_t base;
+	uint8_t count; // 1 when V0 was loaded with a constant just before
+};
+
+struct Disassembly
+{
+	bool valid;
+	bool dirty; // a write hit a decoded instruction, or memory was replaced
+	uint64_t rom_hash; // entry points are forgotten when the ROM changes
+
+	uint8_t flags[MEMORY_SIZE]; // DisasmFlags
+	uint8_t analyzed[MEMORY_SIZE]; // memory as it was at the last walk
+	uint64_t entries[MEMORY_SIZE / 64]; // bitmap
+	uint64_t read_chunks; // bit n: the walk read a byte in [64n, 64n + 64)
+
+	DisasmBlock blocks[MEMORY_SIZE]; // by address; targets can be odd, so both byte alignments may hold code
+	int block_count;
+	int16_t block_of[MEMORY_SIZE]; // for each instruction, -1 elsewhere
+	JumpTable tables[DISASM_MAX_TABLES];
+	int table_count;
+
+	uint16_t rows[MEMORY_SIZE]; // first address of each listing row
+	int row_count;
+	uint16_t row_of[MEMORY_SIZE];
+
+	int instruction_count;
+	int subroutine_count;
+	uint64_t walks;
+	double last_walk_us;
+};
+
+Disassembly disasm;
+
+void disasm_invalidate(); // memory was replaced
+void disasm_note_write(uint16_t addr, uint16_t count);
+void disasm_add_entry(uint16_t pc);
+void disasm_update(); // re-walks if dirty and an instruction changed
+void disasm_label(uint16_t addr, char* text, int size); // "" when addr is not a target
+const DisasmBlock* disasm_block_at(uint16_t addr);
+
+void imgui_disasm_menu();
+void imgui_disasm_windows();
+};
@@ -0,0 +1,442 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_expr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace c8e
+{
+
+struct ExprBinary
+{
+    const char* token;
+    int precedence;
+    uint8_t op;
+};
+
+// Two-character tokens first, so "<=" is not read as "<".
+static const ExprBinary EXPR_BINARY[] =
+{
+    {"||", 1, EXPR_LOR}, {"&&", 2, EXPR_LAND}, {"==", 6, EXPR_EQ}, {"!=", 6, EXPR_NE},
+    {"<=", 7, EXPR_LE}, {">=", 7, EXPR_GE}, {"<<", 8, EXPR_SHL}, {">>", 8, EXPR_SHR},
+    {"|", 3, EXPR_OR}, {"^", 4, EXPR_XOR}, {"&", 5, EXPR_AND}, {"<", 7, EXPR_LT}, {">", 7, EXPR_GT},
+    {"+", 9, EXPR_ADD}, {"-", 9, EXPR_SUB}, {"*", 10, EXPR_MUL}, {"/", 10, EXPR_DIV}, {"%", 10, EXPR_MOD},
+};
+
+struct ExprName
+{
+    const char* name;
+    uint8_t op;
+};
+
+static const ExprName EXPR_NAMES[] =
+{
+    {"i", EXPR_I}, {"pc", EXPR_PC}, {"dt", EXPR_DT}, {"st", EXPR_ST}, {"sp", EXPR_SP},
+    {"cycle", EXPR_CYCLE}, {"frame", EXPR_FRAME}, {"mem", EXPR_MEM}, {"key", EXPR_KEY},
+};
+
+struct ExprParser
+{
+    const char* text;
+    const char* at;
+    Expr* expr;
+    int depth; // of the stack at run time
+    bool failed;
+};
+
+static void parse_fail(ExprParser* p, const char* message)
+{
+    if(p->failed)
+        return;
+    p->failed = true;
+    snprintf(p->expr->error, sizeof(p->expr->error), "%s", message);
+    p->expr->error_at = (int)(p->at - p->text);
+}
+
+static void emit(ExprParser* p, uint8_t byte)
+{
+    if(p->expr->size >= EXPR_MAX_CODE - 1) // room for EXPR_END
+    {
+        parse_fail(p, "expression too long");
+        return;
+    }
+    p->expr->code[p->expr->size++] = byte;
+}
+
+static void push(ExprParser* p)
+{
+    if(++p->depth > EXPR_MAX_STACK)
+        parse_fail(p, "expression too deep");
+}
+
+static void skip_space(ExprParser* p)
+{
+    while(*p->at == ' ' || *p->at == '\t')
+        p->at++;
+}
+
+static bool accept(ExprParser* p, char c)
+{
+    skip_space(p);
+    if(*p->at != c)
+        return false;
+    p->at++;
+    return true;
+}
+
+static void parse_expression(ExprParser* p, int min_precedence);
+
+static void parse_operand(ExprParser* p)
+{
+    skip_space(p);
+    char c = *p->at;
+    if(p->failed)
+        return;
+
+    if(c == '(')
+    {
+        p->at++;
+        parse_expression(p, 1);
+        if(!accept(p, ')'))
+            parse_fail(p, "expected )");
+        return;
+    }
+
+    if(c == '-' || c == '!' || c == '~')
+    {
+        p->at++;
+        parse_operand(p);
+        emit(p, c == '-' ? EXPR_NEG : c == '!' ? EXPR_NOT : EXPR_BNOT);
+        return;
+    }
+
+    if(c >= '0' && c <= '9')
+    {
+        char* end;
+        bool hex = c == '0' && (p->at[1] == 'x' || p->at[1] == 'X');
+        long long value = strtoll(p->at, &end, hex ? 16 : 10);
+        if(value > INT32_MAX)
+        {
+            parse_fail(p, "number too big");
+            return;
+        }
+        p->at = end;
+        int32_t constant = (int32_t)value;
+        emit(p, EXPR_CONST);
+        for(int b = 0; b < 4; b++)
+        {
+            emit(p, (uint8_t)(constant >> (b*8)));
+        }
+        push(p);
+        return;
+    }
+
+    char name[8];
+    int length = 0;
+    while((p->at[length] >= 'a' && p->at[length] <= 'z') || (p->at[length] >= 'A' && p->at[length] <= 'Z') ||
+          (p->at[length] >= '0' && p->at[length] <= '9') || p->at[length] == '_')
+    {
+        if(length < (int)sizeof(name) - 1)
+            name[length] = (char)(p->at[length] | 0x20);
+        length++;
+    }
+    if(length == 0)
+    {
+        parse_fail(p, "expected a value");
+        return;
+    }
+    name[length < (int)sizeof(name) ? length : (int)sizeof(name) - 1] = 0;
+
+    if(length == 2 && name[0] == 'v' && ((name[1] >= '0' && name[1] <= '9') || (name[1] >= 'a' && name[1] <= 'f')))
+    {
+        p->at += length;
+        emit(p, EXPR_V);
+        emit(p, (uint8_t)(name[1] <= '9' ? name[1] - '0' : name[1] - 'a' + 10));
+        push(p);
+        return;
+    }
+    for(size_t n = 0; n < sizeof(EXPR_NAMES)/sizeof(*EXPR_NAMES); n++)
+    {
+        if(length >= (int)sizeof(name) || strcmp(name, EXPR_NAMES[n].name) != 0)
+            continue;
+        p->at += length;
+        uint8_t op = EXPR_NAMES[n].op;
+        if(op == EXPR_MEM || op == EXPR_KEY)
+        {
+            if(!accept(p, '['))
+            {
+                parse_fail(p, "expected [");
+                return;
+            }
+            parse_expression(p, 1);
+            if(!accept(p, ']'))
+                parse_fail(p, "expected ]");
+            emit(p, op); // replaces the index
+        }
+        else
+        {
+            emit(p, op);
+            push(p);
+        }
+        return;
+    }
+    parse_fail(p, "unknown name");
+}
+
+// Precedence climbing; every operator is left-associative.
+static void parse_expression(ExprParser* p, int min_precedence)
+{
+    parse_operand(p);
+    while(!p->failed)
+    {
+        skip_space(p);
+        const ExprBinary* binary = 0;
+        for(size_t n = 0; n < sizeof(EXPR_BINARY)/sizeof(*EXPR_BINARY); n++)
+        {
+            if(strncmp(p->at, EXPR_BINARY[n].token, strlen(EXPR_BINARY[n].token)) == 0)
+            {
+                binary = &EXPR_BINARY[n];
+                break;
+            }
+        }
+        if(!binary || binary->precedence < min_precedence)
+            break;
+        p->at += strlen(binary->token);
+        parse_expression(p, binary->precedence + 1);
+        emit(p, binary->op);
+        p->depth--;
+    }
+}
+
+bool expr_compile(Expr* expr, const char* text)
+{
+    memset(expr, 0, sizeof(*expr));
+    ExprParser parser = {text, text, expr, 0, false};
+    parse_expression(&parser, 1);
+    skip_space(&parser);
+    if(*parser.at)
+        parse_fail(&parser, "unexpected text");
+    emit(&parser, EXPR_END);
+    if(parser.failed)
+    {
+        expr->size = 0;
+        expr->code[0] = EXPR_END;
+        return false;
+    }
+    return true;
+}
+
+static inline int64_t expr_eval(const Expr* expr)
+{
+    int64_t stack[EXPR_MAX_STACK + 1];
+    int top = 0;
+    stack[0] = 0;
+    const uint8_t* code = expr->code;
+    for(;;)
+    {
+        uint8_t op = *code++;
+        if(op >= EXPR_MUL)
+        {
+            int64_t b = stack[top--];
+            int64_t a = stack[top];
+            int64_t r;
+            switch(op)
+            {
+                case EXPR_MUL: r = (int64_t)((uint64_t)a * (uint64_t)b); break;
+                case EXPR_DIV: r = (b == 0 || b == -1) ? (b ? (int64_t)(0 - (uint64_t)a) : 0) : a / b; break;
+                case EXPR_MOD: r = (b == 0 || b == -1) ? 0 : a % b; break;
+                case EXPR_ADD: r = (int64_t)((uint64_t)a + (uint64_t)b); break;
+                case EXPR_SUB: r = (int64_t)((uint64_t)a - (uint64_t)b); break;
+                case EXPR_SHL: r = (int64_t)((uint64_t)a << (b & 63)); break;
+                case EXPR_SHR: r = a >> (b & 63); break;
+                case EXPR_LT: r = a < b; break;
+                case EXPR_LE: r = a <= b; break;
+                case EXPR_GT: r = a > b; break;
+                case EXPR_GE: r = a >= b; break;
+                case EXPR_EQ: r = a == b; break;
+                case EXPR_NE: r = a != b; break;
+                case EXPR_AND: r = a & b; break;
+                case EXPR_XOR: r = a ^ b; break;
+                case EXPR_OR: r = a | b; break;
+                case EXPR_LAND: r = a && b; break;
+                default: r = a || b; break;
+            }
+            stack[top] = r;
+            continue;
+        }
+        switch(op)
+        {
+            case EXPR_END: return stack[top];
+            case EXPR_CONST:
+            {
+                int32_t value = (int32_t)(code[0] | (code[1] << 8) | (code[2] << 16) | ((uint32_t)code[3] << 24));
+                code += 4;
+                stack[++top] = value;
+                break;
+            }
+            case EXPR_V: stack[++top] = c8.v[*code++ & 0xF]; break;
+            case EXPR_I: stack[++top] = c8.i; break;
+            case EXPR_PC: stack[++top] = c8.pc; break;
+            case EXPR_DT: stack[++top] = c8.vd; break;
+            case EXPR_ST: stack[++top] = c8.vs; break;
+            case EXPR_SP: stack[++top] = c8.sp; break;
+            case EXPR_CYCLE: stack[++top] = (int64_t)c8.cycle; break;
+            case EXPR_FRAME: stack[++top] = (int64_t)c8.frame; break;
+            case EXPR_MEM: stack[top] = c8.memory[(uint64_t)stack[top] % MEMORY_SIZE]; break;
+            case EXPR_KEY: stack[top] = c8.keys[stack[top] & 0xF] != 0; break;
+            case EXPR_NEG: stack[top] = (int64_t)(0 - (uint64_t)stack[top]); break;
+            case EXPR_NOT: stack[top] = !stack[top]; break;
+            case EXPR_BNOT: stack[top] = ~stack[top]; break;
+        }
+    }
+}
+
+bool watch_add(const char* text)
+{
+    if(watches.count == WATCH_MAX)
+        return false;
+    Watch* watch = &watches.items[watches.count];
+    if(!expr_compile(&watch->expr, text))
+        return false;
+    snprintf(watch->text, sizeof(watch->text), "%s", text);
+    watch->history_head = 0;
+    watch->history_count = 0;
+    watches.count++;
+    return true;
+}
+
+void watch_remove(int index)
+{
+    memmove(&watches.items[index], &watches.items[index + 1], (watches.count - index - 1) * sizeof(Watch));
+    watches.count--;
+}
+
+// Called by end_frame. Going back in time drops the samples from then on.
+void watch_sample()
+{
+    for(int w = 0; w < watches.count; w++)
+    {
+        Watch* watch = &watches.items[w];
+        while(watch->history_count > 0)
+        {
+            int newest = (watch->history_head + WATCH_HISTORY - 1) % WATCH_HISTORY;
+            if(watch->history_frame[newest] < c8.frame)
+                break;
+            watch->history_head = newest;
+            watch->history_count--;
+        }
+        watch->history[watch->history_head] = (float)expr_eval(&watch->expr);
+        watch->history_frame[watch->history_head] = c8.frame;
+        watch->history_head = (watch->history_head + 1) % WATCH_HISTORY;
+        if(watch->history_count < WATCH_HISTORY)
+            watch->history_count++;
+    }
+}
+
+#ifdef USE_IMGUI
+static bool g_show_watches = false;
+
+void imgui_watch_menu()
+{
+    if(ImGui::BeginMenu("Debug"))
+    {
+        ImGui::MenuItem("Watch", 0, &g_show_watches);
+        ImGui::EndMenu();
+    }
+}
+
+static float watch_history_value(void* data, int index)
+{
+    const Watch* watch = (const Watch*)data;
+    int oldest = (watch->history_head + WATCH_HISTORY - watch->history_count) % WATCH_HISTORY;
+    return watch->history[(oldest + index) % WATCH_HISTORY];
+}
+
+// Shared with the breakpoints window: a text field that compiles on Enter or Add, showing
+// where it went wrong.
+static bool imgui_expr_input(const char* id, char* text, int size, Expr* compiled)
+{
+    ImGui::PushID(id);
+    ImGui::SetNextItemWidth(-60);
+    bool submit = ImGui::InputTextWithHint("##text", "v3 == 0x10 && mem[i+2] > 5", text, size, ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    submit |= ImGui::Button("Add");
+    ImGui::PopID();
+
+    static const char* error_text = 0;
+    static char error[80];
+    bool ok = false;
+    if(submit)
+    {
+        ok = expr_compile(compiled, text);
+        if(!ok)
+        {
+            snprintf(error, sizeof(error), "column %d: %s", compiled->error_at + 1, compiled->error);
+            error_text = text;
+        }
+        else
+        {
+            error_text = 0;
+        }
+    }
+    if(error_text == text)
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", error);
+    return ok;
+}
+
+void imgui_watch_windows()
+{
+    if(!g_show_watches)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(420, 300), ImGuiCond_FirstUseEver);
+    if(ImGui::Begin("Watch", &g_show_watches))
+    {
+        static char text[EXPR_MAX_TEXT];
+        static Expr compiled;
+        if(imgui_expr_input("watch", text, sizeof(text), &compiled) && watch_add(text))
+        {
+            text[0] = 0;
+        }
+
+        ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersV | ImGuiTableFlags_Resizable;
+        if(ImGui::BeginTable("watches", 4, flags))
+        {
+            ImGui::TableSetupColumn("Expression");
+            ImGui::TableSetupColumn("Value");
+            ImGui::TableSetupColumn("Last 10 s", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableHeadersRow();
+            for(int w = 0; w < watches.count; w++)
+            {
+                Watch* watch = &watches.items[w];
+                int64_t value = expr_eval(&watch->expr);
+                ImGui::PushID(w);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(watch->text);
+                ImGui::TableNextColumn();
+                ImGui::Text("%lld (%llX)", (long long)value, (unsigned long long)value);
+                ImGui::TableNextColumn();
+                ImGui::PlotLines("##history", watch_history_value, watch, watch->history_count, 0, 0, FLT_MAX, FLT_MAX, ImVec2(-1, 32));
+                ImGui::TableNextColumn();
+                bool removed = ImGui::SmallButton("x");
+                ImGui::PopID();
+                if(removed)
+                {
+                    watch_remove(w);
+                    break;
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+#else
+#define imgui_watch_menu(...)
+#define imgui_watch_windows(...)
+#endif
+
+};
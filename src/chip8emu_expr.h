@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+
+namespace c8e
+{
+// Expressions for breakpoint conditions and watches, like "v3 == 0x10 && mem[i+2] > 5".
+// expr_compile parses the text once into stack bytecode; expr_eval only runs that, so nothing
+// is parsed per instruction.
+//
+//   operands   numbers (12, 0x1F), v0-vf, i, pc, dt, st, sp, cycle, frame, mem[e], key[e]
+//   operators  C's, with C's precedence: ! ~ - (unary), * / %, + -, << >>, < <= > >=,
+//              == !=, &, ^, |, &&, ||, and parentheses
+//
+// Values are 64-bit signed. Division by zero gives 0, mem[] wraps around memory.
+const int EXPR_MAX_CODE = 96;
+const int EXPR_MAX_STACK = 16;
+const int EXPR_MAX_TEXT = 96;
+
+enum ExprOp
+{
+	EXPR_END,
+	EXPR_CONST, // 4 byte operand, little-endian
+	EXPR_V, // 1 byte operand
+	EXPR_I, EXPR_PC, EXPR_DT, EXPR_ST, EXPR_SP, EXPR_CYCLE, EXPR_FRAME,
+	EXPR_MEM, EXPR_KEY, // pop an index
+	EXPR_NEG, EXPR_NOT, EXPR_BNOT,
+	EXPR_MUL, EXPR_DIV, EXPR_MOD, EXPR_ADD, EXPR_SUB, EXPR_SHL, EXPR_SHR,
+	EXPR_LT, EXPR_LE, EXPR_GT, EXPR_GE, EXPR_EQ, EXPR_NE,
+	EXPR_AND, EXPR_XOR, EXPR_OR, EXPR_LAND, EXPR_LOR,
+};
+
+struct Expr
+{
+	uint8_t code[EXPR_MAX_CODE];
+	int size; // 0 when it did not compile
+	char error[48];
+	int error_at; // offset into the text
+};
+
+bool expr_compile(Expr* expr, const char* text);
+static inline int64_t expr_eval(const Expr* expr);
+
+// A watch samples its expression at the end of every frame for the plot.
+const int WATCH_MAX = 16;
+const int WATCH_HISTORY = 600; // frames
+
+struct Watch
+{
+	Expr expr;
+	char text[EXPR_MAX_TEXT];
+	float history[WATCH_HISTORY]; // ring
+	uint64_t history_frame[WATCH_HISTORY];
+	int history_head; // next slot
+	int history_count;
+};
+
+struct Watches
+{
+	Watch items[WATCH_MAX];
+	int count;
+};
+
+Watches watches;
+
+bool watch_add(const char* text);
+void watch_remove(int index);
+void watch_sample();
+
+void imgui_watch_menu();
+void imgui_watch_windows();
+};
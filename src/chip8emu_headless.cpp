@@ -0,0 +1,2905 @@
+#include "chip8emu_platform.h"
+#include "chip8emu.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace plat
+{
+
+bool show_file_prompt(FilePath* path, const char* extension)
+{
+    // Nothing to prompt with, paths come from the command line.
+    return false;
+}
+
+bool show_save_prompt(FilePath* path, const char* extension)
+{
+    return false;
+}
+
+void unload_path(FilePath path)
+{
+    // Paths point into argv.
+}
+
+FileContents load_entire_file(FilePath path)
+{
+    FileContents contents = {0};
+
+    FILE* file = fopen(path.data, "rb");
+    if(!file)
+    {
+        return contents;
+    }
+    if(fseek(file, 0, SEEK_END) != 0)
+    {
+        fclose(file);
+        return contents;
+    }
+    long size = ftell(file);
+    if(size < 0)
+    {
+        fclose(file);
+        return contents;
+    }
+    rewind(file);
+
+    void* memory = malloc(size ? size : 1);
+    if(!memory)
+    {
+        fclose(file);
+        return contents;
+    }
+    if(fread(memory, 1, size, file) != (size_t)size)
+    {
+        free(memory);
+        fclose(file);
+        return contents;
+    }
+
+    contents.data = memory;
+    contents.len = size;
+    fclose(file);
+    return contents;
+}
+
+void unload_file(FileContents contents)
+{
+    free(contents.data);
+}
+
+bool write_entire_file(FilePath path, const void* data, size_t size)
+{
+    FILE* file = fopen(path.data, "wb");
+    if(!file)
+    {
+        return false;
+    }
+    bool result = fwrite(data, 1, size, file) == size;
+    result &= fclose(file) == 0;
+    return result;
+}
+
+FileContents map_file(FilePath path)
+{
+    FileContents contents = {0};
+    int file = open(path.data, O_RDONLY);
+    if(file < 0)
+        return contents;
+
+    struct stat status;
+    if(fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        void* data = mmap(0, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if(data != MAP_FAILED)
+        {
+            contents.data = data;
+            contents.len = (size_t)status.st_size;
+        }
+    }
+    close(file);
+    return contents;
+}
+
+void unmap_file(FileContents contents)
+{
+    if(contents.data)
+        munmap(contents.data, contents.len);
+}
+
+FileHandle open_file_for_writing(FilePath path)
+{
+    return fopen(path.data, "wb");
+}
+
+bool write_file(FileHandle file, const void* data, size_t size)
+{
+    return fwrite(data, 1, size, (FILE*)file) == size;
+}
+
+void close_file(FileHandle file)
+{
+    if(file)
+        fclose((FILE*)file);
+}
+
+FileHandle open_temp_file()
+{
+    return tmpfile();
+}
+
+bool read_file_at(FileHandle file, uint64_t offset, void* data, size_t size)
+{
+    return fseeko((FILE*)file, (off_t)offset, SEEK_SET) == 0 && fread(data, 1, size, (FILE*)file) == size;
+}
+
+bool write_file_at(FileHandle file, uint64_t offset, const void* data, size_t size)
+{
+    return fseeko((FILE*)file, (off_t)offset, SEEK_SET) == 0 && fwrite(data, 1, size, (FILE*)file) == size;
+}
+
+void update_input()
+{
+    // Headless runs drive c8.keys directly.
+}
+
+uint64_t get_ticks()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t get_ticks_per_second()
+{
+    return 1000000000ull;
+}
+
+};
+
+static inline double get_time()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+// Used when no ROM is given: draws random font glyphs at random positions forever.
+static const uint16_t DEFAULT_PROGRAM[] =
+{
+    0xC00F, // 200: rnd v0, 0xF
+    0xF029, // 202: ld f, v0
+    0xC13F, // 204: rnd v1, 0x3F
+    0xC21F, // 206: rnd v2, 0x1F
+    0xD125, // 208: drw v1, v2, 5
+    0x1200, // 20A: jp 200
+};
+
+static void load_program(const uint16_t* ops, int count)
+{
+    memset(c8e::c8.rom, 0, sizeof(c8e::c8.rom));
+    for(int i = 0; i < count; i++)
+    {
+        c8e::c8.rom[i*2] = ops[i] >> 8;
+        c8e::c8.rom[i*2+1] = ops[i] & 0xFF;
+    }
+}
+
+static void headless_initialize(const char* rom_path)
+{
+    memset(&c8e::c8, 0, sizeof(c8e::c8));
+    if(rom_path)
+    {
+        plat::FilePath path = {strlen(rom_path), (char*)rom_path};
+        c8e::load_rom(path);
+    }
+    else
+    {
+        load_program(DEFAULT_PROGRAM, sizeof(DEFAULT_PROGRAM)/sizeof(*DEFAULT_PROGRAM));
+    }
+    c8e::reset();
+    c8e::c8.loaded = true;
+}
+
+// Measures how many snapshots and restores one core can do per second.
+static int bench_snapshot(const char* rom_path)
+{
+    headless_initialize(rom_path);
+
+    // Get the machine into some non-trivial state first.
+    for(int i = 0; i < 100000; i++)
+    {
+        c8e::next_op();
+    }
+
+    static c8e::Snapshot snapshots[64];
+    const int iterations = 200000;
+
+    double start = get_time();
+    for(int i = 0; i < iterations; i++)
+    {
+        c8e::save_snapshot(&snapshots[i & 63]);
+    }
+    double save_seconds = get_time() - start;
+
+    start = get_time();
+    for(int i = 0; i < iterations; i++)
+    {
+        c8e::load_snapshot(&snapshots[i & 63]);
+    }
+    double load_seconds = get_time() - start;
+
+    printf("{\"benchmark\": \"snapshot\", \"snapshot_bytes\": %d, \"iterations\": %d, "
+           "\"saves_per_second\": %.0f, \"ns_per_save\": %.1f, "
+           "\"restores_per_second\": %.0f, \"ns_per_restore\": %.1f}\n",
+           (int)sizeof(c8e::Snapshot), iterations,
+           iterations / save_seconds, save_seconds * 1e9 / iterations,
+           iterations / load_seconds, load_seconds * 1e9 / iterations);
+    return 0;
+}
+
+// Runs the same frames with and without recording rewind history, then steps back through it.
+static int bench_rewind(const char* rom_path)
+{
+    const int frames = 10*60*60;
+
+    headless_initialize(rom_path);
+    double start = get_time();
+    for(int f = 0; f < frames; f++)
+    {
+        c8e::run_frame();
+    }
+    double plain_seconds = get_time() - start;
+
+    c8e::Rewind* rewind = &c8e::rewind_history;
+    if(!c8e::rewind_init(rewind, frames, 8*1024*1024))
+    {
+        fprintf(stderr, "ERROR: Could not allocate the rewind buffer.\n");
+        return 1;
+    }
+
+    // Keep the last few frames around to check that stepping back restores them exactly.
+    static c8e::Snapshot expected[120];
+    const int checked = sizeof(expected)/sizeof(*expected);
+
+    headless_initialize(rom_path);
+    start = get_time();
+    for(int f = 0; f < frames; f++)
+    {
+        c8e::run_frame();
+        c8e::rewind_push(rewind);
+        if(f >= frames - checked)
+        {
+            c8e::save_snapshot(&expected[f - (frames - checked)]);
+        }
+    }
+    double rewind_seconds = get_time() - start;
+
+    int recorded = rewind->count;
+    uint32_t bytes = c8e::rewind_bytes_used(rewind);
+
+    bool verified = true;
+    c8e::Snapshot actual;
+    for(int back = 1; back < checked; back++)
+    {
+        c8e::rewind_step_back(rewind);
+        c8e::save_snapshot(&actual);
+        verified &= memcmp(&actual, &expected[checked - 1 - back], sizeof(actual)) == 0;
+    }
+
+    int stepped = 0;
+    start = get_time();
+    while(c8e::rewind_step_back(rewind))
+    {
+        stepped++;
+    }
+    double step_seconds = get_time() - start;
+
+    printf("{\"benchmark\": \"rewind\", \"frames\": %d, \"frames_recorded\": %d, "
+           "\"fps_without_rewind\": %.0f, \"fps_with_rewind\": %.0f, \"ns_per_push\": %.1f, "
+           "\"bytes_used\": %u, \"bytes_per_frame\": %.1f, \"ns_per_step_back\": %.1f, \"verified\": %s}\n",
+           frames, recorded,
+           frames / plain_seconds, frames / rewind_seconds, (rewind_seconds - plain_seconds) * 1e9 / frames,
+           bytes, (double)bytes / recorded, stepped ? step_seconds * 1e9 / stepped : 0.0,
+           verified ? "true" : "false");
+
+    c8e::rewind_free(rewind);
+    return verified ? 0 : 1;
+}
+
+// Cost of presenting each frame with 0..max_frames of run-ahead.
+static int bench_run_ahead(const char* rom_path, int max_frames)
+{
+    const int frames = 60*60;
+
+    printf("[\n");
+    for(int ahead = 0; ahead <= max_frames; ahead++)
+    {
+        headless_initialize(rom_path);
+        c8e::run_ahead_state.frames = ahead;
+
+        long long ops = 0;
+        long long extra_ops = 0;
+        double extra_seconds = 0.0;
+        double start = get_time();
+        for(int f = 0; f < frames; f++)
+        {
+            ops += c8e::run_frame();
+            double ahead_start = get_time();
+            extra_ops += c8e::run_ahead(&c8e::run_ahead_state);
+            extra_seconds += get_time() - ahead_start;
+        }
+        double seconds = get_time() - start;
+
+        printf("    {\"benchmark\": \"run_ahead\", \"frames_ahead\": %d, \"presented_fps\": %.0f, "
+               "\"extra_us_per_frame\": %.3f, \"extra_ops_per_frame\": %.1f, \"ops_per_frame\": %.1f}%s\n",
+               ahead, frames / seconds, extra_seconds * 1e6 / frames, (double)extra_ops / frames, (double)ops / frames,
+               ahead < max_frames ? "," : "");
+    }
+    printf("]\n");
+    return 0;
+}
+
+static bool pc_is(void* user)
+{
+    return c8e::c8.pc == *(uint16_t*)user;
+}
+
+// Runs with reverse-debugging history on and random input, then checks that seeking back lands
+// on exactly the states the forward run went through, and times steps back.
+static int bench_reverse(const char* rom_path, int minutes)
+{
+    const int frames = minutes*60*60;
+    const int checked = 256;
+    static c8e::Snapshot expected[checked];
+
+    headless_initialize(rom_path);
+    double start = get_time();
+    for(int f = 0; f < frames; f++)
+    {
+        c8e::run_frame();
+    }
+    double plain_seconds = get_time() - start;
+
+    if(!c8e::debug_init(&c8e::debugger, c8e::DEBUG_DEFAULT_BUDGET))
+    {
+        fprintf(stderr, "ERROR: Could not allocate the debugger history.\n");
+        return 1;
+    }
+
+    // Random keys, each held for a few frames; the last frames are kept to check against.
+    headless_initialize(rom_path);
+    uint32_t rng = 0x9E3779B9;
+    start = get_time();
+    for(int f = 0; f < frames; f++)
+    {
+        if(f % 8 == 0)
+        {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            for(int k = 0; k < 16; k++)
+            {
+                c8e::c8.keys[k] = (rng >> k) & (rng >> (k + 16)) & 1;
+            }
+        }
+        c8e::run_frame();
+        int slot = f - (frames - checked*4);
+        if(slot >= 0 && slot % 4 == 0)
+        {
+            c8e::save_snapshot(&expected[slot / 4]);
+        }
+    }
+    double debug_seconds = get_time() - start;
+    uint64_t end_cycle = c8e::c8.cycle;
+    uint64_t history_cycles = end_cycle - c8e::debugger.keyframes[0].cycle;
+
+    // Seek to the recorded frame boundaries out of order.
+    int mismatches = 0;
+    c8e::Snapshot actual;
+    for(int n = 0; n < checked; n++)
+    {
+        int e = (n * 97) % checked;
+        if(!c8e::debug_seek(expected[e].cycle))
+        {
+            mismatches++;
+            continue;
+        }
+        c8e::save_snapshot(&actual);
+        mismatches += memcmp(&actual, &expected[e], sizeof(actual)) != 0;
+    }
+
+    // A step back and a step forward again is a no-op.
+    c8e::debug_seek(end_cycle);
+    int steps = 2000;
+    double step_max = 0.0;
+    start = get_time();
+    for(int n = 0; n < steps; n++)
+    {
+        double step_start = get_time();
+        c8e::debug_step_back();
+        double t = get_time() - step_start;
+        if(t > step_max)
+            step_max = t;
+    }
+    double step_seconds = get_time() - start;
+    uint64_t back_hash = c8e::hash_state();
+    c8e::debug_step();
+    c8e::debug_step_back();
+    mismatches += c8e::hash_state() != back_hash;
+
+    // Run back to the pc of the instruction at the start of the history.
+    c8e::debug_seek(end_cycle);
+    c8e::debug_seek(c8e::debugger.keyframes[0].cycle + 1);
+    uint16_t target_pc = c8e::c8.pc;
+    c8e::debug_seek(end_cycle);
+    start = get_time();
+    bool found = c8e::debug_run_back(pc_is, &target_pc);
+    double run_back_seconds = get_time() - start;
+    mismatches += !found || c8e::c8.pc != target_pc;
+
+    printf("{\"benchmark\": \"reverse\", \"frames\": %d, \"fps_without_history\": %.0f, \"fps_with_history\": %.0f, "
+           "\"history_cycles\": %llu, \"keyframes\": %d, \"keyframe_spacing\": %llu, "
+           "\"us_per_step_back\": %.1f, \"max_us_step_back\": %.1f, \"ms_run_back\": %.2f, "
+           "\"mismatches\": %d}\n",
+           frames, frames / plain_seconds, frames / debug_seconds,
+           (unsigned long long)history_cycles, c8e::debugger.keyframe_count, (unsigned long long)c8e::debugger.keyframe_spacing,
+           step_seconds * 1e6 / steps, step_max * 1e6, run_back_seconds * 1e3, mismatches);
+
+    c8e::debug_free(&c8e::debugger);
+    return mismatches ? 1 : 0;
+}
+
+// Scatters BCD and register stores over 0x400-0x5FF.
+static const uint16_t WRITES_PROGRAM[] =
+{
+    0xA400, // 200: ld i, 400
+    0xC1FF, // 202: rnd v1, 0xFF
+    0xF11E, // 204: add i, v1
+    0xC1FF, // 206: rnd v1, 0xFF
+    0xF11E, // 208: add i, v1
+    0xC0FF, // 20A: rnd v0, 0xFF
+    0xF033, // 20C: ld b, v0
+    0xF155, // 20E: ld [i], v1
+    0x1200, // 210: jp 200
+};
+
+// Logs memory writes over a long run at a high ips, checks the log against memory diffed after
+// every instruction, and times queries.
+static int bench_writes(const char* rom_path, int seconds)
+{
+    const long long ips = 600000;
+    const int frames = seconds*60;
+
+    if(rom_path)
+        headless_initialize(rom_path);
+    else
+    {
+        memset(&c8e::c8, 0, sizeof(c8e::c8));
+        load_program(WRITES_PROGRAM, sizeof(WRITES_PROGRAM)/sizeof(*WRITES_PROGRAM));
+        c8e::reset();
+        c8e::c8.loaded = true;
+    }
+    static c8e::Snapshot start_state;
+    c8e::save_snapshot(&start_state);
+
+    c8e::c8.ips = ips;
+    double start = get_time();
+    for(int f = 0; f < frames; f++)
+    {
+        c8e::run_frame();
+    }
+    double plain_seconds = get_time() - start;
+
+    c8e::WriteLog* log = &c8e::write_log;
+    c8e::load_snapshot(&start_state);
+    if(!c8e::write_log_init(log))
+    {
+        fprintf(stderr, "ERROR: Could not set up the write log.\n");
+        return 1;
+    }
+    c8e::c8.ips = ips;
+    start = get_time();
+    static c8e::Snapshot middle_state;
+    for(int f = 0; f < frames; f++)
+    {
+        if(f == frames / 2)
+            c8e::save_snapshot(&middle_state);
+        c8e::run_frame();
+    }
+    double log_seconds = get_time() - start;
+
+    // Changed bytes seen by diffing memory must be the newest logged write at their cycle.
+    int mismatches = 0;
+    long long changes = 0;
+    uint8_t before[c8e::MEMORY_SIZE];
+    for(int n = 0; n < 200000; n++)
+    {
+        memcpy(before, c8e::c8.memory, sizeof(before));
+        uint64_t cycle = c8e::c8.cycle;
+        uint16_t pc = c8e::c8.pc;
+        c8e::next_op();
+        for(int a = 0; a < c8e::MEMORY_SIZE; a++)
+        {
+            if(before[a] == c8e::c8.memory[a])
+                continue;
+            c8e::MemoryWrite write;
+            changes++;
+            mismatches += !c8e::write_log_last(log, (uint16_t)a, cycle + 1, &write) || write.cycle != cycle ||
+                          write.pc != pc || write.old_value != before[a] || write.new_value != c8e::c8.memory[a];
+        }
+    }
+    for(int a = 0; a < c8e::MEMORY_SIZE; a++)
+    {
+        c8e::MemoryWrite write;
+        if(c8e::write_log_last(log, (uint16_t)a, UINT64_MAX, &write))
+            mismatches += write.new_value != c8e::c8.memory[a];
+    }
+
+    // Query timing, over the whole history that is still kept.
+    uint64_t first_cycle = c8e::write_log_first_cycle(log);
+    uint64_t span = c8e::c8.cycle - first_cycle;
+    uint32_t rng = 0x2545F491;
+    const int queries = 20000;
+    int hits = 0;
+    start = get_time();
+    for(int n = 0; n < queries; n++)
+    {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        c8e::MemoryWrite write;
+        hits += c8e::write_log_last(log, (uint16_t)(0x400 + (rng & 0x1FF)), first_cycle + (uint64_t)((double)rng / UINT32_MAX * span), &write);
+    }
+    double last_seconds = get_time() - start;
+
+    static c8e::MemoryWrite writes[256];
+    start = get_time();
+    for(int n = 0; n < queries / 10; n++)
+    {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        uint16_t addr = (uint16_t)(0x400 + (rng & 0x1F0));
+        c8e::write_log_query(log, addr, addr + 15, first_cycle + (uint64_t)((double)rng / UINT32_MAX * span), writes, 256);
+    }
+    double range_seconds = get_time() - start;
+
+    // Going back cuts off the history after that point; running forward again logs it anew.
+    uint64_t total = log->total;
+    uint64_t segments = log->segment_end - log->first_segment;
+    c8e::load_snapshot(&middle_state);
+    for(int a = 0; a < c8e::MEMORY_SIZE; a++)
+    {
+        c8e::MemoryWrite write;
+        if(c8e::write_log_last(log, (uint16_t)a, UINT64_MAX, &write))
+            mismatches += write.cycle >= middle_state.cycle;
+    }
+    for(int f = 0; f < 60; f++)
+    {
+        c8e::run_frame();
+    }
+    for(int a = 0; a < c8e::MEMORY_SIZE; a++)
+    {
+        c8e::MemoryWrite write;
+        if(c8e::write_log_last(log, (uint16_t)a, UINT64_MAX, &write))
+            mismatches += write.new_value != c8e::c8.memory[a];
+    }
+
+    printf("{\"benchmark\": \"writes\", \"frames\": %d, \"ips\": %lld, \"writes_logged\": %llu, "
+           "\"fps_without_log\": %.0f, \"fps_with_log\": %.0f, \"ns_per_write\": %.1f, "
+           "\"history_cycles\": %llu, \"segments\": %llu, \"changes_checked\": %lld, "
+           "\"us_per_last_write\": %.2f, \"last_write_hits\": %d, \"us_per_range_query\": %.2f, \"mismatches\": %d}\n",
+           frames, ips, (unsigned long long)total,
+           frames / plain_seconds, frames / log_seconds, (log_seconds - plain_seconds) * 1e9 / (total ? total : 1),
+           (unsigned long long)span, (unsigned long long)segments, changes,
+           last_seconds * 1e6 / queries, hits, range_seconds * 1e6 / (queries / 10), mismatches);
+
+    c8e::write_log_free(log);
+    return mismatches ? 1 : 0;
+}
+
+// Runs frames the way the win32 loop does until a breakpoint pauses the debugger.
+static bool run_to_breakpoint(int max_frames)
+{
+    c8e::debug_continue();
+    for(int f = 0; f < max_frames; f++)
+    {
+        if(c8e::debugger.frame_ops_left > 0)
+            c8e::debug_finish_frame();
+        else
+            c8e::run_frame();
+        if(c8e::debugger.paused)
+            return true;
+    }
+    return false;
+}
+
+// Speed with nothing armed, with an unreachable pc breakpoint and with a register condition,
+// then checks watch hits against the memory-write log.
+static int bench_breakpoints()
+{
+    const int frames = 20*60;
+    const long long ips = 600000;
+    double fps[3];
+    for(int mode = 0; mode < 3; mode++)
+    {
+        memset(&c8e::breakpoints, 0, sizeof(c8e::breakpoints));
+        if(mode == 1)
+            c8e::break_toggle_pc(0xFFE);
+        if(mode == 2)
+            c8e::break_add_condition(c8e::BREAK_REG_SP, c8e::BREAK_GT, 8);
+
+        memset(&c8e::c8, 0, sizeof(c8e::c8));
+        load_program(WRITES_PROGRAM, sizeof(WRITES_PROGRAM)/sizeof(*WRITES_PROGRAM));
+        c8e::reset();
+        c8e::c8.ips = ips;
+        double start = get_time();
+        for(int f = 0; f < frames; f++)
+        {
+            c8e::run_frame();
+        }
+        fps[mode] = frames / (get_time() - start);
+    }
+
+    // Every stop on a write watch is followed by a logged write into the range, and nothing else
+    // writes there between stops.
+    int mismatches = 0;
+    int hits = 0;
+    memset(&c8e::breakpoints, 0, sizeof(c8e::breakpoints));
+    memset(&c8e::c8, 0, sizeof(c8e::c8));
+    load_program(WRITES_PROGRAM, sizeof(WRITES_PROGRAM)/sizeof(*WRITES_PROGRAM));
+    c8e::reset();
+    c8e::c8.ips = 60000;
+    c8e::write_log_init(&c8e::write_log);
+    c8e::debug_init(&c8e::debugger, c8e::DEBUG_DEFAULT_BUDGET);
+    c8e::break_add_watch(0x450, 0x45F, c8e::BREAK_WRITE);
+    uint64_t last_hit = 0;
+    static c8e::MemoryWrite writes[64];
+    while(hits < 500 && run_to_breakpoint(600))
+    {
+        uint64_t cycle = c8e::c8.cycle;
+        mismatches += c8e::breakpoints.hit.kind != c8e::BREAK_WATCH || c8e::breakpoints.hit.cycle != cycle;
+        int between = c8e::write_log_query(&c8e::write_log, 0x450, 0x45F, cycle, writes, 64);
+        if(hits == 0)
+            mismatches += between != 0;
+        else
+            mismatches += between == 0 || writes[0].cycle != last_hit;
+        last_hit = cycle;
+        hits++;
+    }
+
+    // Running back from a bit later lands on the newest write into the range.
+    for(int n = 0; n < 1000; n++)
+        c8e::debug_step();
+    c8e::write_log_query(&c8e::write_log, 0x450, 0x45F, c8e::c8.cycle, writes, 1);
+    double start = get_time();
+    bool back = c8e::debug_run_back(c8e::break_matches, 0);
+    double run_back_ms = (get_time() - start) * 1e3;
+    mismatches += !back || c8e::c8.cycle != writes[0].cycle;
+
+    printf("{\"benchmark\": \"breakpoints\", \"ips\": %lld, \"fps_unarmed\": %.0f, \"fps_pc_breakpoint\": %.0f, "
+           "\"fps_condition\": %.0f, \"watch_hits\": %d, \"ms_run_back\": %.2f, \"mismatches\": %d}\n",
+           ips, fps[0], fps[1], fps[2], hits, run_back_ms, mismatches);
+
+    c8e::debug_free(&c8e::debugger);
+    c8e::write_log_free(&c8e::write_log);
+    return mismatches || hits < 500 ? 1 : 0;
+}
+
+static const char* EXPR_TESTS[] =
+{
+    "v3 == 0x10 && mem[i+2] > 5",
+    "v0 + v1 * v2 - 7",
+    "(v0 + v1) * v2 % 13",
+    "-v4 / 3 + ~v5",
+    "v6 << 3 | v7 >> 1 ^ va & 0xF0",
+    "!vf || v8 <= v9 && vb != 0",
+    "mem[pc] * 256 + mem[pc + 1]",
+    "i >= 0x300 && dt < 20 || st > 10",
+    "key[vc] + key[vd & 3] * 2",
+    "cycle % 1000 + frame",
+    "vE / (v1 - v1) + vE % 0",
+    "sp - 1 - -2",
+};
+
+static int64_t expr_reference(int n)
+{
+    c8e::Chip8& c = c8e::c8;
+    switch(n)
+    {
+        case 0: return c.v[3] == 0x10 && c.memory[(c.i + 2) % c8e::MEMORY_SIZE] > 5;
+        case 1: return c.v[0] + c.v[1] * c.v[2] - 7;
+        case 2: return (c.v[0] + c.v[1]) * c.v[2] % 13;
+        case 3: return -c.v[4] / 3 + ~(int64_t)c.v[5];
+        case 4: return ((int64_t)c.v[6] << 3) | ((c.v[7] >> 1) ^ (c.v[0xA] & 0xF0));
+        case 5: return !c.v[0xF] || (c.v[8] <= c.v[9] && c.v[0xB] != 0);
+        case 6: return c.memory[c.pc] * 256 + c.memory[(c.pc + 1) % c8e::MEMORY_SIZE];
+        case 7: return (c.i >= 0x300 && c.vd < 20) || c.vs > 10;
+        case 8: return (c.keys[c.v[0xC] & 0xF] != 0) + (c.keys[c.v[0xD] & 3] != 0) * 2;
+        case 9: return (int64_t)(c.cycle % 1000 + c.frame);
+        case 10: return 0;
+        default: return c.sp - 1 + 2;
+    }
+}
+
+// Compiled expressions against the same thing written in C over random machine states, then
+// their speed alone and as breakpoint conditions.
+static int bench_expr()
+{
+    const int tests = sizeof(EXPR_TESTS)/sizeof(*EXPR_TESTS);
+    static c8e::Expr exprs[tests];
+    int mismatches = 0;
+    for(int t = 0; t < tests; t++)
+    {
+        if(!c8e::expr_compile(&exprs[t], EXPR_TESTS[t]))
+        {
+            fprintf(stderr, "ERROR: \"%s\" did not compile: %s\n", EXPR_TESTS[t], exprs[t].error);
+            mismatches++;
+        }
+    }
+    const char* bad[] = {"", "v3 ==", "(v1 + 2", "mem[3", "vg", "v1 $ 2", "99999999999"};
+    for(size_t b = 0; b < sizeof(bad)/sizeof(*bad); b++)
+    {
+        c8e::Expr expr;
+        mismatches += c8e::expr_compile(&expr, bad[b]) || c8e::expr_eval(&expr) != 0;
+    }
+
+    uint32_t rng = 0x2545F491;
+    for(int n = 0; n < 100000; n++)
+    {
+        for(int b = 0; b < 64; b++)
+        {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            if(b < 16) c8e::c8.v[b] = (uint8_t)rng;
+            else if(b < 32) c8e::c8.keys[b - 16] = rng & 1;
+            else c8e::c8.memory[rng % c8e::MEMORY_SIZE] = (uint8_t)(rng >> 16);
+        }
+        c8e::c8.i = rng % c8e::MEMORY_SIZE;
+        c8e::c8.pc = (rng >> 12) % (c8e::MEMORY_SIZE - 1);
+        c8e::c8.vd = (uint8_t)(rng >> 3);
+        c8e::c8.vs = (uint8_t)(rng >> 5);
+        c8e::c8.sp = (rng >> 7) & 15;
+        c8e::c8.cycle = rng;
+        c8e::c8.frame = rng >> 9;
+        for(int t = 0; t < tests; t++)
+        {
+            if(c8e::expr_eval(&exprs[t]) != expr_reference(t))
+            {
+                if(mismatches < 10)
+                    fprintf(stderr, "MISMATCH: \"%s\" gave %lld, expected %lld\n", EXPR_TESTS[t],
+                            (long long)c8e::expr_eval(&exprs[t]), (long long)expr_reference(t));
+                mismatches++;
+            }
+        }
+    }
+
+    const int evals = 10000000;
+    int64_t sink = 0;
+    double start = get_time();
+    for(int n = 0; n < evals; n++)
+    {
+        c8e::c8.v[3] = (uint8_t)n;
+        sink += c8e::expr_eval(&exprs[0]);
+    }
+    double eval_seconds = get_time() - start;
+
+    // An expression breakpoint that never fires, and a pc breakpoint whose condition rarely holds.
+    const int frames = 20*60;
+    double fps[3];
+    int stops = 0;
+    for(int mode = 0; mode < 3; mode++)
+    {
+        memset(&c8e::breakpoints, 0, sizeof(c8e::breakpoints));
+        memset(&c8e::debugger, 0, sizeof(c8e::debugger));
+        if(mode == 1)
+            c8e::break_add_expression("v3 == 0x10 && mem[i+2] > 5 && pc == 0xFFE");
+        if(mode == 2)
+            c8e::break_set_pc_condition(0x20C, "v0 > 250");
+        memset(&c8e::c8, 0, sizeof(c8e::c8));
+        load_program(WRITES_PROGRAM, sizeof(WRITES_PROGRAM)/sizeof(*WRITES_PROGRAM));
+        c8e::reset();
+        c8e::c8.ips = 600000;
+        start = get_time();
+        while(c8e::c8.frame < frames)
+        {
+            if(c8e::debugger.paused)
+            {
+                stops++;
+                mismatches += c8e::c8.pc != 0x20C || c8e::c8.v[0] <= 250;
+                c8e::debug_continue();
+            }
+            if(c8e::debugger.frame_ops_left > 0)
+                c8e::debug_finish_frame();
+            else
+                c8e::run_frame();
+        }
+        fps[mode] = frames / (get_time() - start);
+    }
+    memset(&c8e::breakpoints, 0, sizeof(c8e::breakpoints));
+
+    printf("{\"benchmark\": \"expr\", \"expressions\": %d, \"ns_per_eval\": %.2f, \"fps_unarmed\": %.0f, "
+           "\"fps_expression_breakpoint\": %.0f, \"fps_conditional_pc\": %.0f, \"conditional_stops\": %d, "
+           "\"mismatches\": %d, \"sink\": %lld}\n",
+           tests, eval_seconds * 1e9 / evals, fps[0], fps[1], fps[2], stops, mismatches, (long long)sink);
+    return mismatches || stops == 0 ? 1 : 0;
+}
+
+// A call, a skip, a jump table behind JP V0, and data that would decode as instructions.
+static const uint16_t DISASM_PROGRAM[] =
+{
+    0x6004, // 200: ld v0, 04
+    0x2220, // 202: call 220
+    0x3000, // 204: se v0, 00
+    0x1210, // 206: jp 210
+    0x7001, // 208: add v0, 01
+    0xB230, // 20A: jp v0, 230
+    0x1200, // 20C: never reached
+    0x0000, // 20E
+    0xA240, // 210: ld i, 240
+    0xD015, // 212: drw v0, v1, 5
+    0x1200, // 214: jp 200
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 216-21F
+    0x8104, // 220: add v1, v0
+    0x00EE, // 222: ret
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 224-22F
+    0x1200, // 230: jp 200
+    0x1210, // 232: jp 210
+    0x1220, // 234: jp 220
+    0x1208, // 236: jp 208
+    0x0000, 0x0000, 0x0000, 0x0000, // 238-23F
+    0x6A12, // 240: sprite data
+    0x7B22, // 242
+};
+
+static void disasm_check(bool ok, const char* what, int* mismatches)
+{
+    if(!ok)
+    {
+        fprintf(stderr, "MISMATCH: %s\n", what);
+        (*mismatches)++;
+    }
+}
+
+// Checks the analysis of DISASM_PROGRAM, that data writes leave the cache alone and code writes
+// re-walk it, and that nothing a ROM executes was missed; then times it all.
+static int bench_disasm(const char* rom_path)
+{
+    int mismatches = 0;
+    c8e::Disassembly* d = &c8e::disasm;
+
+    memset(&c8e::c8, 0, sizeof(c8e::c8));
+    load_program(DISASM_PROGRAM, sizeof(DISASM_PROGRAM)/sizeof(*DISASM_PROGRAM));
+    c8e::reset();
+    d->valid = false;
+    c8e::disasm_update();
+    const uint16_t code[] = {0x200, 0x202, 0x204, 0x206, 0x208, 0x20A, 0x210, 0x212, 0x214, 0x220, 0x222, 0x230, 0x232, 0x234, 0x236};
+    for(size_t n = 0; n < sizeof(code)/sizeof(*code); n++)
+        disasm_check(d->flags[code[n]] & c8e::DISASM_CODE, "an instruction was not decoded", &mismatches);
+    const uint16_t data[] = {0x20C, 0x216, 0x224, 0x238, 0x240, 0x242};
+    for(size_t n = 0; n < sizeof(data)/sizeof(*data); n++)
+        disasm_check(!(d->flags[data[n]] & c8e::DISASM_CODE), "data was decoded", &mismatches);
+    disasm_check(d->flags[0x220] & c8e::DISASM_CALL_TARGET, "sub_220 is not a call target", &mismatches);
+    disasm_check(d->table_count == 1 && d->tables[0].at == 0x20A && d->tables[0].base == 0x230 && d->tables[0].count == 4,
+                 "the jump table at 230 was not recovered", &mismatches);
+    const c8e::DisasmBlock* block = c8e::disasm_block_at(0x200);
+    disasm_check(block && block->end == 0x204 && block->next_count == 2 && block->next[0] == 0x220 && block->next[1] == 0x204,
+                 "block 200 should end at the call", &mismatches);
+    block = c8e::disasm_block_at(0x204);
+    disasm_check(block && block->next_count == 2 && block->next[0] == 0x206 && block->next[1] == 0x208,
+                 "block 204 should fork at the skip", &mismatches);
+    disasm_check(c8e::disasm_block_at(0x212) == c8e::disasm_block_at(0x210), "210-214 should be one block", &mismatches);
+
+    // Writes to data never re-walk; writes that change an instruction always do.
+    uint64_t walks = d->walks;
+    for(int f = 0; f < 600; f++)
+    {
+        c8e::c8.memory[0x240 + f % 4] = (uint8_t)f;
+        c8e::mark_memory_written((uint16_t)(0x240 + f % 4), 1);
+        c8e::disasm_update();
+    }
+    uint64_t data_walks = d->walks - walks;
+    walks = d->walks;
+    for(int f = 0; f < 600; f++)
+    {
+        c8e::c8.memory[0x201] = (uint8_t)(f + 5);
+        c8e::mark_memory_written(0x201, 1);
+        c8e::disasm_update();
+    }
+    uint64_t code_walks = d->walks - walks;
+    disasm_check(data_walks == 0, "a data write re-walked", &mismatches);
+    disasm_check(code_walks == 600, "a code write did not re-walk", &mismatches);
+
+    // A call to 203 then skips all the way up: every skip ends a block, on even and odd
+    // addresses alike, so there are more blocks than 2-byte words.
+    memset(&c8e::c8, 0, sizeof(c8e::c8));
+    memset(c8e::c8.rom, 0x33, sizeof(c8e::c8.rom));
+    c8e::c8.rom[0] = 0x22;
+    c8e::c8.rom[1] = 0x03;
+    c8e::reset();
+    d->valid = false;
+    c8e::disasm_update();
+    disasm_check(d->block_count > c8e::MEMORY_SIZE / 2 && d->block_count <= c8e::MEMORY_SIZE,
+                 "odd and even skip chains should both be split into blocks", &mismatches);
+    load_program(DISASM_PROGRAM, sizeof(DISASM_PROGRAM)/sizeof(*DISASM_PROGRAM));
+
+    // Run a ROM and count the instructions the analysis had not reached.
+    if(rom_path)
+        headless_initialize(rom_path);
+    else
+        c8e::reset();
+    d->valid = false;
+    c8e::disasm_update();
+    int initial_instructions = d->instruction_count;
+    uint64_t missed = 0;
+    uint64_t ran = 0;
+    for(int f = 0; f < 600; f++)
+    {
+        int ops = c8e::begin_frame();
+        for(int n = 0; n < ops; n++)
+        {
+            c8e::disasm_update();
+            if(!(d->flags[c8e::c8.pc] & c8e::DISASM_CODE))
+            {
+                missed++;
+                c8e::disasm_add_entry(c8e::c8.pc);
+            }
+            c8e::next_op();
+        }
+        c8e::end_frame(ops);
+        ran += ops;
+    }
+    c8e::Disassembly result = *d;
+
+    const int updates = 10000000;
+    double start = get_time();
+    for(int n = 0; n < updates; n++)
+        c8e::disasm_update();
+    double update_ns = (get_time() - start) * 1e9 / updates;
+    const int walk_count = 2000;
+    start = get_time();
+    for(int n = 0; n < walk_count; n++)
+    {
+        c8e::disasm_invalidate();
+        c8e::c8.memory[c8e::PROGRAM_OFFSET] ^= 0xFF; // changes the first instruction
+        c8e::disasm_update();
+    }
+    double walk_us = (get_time() - start) * 1e6 / walk_count;
+
+    // What the hook in mark_memory_written costs a program that writes a lot. The best of five
+    // runs each, alternating, since a single run is mostly noise.
+    double fps[2] = {0, 0};
+    for(int run = 0; run < 10; run++)
+    {
+        int valid = run & 1;
+        memset(&c8e::c8, 0, sizeof(c8e::c8));
+        load_program(WRITES_PROGRAM, sizeof(WRITES_PROGRAM)/sizeof(*WRITES_PROGRAM));
+        c8e::reset();
+        c8e::c8.ips = 600000;
+        d->valid = false;
+        if(valid)
+            c8e::disasm_update();
+        start = get_time();
+        for(int f = 0; f < 600; f++)
+            c8e::run_frame();
+        double run_fps = 600 / (get_time() - start);
+        if(run_fps > fps[valid])
+            fps[valid] = run_fps;
+    }
+
+    printf("{\"benchmark\": \"disasm\", \"instructions\": %d, \"after_running\": %d, \"blocks\": %d, "
+           "\"subroutines\": %d, \"jump_tables\": %d, \"rows\": %d, \"missed\": %llu, \"ran\": %llu, "
+           "\"us_per_walk\": %.2f, \"ns_per_clean_update\": %.2f, \"fps_writes\": %.0f, \"fps_writes_cached\": %.0f, "
+           "\"mismatches\": %d}\n",
+           initial_instructions, result.instruction_count, result.block_count, result.subroutine_count, result.table_count, result.row_count,
+           (unsigned long long)missed, (unsigned long long)ran, walk_us, update_ns, fps[0], fps[1], mismatches);
+    d->valid = false;
+    return mismatches ? 1 : 0;
+}
+
+// Runs WRITES_PROGRAM at a high ips, comparing memory once a frame like the open viewer does,
+// and checks the changed bytes against a plain byte loop.
+static int bench_memview()
+{
+    const int frames = 60*60;
+    memset(&c8e::c8, 0, sizeof(c8e::c8));
+    load_program(WRITES_PROGRAM, sizeof(WRITES_PROGRAM)/sizeof(*WRITES_PROGRAM));
+    c8e::reset();
+    c8e::c8.ips = 600000;
+    c8e::memview_reset();
+
+    static uint8_t previous[c8e::MEMORY_SIZE];
+    memcpy(previous, c8e::c8.memory, sizeof(previous));
+    int mismatches = 0;
+    uint64_t changed = 0;
+    double compare_seconds = 0;
+    for(int f = 0; f < frames; f++)
+    {
+        c8e::run_frame();
+        double start = get_time();
+        int count = c8e::memview_compare();
+        compare_seconds += get_time() - start;
+        changed += count;
+
+        int expected = 0;
+        for(int a = 0; a < c8e::MEMORY_SIZE; a++)
+        {
+            bool differs = previous[a] != c8e::c8.memory[a];
+            expected += differs;
+            if(differs != (c8e::memview.changed_frame[a] == c8e::c8.frame))
+                mismatches++;
+        }
+        mismatches += count != expected;
+        memcpy(previous, c8e::c8.memory, sizeof(previous));
+    }
+
+    // Going back in time starts over.
+    c8e::reset();
+    mismatches += c8e::memview_compare() != 0 || c8e::memview.changed_frame[0x400] != UINT64_MAX;
+
+    printf("{\"benchmark\": \"memview\", \"frames\": %d, \"bytes_changed_per_frame\": %.1f, "
+           "\"us_per_compare\": %.3f, \"mismatches\": %d}\n",
+           frames, (double)changed / frames, compare_seconds * 1e6 / frames, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// Counts up at 3A0 once a frame (at 720 ips) while scattering random bytes over 0x400-0x5FF.
+static const uint16_t COUNTER_PROGRAM[] =
+{
+    0xA3A0, // 200: ld i, 3A0
+    0xF065, // 202: ld v0, [i]
+    0x7001, // 204: add v0, 01
+    0xF055, // 206: ld [i], v0
+    0xA400, // 208: ld i, 400
+    0xC1FF, // 20A: rnd v1, 0xFF
+    0xF11E, // 20C: add i, v1
+    0xC1FF, // 20E: rnd v1, 0xFF
+    0xF11E, // 210: add i, v1
+    0xC0FF, // 212: rnd v0, 0xFF
+    0xF055, // 214: ld [i], v0
+    0x1200, // 216: jp 200
+};
+
+// The vector filter against the plain one on random memory, then finding COUNTER_PROGRAM's
+// counter in one instance and across a batch run with different seeds, and timing filters.
+static int bench_search()
+{
+    const int max_instances = 8;
+    static uint8_t memories[max_instances][c8e::MEMORY_SIZE];
+    const uint8_t* pointers[max_instances];
+    for(int k = 0; k < max_instances; k++)
+        pointers[k] = memories[k];
+    static c8e::MemorySearch vector_search;
+    static c8e::MemorySearch scalar_search;
+    scalar_search.scalar = true;
+
+    // Mostly small changes, so every condition keeps a few candidates for a while.
+    uint32_t rng = 0x2545F491;
+    int mismatches = 0;
+    for(int round = 0; round < 200; round++)
+    {
+        int instances = 1 + round % max_instances;
+        for(int k = 0; k < instances; k++)
+        {
+            for(int a = 0; a < c8e::MEMORY_SIZE; a++)
+            {
+                rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+                memories[k][a] = (uint8_t)(rng & 3);
+            }
+        }
+        c8e::search_begin(&vector_search, pointers, instances);
+        c8e::search_begin(&scalar_search, pointers, instances);
+        for(int filter = 0; filter < 6; filter++)
+        {
+            for(int k = 0; k < instances; k++)
+            {
+                for(int a = 0; a < c8e::MEMORY_SIZE; a++)
+                {
+                    rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+                    memories[k][a] = (uint8_t)(memories[k][a] + (rng & 3) - 1);
+                }
+            }
+            c8e::SearchCondition condition = (c8e::SearchCondition)((round + filter) % c8e::SEARCH_CONDITION_COUNT);
+            uint8_t value = (uint8_t)(rng >> 24) & 3;
+            int vector_count = c8e::search_filter(&vector_search, pointers, condition, value);
+            int scalar_count = c8e::search_filter(&scalar_search, pointers, condition, value);
+            mismatches += vector_count != scalar_count ||
+                          memcmp(vector_search.candidates, scalar_search.candidates, c8e::MEMORY_SIZE) != 0;
+        }
+    }
+
+    // One machine, then a batch: the counter goes up every frame, a noise byte only sometimes.
+    int found[2] = {-1, -1};
+    int filters[2] = {0, 0};
+    static c8e::Snapshot states[max_instances];
+    for(int batch = 0; batch < 2; batch++)
+    {
+        int instances = batch ? max_instances : 1;
+        for(int k = 0; k < instances; k++)
+        {
+            memset(&c8e::c8, 0, sizeof(c8e::c8));
+            load_program(COUNTER_PROGRAM, sizeof(COUNTER_PROGRAM)/sizeof(*COUNTER_PROGRAM));
+            c8e::c8.seed = 1000 + k;
+            c8e::reset();
+            c8e::c8.ips = 720;
+            c8e::save_snapshot(&states[k]);
+            pointers[k] = states[k].memory;
+        }
+        c8e::search_begin(&vector_search, pointers, instances);
+        while(vector_search.result_count > 1 && filters[batch] < 50)
+        {
+            for(int k = 0; k < instances; k++)
+            {
+                c8e::load_snapshot(&states[k]);
+                c8e::run_frame();
+                c8e::save_snapshot(&states[k]);
+            }
+            c8e::search_filter(&vector_search, pointers, c8e::SEARCH_INCREASED, 0);
+            filters[batch]++;
+        }
+        found[batch] = vector_search.result_count == 1 ? vector_search.results[0] : -1;
+        mismatches += found[batch] != 0x3A0;
+    }
+
+    // Timing: a fresh search's first filter is the worst case, every chunk still has candidates.
+    double ns[2][2];
+    for(int scalar = 0; scalar < 2; scalar++)
+    {
+        for(int batch = 0; batch < 2; batch++)
+        {
+            c8e::MemorySearch* search = scalar ? &scalar_search : &vector_search;
+            int instances = batch ? max_instances : 1;
+            for(int k = 0; k < instances; k++)
+                pointers[k] = memories[k];
+            const int runs = 2000;
+            double total = 0;
+            for(int n = 0; n < runs; n++)
+            {
+                c8e::search_begin(search, pointers, instances);
+                double start = get_time();
+                c8e::search_filter(search, pointers, c8e::SEARCH_UNCHANGED, 0);
+                total += get_time() - start;
+            }
+            ns[scalar][batch] = total * 1e9 / runs;
+        }
+    }
+    c8e::search_free(&vector_search);
+    c8e::search_free(&scalar_search);
+
+    printf("{\"benchmark\": \"search\", \"found\": \"%03X\", \"filters\": %d, \"found_batch\": \"%03X\", \"filters_batch\": %d, "
+           "\"us_per_filter\": %.2f, \"us_per_filter_batch\": %.2f, \"us_per_filter_scalar\": %.2f, "
+           "\"us_per_filter_scalar_batch\": %.2f, \"mismatches\": %d}\n",
+           found[0] & 0xFFF, filters[0], found[1] & 0xFFF, filters[1], ns[0][0] / 1000, ns[0][1] / 1000, ns[1][0] / 1000, ns[1][1] / 1000, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// Random key presses, each held for a few frames. Called once a frame.
+static void random_keys(uint32_t* r, int* hold)
+{
+    if((*hold)-- <= 0)
+    {
+        *r ^= *r << 13;
+        *r ^= *r >> 17;
+        *r ^= *r << 5;
+        memset(c8e::c8.keys, 0, sizeof(c8e::c8.keys));
+        if(*r & 0x100)
+        {
+            c8e::c8.keys[*r & 0xF] = 1;
+        }
+        *hold = (*r >> 4) & 0xF;
+    }
+}
+
+// Records a movie of random key presses.
+static int record_random_movie(const char* rom_path, const char* movie_path, int frames, uint32_t input_seed)
+{
+    headless_initialize(rom_path);
+
+    c8e::Movie* movie = &c8e::movie_state;
+    if(!c8e::movie_record_start(movie, false, 60))
+    {
+        fprintf(stderr, "ERROR: Could not start recording.\n");
+        return 1;
+    }
+
+    uint32_t r = input_seed ? input_seed : 1;
+    int hold = 0;
+    for(int f = 0; f < frames; f++)
+    {
+        random_keys(&r, &hold);
+        c8e::movie_run_frame(movie);
+    }
+    c8e::movie_record_stop(movie);
+
+    plat::FilePath path = {strlen(movie_path), (char*)movie_path};
+    bool written = plat::write_entire_file(path, movie->data, movie->size);
+    printf("{\"command\": \"record\", \"frames\": %d, \"bytes\": %zu, \"written\": %s}\n",
+           frames, movie->size, written ? "true" : "false");
+    c8e::movie_free(movie);
+    return written ? 0 : 1;
+}
+
+// Plays a movie back uncapped and reports speed and whether it stayed in sync.
+static int replay_movie(const char* rom_path, const char* movie_path)
+{
+    headless_initialize(rom_path);
+
+    plat::FilePath path = {strlen(movie_path), (char*)movie_path};
+    plat::FileContents contents = plat::load_entire_file(path);
+    c8e::Movie* movie = &c8e::movie_state;
+    if(!contents.data || !c8e::movie_play_start(movie, contents.data, contents.len))
+    {
+        fprintf(stderr, "ERROR: Could not play %s against this ROM: %s.\n", movie_path,
+                contents.data ? movie->error : "could not read the file");
+        plat::unload_file(contents);
+        return 1;
+    }
+
+    long long ops = 0;
+    double start = get_time();
+    while(movie->mode == c8e::MOVIE_PLAYING)
+    {
+        ops += c8e::movie_run_frame(movie);
+    }
+    double seconds = get_time() - start;
+
+    printf("{\"command\": \"replay\", \"frames\": %llu, \"instructions\": %lld, \"seconds\": %.6f, "
+           "\"fps\": %.0f, \"ips\": %.0f, \"desynced\": %s, \"desync_frame\": %llu, \"corrupt\": %s, "
+           "\"display_hash\": \"%016llx\", \"state_hash\": \"%016llx\"}\n",
+           (unsigned long long)movie->frame, ops, seconds, movie->frame / seconds, ops / seconds,
+           movie->desynced ? "true" : "false", (unsigned long long)movie->desync_frame, movie->corrupt ? "true" : "false",
+           (unsigned long long)c8e::hash_display(), (unsigned long long)c8e::hash_state());
+
+    bool desynced = movie->desynced || movie->corrupt;
+    c8e::movie_free(movie);
+    plat::unload_file(contents);
+    return desynced ? 2 : 0;
+}
+
+// Per-frame cost of the cached hashes against hashing the same bytes from scratch.
+static int bench_hash(const char* rom_path)
+{
+    const int frames = 100000;
+
+    headless_initialize(rom_path);
+    double hash_seconds = 0.0;
+    uint64_t sink = 0;
+    for(int f = 0; f < frames; f++)
+    {
+        c8e::run_frame();
+        double start = get_time();
+        sink ^= c8e::hash_state();
+        hash_seconds += get_time() - start;
+    }
+
+    headless_initialize(rom_path);
+    double full_seconds = 0.0;
+    for(int f = 0; f < frames; f++)
+    {
+        c8e::run_frame();
+        double start = get_time();
+        sink ^= c8e::hash64(c8e::c8.memory, sizeof(c8e::c8.memory), 0);
+        sink ^= c8e::hash64(c8e::c8.display, sizeof(c8e::c8.display), 0);
+        full_seconds += get_time() - start;
+    }
+
+    printf("{\"benchmark\": \"hash\", \"frames\": %d, \"ns_per_cached_state_hash\": %.1f, "
+           "\"ns_per_full_hash\": %.1f, \"sink\": \"%016llx\"}\n",
+           frames, hash_seconds * 1e9 / frames, full_seconds * 1e9 / frames, (unsigned long long)sink);
+    return 0;
+}
+
+// Synthetic instruction mixes for the benchmark suite. Each one loops forever.
+static const uint16_t ALU_PROGRAM[] =
+{
+    0x6001, // 200: ld v0, 1
+    0x6103, // 202: ld v1, 3
+    0x8014, // 204: add v0, v1
+    0x8102, // 206: and v1, v0
+    0x8203, // 208: xor v2, v0
+    0x7305, // 20A: add v3, 5
+    0x8431, // 20C: or v4, v3
+    0x8015, // 20E: sub v0, v1
+    0x8506, // 210: shr v5
+    0x8537, // 212: subn v5, v3
+    0x860E, // 214: shl v6
+    0x1204, // 216: jp 204
+};
+
+static const uint16_t BRANCH_PROGRAM[] =
+{
+    0x7001, // 200: add v0, 1
+    0x3000, // 202: se v0, 0
+    0x7101, // 204: add v1, 1
+    0x4180, // 206: sne v1, 0x80
+    0x6100, // 208: ld v1, 0
+    0x5010, // 20A: se v0, v1
+    0x7201, // 20C: add v2, 1
+    0x9020, // 20E: sne v0, v2
+    0x6200, // 210: ld v2, 0
+    0x2216, // 212: call 216
+    0x1200, // 214: jp 200
+    0x00EE, // 216: ret
+};
+
+static const uint16_t DRAW_PROGRAM[] =
+{
+    0xA050, // 200: ld i, font
+    0xC03F, // 202: rnd v0, 0x3F
+    0xC11F, // 204: rnd v1, 0x1F
+    0xD015, // 206: drw v0, v1, 5
+    0xD01F, // 208: drw v0, v1, 15
+    0x1202, // 20A: jp 202
+};
+
+static const uint16_t MEMORY_PROGRAM[] =
+{
+    0xA300, // 200: ld i, 300
+    0x7013, // 202: add v0, 0x13
+    0xF01E, // 204: add i, v0
+    0xF033, // 206: ld b, v0
+    0xF355, // 208: ld [i], v3
+    0xF365, // 20A: ld v3, [i]
+    0x1200, // 20C: jp 200
+};
+
+// Hardware counters read around each benchmark with perf_event_open. Each event is opened on
+// its own so the kernel can multiplex them; values are scaled by time enabled / time running.
+enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_EVENT_COUNT,
+};
+
+static const char* PERF_EVENT_NAMES[PERF_EVENT_COUNT] =
+{
+    "cycles",
+    "instructions",
+    "branch_misses",
+    "l1d_misses",
+    "llc_misses",
+};
+
+static int g_perf_fds[PERF_EVENT_COUNT];
+static bool g_perf_enabled = true;
+
+static void perf_open()
+{
+    for(int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+        g_perf_fds[e] = -1;
+    }
+#ifdef __linux__
+    if(!g_perf_enabled)
+        return;
+
+    for(int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        switch(e)
+        {
+            case PERF_CYCLES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case PERF_INSTRUCTIONS:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case PERF_BRANCH_MISSES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+                break;
+            case PERF_L1D_MISSES:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            case PERF_LLC_MISSES:
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+        }
+        g_perf_fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+#endif
+}
+
+static void perf_begin()
+{
+#ifdef __linux__
+    for(int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+        if(g_perf_fds[e] >= 0)
+        {
+            ioctl(g_perf_fds[e], PERF_EVENT_IOC_RESET, 0);
+            ioctl(g_perf_fds[e], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+// Returns a bitmask of the events that could be read into values.
+static int perf_end(uint64_t* values)
+{
+    int valid = 0;
+#ifdef __linux__
+    for(int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+        if(g_perf_fds[e] >= 0)
+        {
+            ioctl(g_perf_fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for(int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+        uint64_t data[3]; // value, time enabled, time running
+        if(g_perf_fds[e] < 0 || read(g_perf_fds[e], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            continue;
+        values[e] = (uint64_t)((double)data[0] * data[1] / data[2]);
+        valid |= 1 << e;
+    }
+#endif
+    return valid;
+}
+
+static void perf_close()
+{
+#ifdef __linux__
+    for(int e = 0; e < PERF_EVENT_COUNT; e++)
+    {
+        if(g_perf_fds[e] >= 0)
+        {
+            close(g_perf_fds[e]);
+            g_perf_fds[e] = -1;
+        }
+    }
+#endif
+}
+
+struct BenchResult
+{
+    const char* name;
+    long long instructions;
+    long long frames;
+    double seconds;
+
+    int perf_valid; // bitmask of PerfEvent
+    uint64_t perf[PERF_EVENT_COUNT];
+};
+
+static void print_result(const BenchResult* result, bool last)
+{
+    printf("        {\"name\": \"%s\", \"instructions\": %lld, \"frames\": %lld, \"seconds\": %.6f, "
+           "\"ips\": %.0f, \"ns_per_op\": %.3f, \"fps\": %.1f, \"perf\": ",
+           result->name, result->instructions, result->frames, result->seconds,
+           result->instructions / result->seconds,
+           result->instructions ? result->seconds * 1e9 / result->instructions : 0.0,
+           result->frames / result->seconds);
+
+    if(!result->perf_valid)
+    {
+        printf("null");
+    }
+    else
+    {
+        // Totals, then the same normalized per guest instruction.
+        printf("{");
+        for(int e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            if(result->perf_valid & (1 << e))
+                printf("\"%s\": %llu, ", PERF_EVENT_NAMES[e], (unsigned long long)result->perf[e]);
+        }
+        if((result->perf_valid & (1 << PERF_CYCLES)) && (result->perf_valid & (1 << PERF_INSTRUCTIONS)) && result->perf[PERF_CYCLES])
+        {
+            printf("\"ipc\": %.3f, ", (double)result->perf[PERF_INSTRUCTIONS] / result->perf[PERF_CYCLES]);
+        }
+        printf("\"per_guest_op\": {");
+        bool first = true;
+        for(int e = 0; e < PERF_EVENT_COUNT; e++)
+        {
+            if(!(result->perf_valid & (1 << e)))
+                continue;
+            printf("%s\"%s\": %.4f", first ? "" : ", ", PERF_EVENT_NAMES[e],
+                   result->instructions ? (double)result->perf[e] / result->instructions : 0.0);
+            first = false;
+        }
+        printf("}}");
+    }
+    printf("}%s\n", last ? "" : ",");
+}
+
+static BenchResult bench_program(const char* name, const uint16_t* ops, int count, long long instructions)
+{
+    memset(&c8e::c8, 0, sizeof(c8e::c8));
+    load_program(ops, count);
+    c8e::reset();
+    c8e::c8.loaded = true;
+
+    BenchResult result = {name, instructions, 0};
+    perf_begin();
+    double start = get_time();
+    for(long long n = 0; n < instructions; n++)
+    {
+        c8e::next_op();
+    }
+    result.seconds = get_time() - start;
+    result.perf_valid = perf_end(result.perf);
+    return result;
+}
+
+// Decode and dispatch only, no fetch: feeds execute_op a fixed stream of register ops.
+static BenchResult bench_execute_op(long long instructions)
+{
+    headless_initialize(0);
+
+    uint16_t ops[256];
+    uint32_t r = 12345;
+    static const uint16_t alu[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+    for(int n = 0; n < 256; n++)
+    {
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+        switch(r % 3)
+        {
+            case 0: ops[n] = 0x6000 | (r & 0xFFF); break;
+            case 1: ops[n] = 0x7000 | (r & 0xFFF); break;
+            case 2: ops[n] = 0x8000 | ((r >> 8) & 0xFF0) | alu[(r >> 4) % 9]; break;
+        }
+    }
+
+    BenchResult result = {"execute_op_alu", instructions, 0};
+    perf_begin();
+    double start = get_time();
+    for(long long n = 0; n < instructions; n++)
+    {
+        c8e::execute_op(ops[n & 255]);
+    }
+    result.seconds = get_time() - start;
+    result.perf_valid = perf_end(result.perf);
+    return result;
+}
+
+// Runs a ROM frame by frame as fast as possible, driven by a movie if one is given.
+static bool bench_rom(const char* rom_path, const char* movie_path, long long frames, BenchResult* result)
+{
+    headless_initialize(rom_path);
+
+    const char* name = strrchr(rom_path, '/');
+    result->name = name ? name + 1 : rom_path;
+    result->instructions = 0;
+    result->frames = 0;
+    result->perf_valid = 0;
+
+    plat::FileContents contents = {0};
+    c8e::Movie* movie = &c8e::movie_state;
+    if(movie_path)
+    {
+        plat::FilePath path = {strlen(movie_path), (char*)movie_path};
+        contents = plat::load_entire_file(path);
+        if(!contents.data || !c8e::movie_play_start(movie, contents.data, contents.len))
+        {
+            fprintf(stderr, "ERROR: Could not play %s against %s: %s.\n", movie_path, rom_path,
+                    contents.data ? movie->error : "could not read the file");
+            plat::unload_file(contents);
+            return false;
+        }
+    }
+
+    perf_begin();
+    double start = get_time();
+    if(movie_path)
+    {
+        while(movie->mode == c8e::MOVIE_PLAYING)
+        {
+            result->instructions += c8e::movie_run_frame(movie);
+            result->frames++;
+        }
+    }
+    else
+    {
+        for(long long f = 0; f < frames; f++)
+        {
+            result->instructions += c8e::run_frame();
+        }
+        result->frames = frames;
+    }
+    result->seconds = get_time() - start;
+    result->perf_valid = perf_end(result->perf);
+
+    if(movie_path)
+    {
+        if(movie->desynced)
+        {
+            fprintf(stderr, "WARNING: %s desynced at frame %llu.\n", movie_path, (unsigned long long)movie->desync_frame);
+        }
+        if(movie->corrupt)
+        {
+            fprintf(stderr, "WARNING: %s is corrupt, it stopped at frame %llu.\n", movie_path, (unsigned long long)movie->frame);
+        }
+        c8e::movie_free(movie);
+        plat::unload_file(contents);
+    }
+    return true;
+}
+
+// The benchmark suite: synthetic instruction mixes, then each ROM given as rom.ch8 or rom.ch8:movie.c8m.
+static int bench_suite(int argc, char** argv)
+{
+    long long instructions = 20000000;
+    long long frames = 60*60*10;
+
+    BenchResult results[64];
+    int count = 0;
+
+    int arg = 0;
+    for(; arg < argc; arg++)
+    {
+        if(strcmp(argv[arg], "--instructions") == 0 && arg + 1 < argc)
+            instructions = atoll(argv[++arg]);
+        else if(strcmp(argv[arg], "--frames") == 0 && arg + 1 < argc)
+            frames = atoll(argv[++arg]);
+        else if(strcmp(argv[arg], "--no-perf") == 0)
+            g_perf_enabled = false;
+        else
+            break;
+    }
+
+    perf_open();
+
+    results[count++] = bench_execute_op(instructions);
+    results[count++] = bench_program("mix_alu", ALU_PROGRAM, sizeof(ALU_PROGRAM)/sizeof(*ALU_PROGRAM), instructions);
+    results[count++] = bench_program("mix_branch", BRANCH_PROGRAM, sizeof(BRANCH_PROGRAM)/sizeof(*BRANCH_PROGRAM), instructions);
+    results[count++] = bench_program("mix_draw", DRAW_PROGRAM, sizeof(DRAW_PROGRAM)/sizeof(*DRAW_PROGRAM), instructions);
+    results[count++] = bench_program("mix_memory", MEMORY_PROGRAM, sizeof(MEMORY_PROGRAM)/sizeof(*MEMORY_PROGRAM), instructions);
+
+    for(; arg < argc && count < 64; arg++)
+    {
+        // rom.ch8:movie.c8m
+        static char paths[64][1024];
+        char* rom_path = paths[count];
+        snprintf(rom_path, sizeof(paths[count]), "%s", argv[arg]);
+        char* movie_path = strchr(rom_path, ':');
+        if(movie_path)
+        {
+            *movie_path++ = 0;
+        }
+        if(bench_rom(rom_path, movie_path, frames, &results[count]))
+        {
+            count++;
+        }
+    }
+
+    printf("{\n    \"suite\": \"chip8emu\",\n    \"results\": [\n");
+    for(int n = 0; n < count; n++)
+    {
+        print_result(&results[n], n == count - 1);
+    }
+    printf("    ]\n}\n");
+    perf_close();
+    return 0;
+}
+
+// Runs a ROM (or one of the synthetic mixes when no ROM is given) and prints the op counters.
+static int op_stats(const char* rom_path, const char* movie_path, long long frames)
+{
+#ifdef USE_OP_COUNTERS
+    BenchResult result;
+    if(rom_path)
+    {
+        c8e::reset_op_counters();
+        if(!bench_rom(rom_path, movie_path, frames, &result))
+            return 1;
+    }
+    else
+    {
+        c8e::reset_op_counters();
+        result = bench_program("default", DEFAULT_PROGRAM, sizeof(DEFAULT_PROGRAM)/sizeof(*DEFAULT_PROGRAM), frames * 10);
+    }
+
+    static c8e::OpClassStats stats[c8e::OP_CLASS_COUNT];
+    int ran = c8e::get_op_class_stats(stats);
+
+    printf("{\n    \"name\": \"%s\",\n    \"instructions\": %lld,\n    \"seconds\": %.6f,\n    \"timer_overhead_ticks\": %.1f,\n    \"classes\": [\n",
+           result.name, result.instructions, result.seconds, c8e::op_counters.overhead_ticks);
+    for(int n = 0; n < ran; n++)
+    {
+        printf("        {\"class\": \"%s\", \"count\": %llu, \"share\": %.4f, \"est_seconds\": %.6f, \"timed\": %llu, \"ticks_log2_histogram\": [",
+               c8e::OP_CLASS_NAMES[stats[n].op_class], (unsigned long long)stats[n].count,
+               result.instructions ? (double)stats[n].count / result.instructions : 0.0,
+               stats[n].seconds, (unsigned long long)c8e::op_counters.samples[stats[n].op_class]);
+        for(int b = 0; b < c8e::OP_HISTOGRAM_BUCKETS; b++)
+            printf("%u%s", c8e::op_counters.histogram[stats[n].op_class][b], b == c8e::OP_HISTOGRAM_BUCKETS - 1 ? "" : ", ");
+        printf("]}%s\n", n == ran - 1 ? "" : ",");
+    }
+    printf("    ],\n    \"hot_pcs\": [\n");
+
+    uint16_t pcs[32];
+    int hot = c8e::get_hot_pcs(pcs, 32);
+    for(int n = 0; n < hot; n++)
+    {
+        printf("        {\"pc\": %d, \"count\": %llu}%s\n", pcs[n],
+               (unsigned long long)c8e::op_counters.pc_count[pcs[n]], n == hot - 1 ? "" : ",");
+    }
+    printf("    ]\n}\n");
+    return 0;
+#else
+    fprintf(stderr, "ERROR: Build with EXTRA_FLAGS=-DUSE_OP_COUNTERS to use op-stats.\n");
+    return 1;
+#endif
+}
+
+static void sample_signal_handler(int signal)
+{
+    c8e::sample_guest_from_timer();
+}
+
+// Runs a ROM under the guest sampling profiler, driven by SIGPROF at 10 kHz of CPU time.
+static int profile_rom(const char* rom_path, const char* movie_path, long long frames)
+{
+    c8e::reset_sampler();
+    c8e::sampler.enabled.store(true);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sample_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, 0);
+    struct itimerval interval = {{0, 100}, {0, 100}};
+    setitimer(ITIMER_PROF, &interval, 0);
+
+    BenchResult result;
+    bool ran;
+    if(rom_path)
+    {
+        ran = bench_rom(rom_path, movie_path, frames, &result);
+    }
+    else
+    {
+        // No ROM: the default program at a high ips so frames are long enough to sample.
+        headless_initialize(0);
+        c8e::c8.ips = 6000000;
+        result.name = "default";
+        result.instructions = 0;
+        result.frames = frames / 100;
+        double start = get_time();
+        for(long long f = 0; f < result.frames; f++)
+        {
+            result.instructions += c8e::run_frame();
+        }
+        result.seconds = get_time() - start;
+        ran = true;
+    }
+
+    struct itimerval off = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_PROF, &off, 0);
+    if(!ran)
+        return 1;
+
+    printf("{\n    \"name\": \"%s\",\n    \"instructions\": %lld,\n    \"seconds\": %.6f,\n    \"samples\": %u,\n    \"hot\": [\n",
+           result.name, result.instructions, result.seconds, c8e::sampler.total.load());
+    uint16_t addresses[32];
+    int hot = c8e::get_hot_samples(addresses, 32);
+    for(int n = 0; n < hot; n++)
+    {
+        uint16_t a = addresses[n];
+        char text[32];
+        c8e::disassemble((c8e::c8.memory[a] << 8) | c8e::c8.memory[(a + 1) % c8e::MEMORY_SIZE], text, sizeof(text));
+        printf("        {\"pc\": %d, \"samples\": %u, \"share\": %.4f, \"disassembly\": \"%s\"}%s\n",
+               a, c8e::sampler.pc_samples[a].load(), (double)c8e::sampler.pc_samples[a] / c8e::sampler.total, text,
+               n == hot - 1 ? "" : ",");
+    }
+    printf("    ]\n}\n");
+    return 0;
+}
+
+// Runs frames the way the emulation thread does and prints the perf stats summary. Paced to
+// 60 Hz unless uncapped; there is no presenter, so present metrics and drops stay empty.
+static int perf_stats_command(int argc, char** argv)
+{
+    long long frames = 240;
+    bool uncapped = false;
+    const char* rom_path = 0;
+    static char rom_arg[1024];
+    char* movie_path = 0;
+    for(int n = 0; n < argc; n++)
+    {
+        if(strcmp(argv[n], "--frames") == 0 && n + 1 < argc)
+            frames = atoll(argv[++n]);
+        else if(strcmp(argv[n], "--uncapped") == 0)
+            uncapped = true;
+        else
+        {
+            snprintf(rom_arg, sizeof(rom_arg), "%s", argv[n]);
+            movie_path = strchr(rom_arg, ':');
+            if(movie_path)
+                *movie_path++ = 0;
+            rom_path = rom_arg;
+        }
+    }
+
+    headless_initialize(rom_path);
+    plat::FileContents contents = {0};
+    c8e::Movie* movie = &c8e::movie_state;
+    if(movie_path)
+    {
+        plat::FilePath path = {strlen(movie_path), movie_path};
+        contents = plat::load_entire_file(path);
+        if(!contents.data || !c8e::movie_play_start(movie, contents.data, contents.len))
+        {
+            fprintf(stderr, "ERROR: Could not play %s against %s: %s.\n", movie_path, rom_path,
+                    contents.data ? movie->error : "could not read the file");
+            plat::unload_file(contents);
+            return 1;
+        }
+    }
+
+    c8e::perf_reset();
+    uint64_t frame_ticks = plat::get_ticks_per_second() / 60;
+    uint64_t next_frame = plat::get_ticks();
+    for(long long f = 0; f < frames; f++)
+    {
+        if(movie_path && movie->mode != c8e::MOVIE_PLAYING)
+            break;
+        uint64_t start = plat::get_ticks();
+        int ops = movie_path ? c8e::movie_run_frame(movie) : c8e::run_frame();
+        c8e::perf_emu_frame(ops, start, plat::get_ticks(), 0);
+
+        if(!uncapped)
+        {
+            next_frame += frame_ticks;
+            uint64_t now = plat::get_ticks();
+            if(next_frame > now)
+            {
+                uint64_t wait = (next_frame - now) * 1000000000ull / plat::get_ticks_per_second();
+                struct timespec duration = {(time_t)(wait / 1000000000ull), (long)(wait % 1000000000ull)};
+                nanosleep(&duration, 0);
+            }
+        }
+    }
+    c8e::movie_free(movie);
+    plat::unload_file(contents);
+
+    c8e::PerfSummary summary;
+    c8e::get_perf_summary(&summary);
+    printf("{\n");
+    for(int m = 0; m < c8e::PERF_METRIC_COUNT; m++)
+    {
+        if(summary.count[m])
+            printf("    \"%s\": {\"count\": %d, \"mean\": %.4f, \"min\": %.4f, \"max\": %.4f},\n",
+                   c8e::PERF_METRIC_NAMES[m], summary.count[m], summary.mean[m], summary.min[m], summary.max[m]);
+        else
+            printf("    \"%s\": null,\n", c8e::PERF_METRIC_NAMES[m]);
+    }
+    printf("    \"dropped\": %llu,\n    \"duplicated\": %llu\n}\n", (unsigned long long)summary.dropped, (unsigned long long)summary.duplicated);
+    return 0;
+}
+
+// Records an instruction trace of a ROM run uncapped, with the untraced speed for comparison.
+static int record_trace(const char* out_path, const char* rom_path, const char* movie_path, long long frames)
+{
+    BenchResult untraced;
+    BenchResult traced;
+    if(!rom_path)
+    {
+        // The default program at a high ips, so frames outgrow the ring.
+        headless_initialize(0);
+        c8e::c8.ips = 600000;
+        untraced.name = traced.name = "default";
+        untraced.instructions = traced.instructions = 0;
+        untraced.frames = traced.frames = frames;
+
+        double start = get_time();
+        for(long long f = 0; f < frames; f++)
+            untraced.instructions += c8e::run_frame();
+        untraced.seconds = get_time() - start;
+
+        headless_initialize(0);
+        c8e::c8.ips = 600000;
+        plat::FilePath path = {strlen(out_path), (char*)out_path};
+        if(!c8e::trace_start(path))
+        {
+            fprintf(stderr, "ERROR: Could not write %s.\n", out_path);
+            return 1;
+        }
+        start = get_time();
+        for(long long f = 0; f < frames; f++)
+            traced.instructions += c8e::run_frame();
+        c8e::trace_stop();
+        traced.seconds = get_time() - start;
+    }
+    else
+    {
+        if(!bench_rom(rom_path, movie_path, frames, &untraced))
+            return 1;
+
+        // bench_rom resets the machine first, so start tracing from its first instruction.
+        headless_initialize(rom_path);
+        plat::FilePath path = {strlen(out_path), (char*)out_path};
+        if(!c8e::trace_start(path))
+        {
+            fprintf(stderr, "ERROR: Could not write %s.\n", out_path);
+            return 1;
+        }
+        bool ran = bench_rom(rom_path, movie_path, frames, &traced);
+        c8e::trace_stop();
+        if(!ran)
+            return 1;
+    }
+
+    if(c8e::tracer.failed)
+    {
+        fprintf(stderr, "ERROR: Writing %s failed%s.\n", out_path, c8e::tracer.out_of_memory ? " (out of memory)" : "");
+        return 1;
+    }
+    printf("{\n    \"name\": \"%s\",\n    \"instructions\": %llu,\n    \"bytes\": %llu,\n    \"bytes_per_instruction\": %.3f,\n"
+           "    \"untraced_ips\": %.0f,\n    \"traced_ips\": %.0f\n}\n",
+           traced.name, (unsigned long long)c8e::tracer.events, (unsigned long long)c8e::tracer.bytes,
+           c8e::tracer.events ? (double)c8e::tracer.bytes / c8e::tracer.events : 0.0,
+           untraced.instructions / untraced.seconds, traced.instructions / traced.seconds);
+    return 0;
+}
+
+static void print_trace_event(const c8e::TraceEvent* event)
+{
+    char text[32];
+    c8e::disassemble(event->op, text, sizeof(text));
+    if(event->reg != c8e::TRACE_NO_REGISTER)
+        printf("%10llu  %03X  %04X  I=%03X  V%X=%02X  %s\n", (unsigned long long)event->cycle, event->pc, event->op, event->i, event->reg, event->value, text);
+    else
+        printf("%10llu  %03X  %04X  I=%03X         %s\n", (unsigned long long)event->cycle, event->pc, event->op, event->i, text);
+}
+
+// Prints count events of a trace file starting at a cycle, one per line.
+static int dump_trace(const char* path_arg, uint64_t cycle, long long count)
+{
+    plat::FilePath path = {strlen(path_arg), (char*)path_arg};
+    c8e::TraceReader reader;
+    if(!c8e::trace_open(&reader, path))
+    {
+        fprintf(stderr, "ERROR: %s is not a finished version %u trace.\n", path_arg, c8e::TRACE_VERSION);
+        return 1;
+    }
+
+    uint64_t event = c8e::trace_find_cycle(&reader, cycle);
+    c8e::TraceEvent events[256];
+    while(count > 0)
+    {
+        int read = c8e::trace_read(&reader, event, events, count < 256 ? (int)count : 256);
+        if(read == 0)
+            break;
+        for(int n = 0; n < read; n++)
+            print_trace_event(&events[n]);
+        event += read;
+        count -= read;
+    }
+    c8e::trace_close(&reader);
+    return 0;
+}
+
+// Seeks to random cycles of a trace, then checks the nearest snapshot re-executes into the
+// recorded pcs. Only valid for traces without input, since key changes aren't recorded.
+static int seek_trace(const char* path_arg, int seeks)
+{
+    plat::FilePath path = {strlen(path_arg), (char*)path_arg};
+    c8e::TraceReader reader;
+    double start = get_time();
+    if(!c8e::trace_open(&reader, path))
+    {
+        fprintf(stderr, "ERROR: %s is not a finished version %u trace.\n", path_arg, c8e::TRACE_VERSION);
+        return 1;
+    }
+    double open_seconds = get_time() - start;
+    if(reader.footer.event_count == 0)
+    {
+        c8e::trace_close(&reader);
+        return 0;
+    }
+
+    uint64_t first_cycle = reader.index[0].first_cycle;
+    uint64_t cycle_range = reader.index[reader.footer.block_count - 1].first_cycle - first_cycle + 1;
+    uint32_t rng = 0x2545F491;
+    double seek_seconds = 0.0;
+    uint64_t replayed = 0;
+    int mismatches = 0;
+    headless_initialize(0);
+    for(int s = 0; s < seeks; s++)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        uint64_t cycle = first_cycle + (((uint64_t)rng << 16) ^ rng) % cycle_range;
+
+        start = get_time();
+        uint64_t event = c8e::trace_find_cycle(&reader, cycle);
+        c8e::TraceEvent target;
+        c8e::trace_read(&reader, event, &target, 1);
+        seek_seconds += get_time() - start;
+
+        c8e::Snapshot snapshot;
+        uint64_t snapshot_event;
+        if(!c8e::trace_read_snapshot(&reader, event, &snapshot, &snapshot_event))
+        {
+            mismatches++;
+            continue;
+        }
+        c8e::load_snapshot(&snapshot);
+        c8e::TraceEvent events[256];
+        for(uint64_t e = snapshot_event; e <= event && !mismatches; )
+        {
+            int read = c8e::trace_read(&reader, e, events, 256);
+            for(int n = 0; n < read && e <= event; n++, e++)
+            {
+                if(c8e::c8.pc != events[n].pc || c8e::c8.cycle != events[n].cycle)
+                {
+                    fprintf(stderr, "Mismatch at cycle %llu: pc %03X, trace has %03X\n",
+                            (unsigned long long)events[n].cycle, c8e::c8.pc, events[n].pc);
+                    mismatches++;
+                    break;
+                }
+                c8e::next_op();
+                replayed++;
+            }
+            if(read == 0)
+                break;
+        }
+    }
+
+    printf("{\n    \"events\": %llu,\n    \"blocks\": %llu,\n    \"open_us\": %.1f,\n    \"seek_us\": %.2f,\n"
+           "    \"replayed_from_snapshots\": %llu,\n    \"mismatches\": %d\n}\n",
+           (unsigned long long)reader.footer.event_count, (unsigned long long)reader.footer.block_count,
+           open_seconds * 1e6, seek_seconds * 1e6 / seeks, (unsigned long long)replayed, mismatches);
+    c8e::trace_close(&reader);
+    return mismatches ? 1 : 0;
+}
+
+#ifdef USE_ZONES
+// Runs a ROM (or movie) for a while and dumps the zone ring buffers as a Chrome trace.
+static int trace_rom(const char* out_path, const char* rom_path, const char* movie_path, long long frames)
+{
+    C8E_ZONE_THREAD("main");
+    BenchResult result;
+    if(rom_path)
+    {
+        if(!bench_rom(rom_path, movie_path, frames, &result))
+            return 1;
+    }
+    else
+    {
+        headless_initialize(0);
+        for(long long f = 0; f < frames; f++)
+        {
+            c8e::run_frame();
+        }
+    }
+
+    plat::FilePath path = {strlen(out_path), (char*)out_path};
+    if(!c8e::zone_write_chrome_trace(path))
+    {
+        fprintf(stderr, "ERROR: Could not write %s.\n", out_path);
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+static void print_usage()
+{
+    fprintf(stderr,
+        "usage: main_headless <command> [args]\n"
+        "    bench [--instructions N] [--frames N] [--no-perf] [rom.ch8[:movie.c8m]]...\n"
+        "                                benchmark suite with hardware counters, JSON on stdout\n"
+        "    bench-snapshot [rom.ch8]    snapshot/restore throughput\n"
+        "    bench-rewind [rom.ch8]      rewind recording cost and size\n"
+        "    bench-run-ahead [rom.ch8]   extra cost per presented frame for 0-4 frames of run-ahead\n"
+        "    bench-hash [rom.ch8]        cached state hash against hashing from scratch\n"
+        "    bench-reverse [rom.ch8] [minutes]\n"
+        "                                reverse-debugging history cost, step back and run back latency\n"
+        "    bench-breakpoints           speed with and without breakpoints armed, watch hits checked\n"
+        "    bench-disasm [rom.ch8]      control-flow disassembly checks, and what caching it costs\n"
+        "    bench-memview               memory viewer change detection, checked against a byte compare\n"
+        "    bench-search                memory search checked against a plain loop, finding a counter, filter speed\n"
+        "    bench-coverage              coverage bitmaps checked against watched pcs, and their cost\n"
+        "    bench-expr                  compiled expressions checked against C, and their cost as conditions\n"
+        "    bench-writes [rom.ch8] [seconds]\n"
+        "                                memory-write log cost and query latency, checked against memory\n"
+        "    profile [rom.ch8[:movie.c8m]]\n"
+        "                                sampled hot guest addresses with disassembly\n"
+        "    perf [--frames N] [--uncapped] [rom.ch8[:movie.c8m]]\n"
+        "                                the performance overlay numbers, paced to 60 Hz\n"
+        "    record-trace <out.c8t> [rom.ch8[:movie.c8m]]\n"
+        "                                instruction trace, with traced and untraced speed\n"
+        "    dump-trace <trace.c8t> [cycle] [count]\n"
+        "                                print instructions of a trace from a cycle on\n"
+        "    seek-trace <trace.c8t> [seeks]\n"
+        "                                random seeks, checked against the snapshots (input-free traces)\n"
+        "    trace <out.json> [rom.ch8[:movie.c8m]]\n"
+        "                                Chrome trace of the built-in zones (not with -DNO_ZONES)\n"
+        "    op-stats [rom.ch8[:movie.c8m]]\n"
+        "                                per-opcode-class and per-address counts (needs -DUSE_OP_COUNTERS)\n"
+        "    coverage <out.info> [--frames N] [--instances N] [rom.ch8[:movie.c8m]]...\n"
+        "                                merged coverage of random-input instances and movies, as lcov\n"
+        "    fuzz [--seconds S] [--execs N] [--frames N] [--seed N] [--rom-bytes] [--no-fork] [--out prefix] [rom.ch8]\n"
+        "                                coverage-guided input fuzzing, crashes written as <prefix>N.ch8 and .c8m\n"
+        "    record <rom.ch8> <out.c8m> <frames> [input seed]\n"
+        "                                record a movie of random input\n"
+        "    replay <rom.ch8> <movie.c8m>\n"
+        "                                replay a movie uncapped and check it stays in sync\n");
+}
+
+// Coverage of each ROM over a movie and/or instances fed random input, merged and written as one
+// lcov record per ROM, with the listing it refers to next to the output.
+static int coverage_command(int argc, char** argv)
+{
+    const char* out_path = 0;
+    long long frames = 60*60;
+    int instances = 8;
+    const char* roms[64];
+    int rom_count = 0;
+    for(int n = 0; n < argc; n++)
+    {
+        if(strcmp(argv[n], "--frames") == 0 && n + 1 < argc)
+            frames = atoll(argv[++n]);
+        else if(strcmp(argv[n], "--instances") == 0 && n + 1 < argc)
+            instances = atoi(argv[++n]);
+        else if(!out_path)
+            out_path = argv[n];
+        else if(rom_count < 64)
+            roms[rom_count++] = argv[n];
+    }
+    if(!out_path)
+    {
+        print_usage();
+        return 1;
+    }
+
+    plat::FilePath out = {strlen(out_path), (char*)out_path};
+    plat::FileHandle file = plat::open_file_for_writing(out);
+    if(!file)
+    {
+        fprintf(stderr, "ERROR: Could not write %s.\n", out_path);
+        return 1;
+    }
+    const char* slash = strrchr(out_path, '/');
+    int directory = slash ? (int)(slash - out_path) + 1 : 0;
+
+    bool failed = false;
+    for(int r = 0; r < (rom_count ? rom_count : 1); r++)
+    {
+        static char rom_path[1024];
+        char* movie_path = 0;
+        if(rom_count)
+        {
+            int length = snprintf(rom_path, sizeof(rom_path), "%s", roms[r]);
+            if(length < 0 || length >= (int)sizeof(rom_path))
+            {
+                fprintf(stderr, "ERROR: Path too long: %s\n", roms[r]);
+                failed = true;
+                continue;
+            }
+            movie_path = strchr(rom_path, ':');
+            if(movie_path)
+                *movie_path++ = 0;
+        }
+        const char* rom = rom_count ? rom_path : 0;
+        const char* name = rom ? (strrchr(rom, '/') ? strrchr(rom, '/') + 1 : rom) : "default";
+
+        static c8e::Coverage total;
+        coverage_clear(&total);
+        long long ran = 0;
+        double start = get_time();
+        int runs = instances + (movie_path ? 1 : 0);
+        for(int k = 0; k < runs; k++)
+        {
+            c8e::coverage_clear(&c8e::coverage);
+            c8e::coverage.enabled = true;
+            if(k == instances)
+            {
+                BenchResult result;
+                if(!bench_rom(rom, movie_path, frames, &result))
+                    failed = true;
+                else
+                    ran += result.instructions;
+            }
+            else
+            {
+                headless_initialize(rom);
+                uint32_t seed = (uint32_t)k + 1;
+                int hold = 0;
+                for(long long f = 0; f < frames; f++)
+                {
+                    random_keys(&seed, &hold);
+                    ran += c8e::run_frame();
+                }
+            }
+            c8e::coverage.enabled = false;
+            c8e::coverage_merge(&total, &c8e::coverage);
+        }
+        double seconds = get_time() - start;
+
+        // The listing and the "found" lines come from the ROM as loaded, not as it ended up.
+        headless_initialize(rom);
+        c8e::disasm.valid = false;
+        static char listing[1024];
+        int length = snprintf(listing, sizeof(listing), "%.*s%s.lst", directory, out_path, name);
+        if(length < 0 || length >= (int)sizeof(listing))
+        {
+            fprintf(stderr, "ERROR: Listing path too long for %s\n", name);
+            failed = true;
+            continue;
+        }
+        plat::FilePath listing_path = {strlen(listing), listing};
+        failed |= !c8e::coverage_write_listing(listing_path);
+        failed |= !c8e::coverage_write_lcov(&total, file, name, listing);
+
+        c8e::CoverageStats stats;
+        c8e::coverage_stats(&total, &stats);
+        printf("{\"command\": \"coverage\", \"name\": \"%s\", \"instances\": %d, \"frames\": %lld, \"instructions\": %d, "
+               "\"executed\": %d, \"share\": %.4f, \"skips\": %d, \"skips_both_ways\": %d, \"skips_one_way\": %d, "
+               "\"subroutines\": %d, \"subroutines_called\": %d, \"mips\": %.1f, \"listing\": \"%s\"}\n",
+               name, runs, frames, stats.instructions, stats.executed,
+               stats.instructions ? (double)stats.executed / stats.instructions : 0.0, stats.skips, stats.skips_both_ways,
+               stats.skips_one_way, stats.subroutines, stats.subroutines_called, ran / seconds / 1e6, listing);
+    }
+    plat::close_file(file);
+    if(failed)
+        fprintf(stderr, "ERROR: Could not write the coverage of every ROM.\n");
+    return failed ? 1 : 0;
+}
+
+// Coverage bitmaps against pcs watched from outside, merging, and what recording costs.
+static int bench_coverage()
+{
+    int mismatches = 0;
+    static c8e::Coverage expected;
+    static c8e::Coverage halves;
+    coverage_clear(&halves);
+    const uint16_t* programs[] = {BRANCH_PROGRAM, DISASM_PROGRAM, DEFAULT_PROGRAM};
+    const int sizes[] = {(int)(sizeof(BRANCH_PROGRAM)/sizeof(*BRANCH_PROGRAM)), (int)(sizeof(DISASM_PROGRAM)/sizeof(*DISASM_PROGRAM)),
+                         (int)(sizeof(DEFAULT_PROGRAM)/sizeof(*DEFAULT_PROGRAM))};
+    for(int p = 0; p < 3; p++)
+    {
+        memset(&c8e::c8, 0, sizeof(c8e::c8));
+        load_program(programs[p], sizes[p]);
+        c8e::reset();
+        coverage_clear(&expected);
+        c8e::coverage_clear(&c8e::coverage);
+        c8e::coverage.enabled = true;
+        for(int n = 0; n < 100000; n++)
+        {
+            uint16_t pc = c8e::c8.pc;
+            uint16_t op = (uint16_t)((c8e::c8.memory[pc] << 8) | c8e::c8.memory[pc + 1]);
+            c8e::next_op();
+            uint64_t bit = 1ull << (pc % 64);
+            expected.executed[pc / 64] |= bit;
+            c8e::OpClass cls = c8e::op_class(op);
+            if(cls == c8e::OP_SE_IMM || cls == c8e::OP_SNE_IMM || cls == c8e::OP_SE || cls == c8e::OP_SNE ||
+               cls == c8e::OP_SKP || cls == c8e::OP_SKNP)
+            {
+                if(c8e::c8.pc == pc + 4)
+                    expected.skipped[pc / 64] |= bit;
+                else
+                    expected.fell_through[pc / 64] |= bit;
+            }
+        }
+        c8e::coverage.enabled = false;
+        mismatches += memcmp(expected.executed, c8e::coverage.executed, sizeof(expected.executed)) != 0;
+        mismatches += memcmp(expected.skipped, c8e::coverage.skipped, sizeof(expected.skipped)) != 0;
+        mismatches += memcmp(expected.fell_through, c8e::coverage.fell_through, sizeof(expected.fell_through)) != 0;
+        c8e::coverage_merge(&halves, &c8e::coverage);
+    }
+    // Every program starts at 200, so the merge has it.
+    mismatches += !c8e::coverage_has(halves.executed, 0x200) || !c8e::coverage_has(halves.executed, 0x222);
+
+    // The skip at 202 in BRANCH_PROGRAM goes both ways once v0 wraps.
+    mismatches += !c8e::coverage_has(halves.skipped, 0x202) || !c8e::coverage_has(halves.fell_through, 0x202);
+
+    const long long instructions = 50000000;
+    double seconds[2];
+    for(int on = 0; on < 2; on++)
+    {
+        memset(&c8e::c8, 0, sizeof(c8e::c8));
+        load_program(BRANCH_PROGRAM, sizeof(BRANCH_PROGRAM)/sizeof(*BRANCH_PROGRAM));
+        c8e::reset();
+        c8e::coverage.enabled = on != 0;
+        double start = get_time();
+        for(long long n = 0; n < instructions; n++)
+            c8e::next_op();
+        seconds[on] = get_time() - start;
+    }
+    c8e::coverage.enabled = false;
+
+    const int merges = 1000000;
+    double start = get_time();
+    for(int n = 0; n < merges; n++)
+        c8e::coverage_merge(&halves, &expected);
+    double merge_ns = (get_time() - start) * 1e9 / merges;
+
+    printf("{\"benchmark\": \"coverage\", \"mips_off\": %.1f, \"mips_on\": %.1f, \"ns_per_merge\": %.1f, \"mismatches\": %d}\n",
+           instructions / seconds[0] / 1e6, instructions / seconds[1] / 1e6, merge_ns, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+// Waits for key 5, then within half a second key 6 or key 9, then within half a second key A.
+// Key 9 runs LD B with I at FFE and key A returns with nothing on the stack: both trip asserts.
+static const uint16_t FUZZ_PROGRAM[] =
+{
+    0x6105, // 200: LD V1, 5
+    0x6206, // 202: LD V2, 6
+    0x630A, // 204: LD V3, A
+    0x6409, // 206: LD V4, 9
+    0xE19E, // 208: SKP V1
+    0x1208, // 20A: JP 208
+    0x6F1E, // 20C: LD VF, 1E
+    0xFF15, // 20E: LD DT, VF
+    0xE29E, // 210: SKP V2
+    0x1216, // 212: JP 216
+    0x1224, // 214: JP 224
+    0xE49E, // 216: SKP V4
+    0x121C, // 218: JP 21C
+    0x1236, // 21A: JP 236
+    0xFF07, // 21C: LD VF, DT
+    0x3F00, // 21E: SE VF, 0
+    0x1210, // 220: JP 210
+    0x1208, // 222: JP 208
+    0x6F1E, // 224: LD VF, 1E
+    0xFF15, // 226: LD DT, VF
+    0xE39E, // 228: SKP V3
+    0x122E, // 22A: JP 22E
+    0x00EE, // 22C: RET
+    0xFF07, // 22E: LD VF, DT
+    0x3F00, // 230: SE VF, 0
+    0x1228, // 232: JP 228
+    0x1208, // 234: JP 208
+    0xAFFE, // 236: LD I, FFE
+    0xF033, // 238: LD B, V0
+    0x1208, // 23A: JP 208
+};
+
+// Fuzzing. An input is the keypad state for every frame, plus optionally a few patched ROM bytes.
+// Inputs in the corpus keep a snapshot every FUZZ_CHECKPOINT frames, so a mutant that changes the
+// keys from frame m on starts from the snapshot before m instead of from reset(). A mutant that
+// reaches an address or skip direction nothing did before joins the corpus; one that trips a
+// C8E_ASSERT is written out as a ROM and a movie that reproduces it.
+const int FUZZ_CHECKPOINT = 30;
+const int FUZZ_MAX_CORPUS = 256;
+const int FUZZ_MAX_PATCHES = 8;
+const int FUZZ_MAX_CRASHES = 64;
+
+struct FuzzInput
+{
+    uint16_t* keys; // one mask per frame
+    c8e::Snapshot* checkpoints; // at the start of every FUZZ_CHECKPOINT-th frame
+    int patch_count;
+    uint16_t patch_addr[FUZZ_MAX_PATCHES];
+    uint8_t patch_value[FUZZ_MAX_PATCHES];
+};
+
+struct FuzzCrash
+{
+    int line;
+    uint16_t pc;
+};
+
+static jmp_buf g_fuzz_jump;
+static const char* g_fuzz_expression;
+static int g_fuzz_line;
+static int g_fuzz_frame;
+static uint8_t g_fuzz_rom[c8e::MEMORY_SIZE - c8e::PROGRAM_OFFSET];
+
+static void fuzz_assert_handler(const char* expression, const char* file, int line)
+{
+    g_fuzz_expression = expression;
+    g_fuzz_line = line;
+    longjmp(g_fuzz_jump, 1);
+}
+
+static inline uint32_t fuzz_random(uint32_t* r)
+{
+    *r ^= *r << 13;
+    *r ^= *r >> 17;
+    *r ^= *r << 5;
+    return *r;
+}
+
+static bool fuzz_alloc(FuzzInput* input, int frames)
+{
+    memset(input, 0, sizeof(*input));
+    input->keys = (uint16_t*)calloc(frames, sizeof(*input->keys));
+    input->checkpoints = (c8e::Snapshot*)malloc(((frames + FUZZ_CHECKPOINT - 1) / FUZZ_CHECKPOINT) * sizeof(c8e::Snapshot));
+    return input->keys && input->checkpoints;
+}
+
+static void fuzz_free(FuzzInput* input)
+{
+    free(input->keys);
+    free(input->checkpoints);
+    memset(input, 0, sizeof(*input));
+}
+
+static void fuzz_reset(const FuzzInput* input)
+{
+    memcpy(c8e::c8.rom, g_fuzz_rom, sizeof(g_fuzz_rom));
+    for(int n = 0; n < input->patch_count; n++)
+        c8e::c8.rom[input->patch_addr[n] - c8e::PROGRAM_OFFSET] = input->patch_value[n];
+    c8e::reset();
+    c8e::c8.loaded = true;
+}
+
+static inline void fuzz_keys(uint16_t keys)
+{
+    for(int k = 0; k < 16; k++)
+        c8e::c8.keys[k] = (keys >> k) & 1;
+}
+
+// Runs input with coverage on from frame from to the end. It starts from parent's checkpoint at
+// or before from, or from reset() without a parent, and saves its own checkpoints as it goes.
+// Returns false if a C8E_ASSERT tripped, in frame g_fuzz_frame.
+static bool fuzz_run(FuzzInput* input, const FuzzInput* parent, int from, int frames)
+{
+    int start = parent ? from - from % FUZZ_CHECKPOINT : 0;
+    if(parent)
+        c8e::load_snapshot(&parent->checkpoints[start / FUZZ_CHECKPOINT]);
+    else
+        fuzz_reset(input);
+    c8e::coverage_clear(&c8e::coverage);
+    c8e::coverage.enabled = true;
+    if(setjmp(g_fuzz_jump))
+    {
+        c8e::coverage.enabled = false;
+        return false;
+    }
+    for(g_fuzz_frame = start; g_fuzz_frame < frames; g_fuzz_frame++)
+    {
+        if(g_fuzz_frame % FUZZ_CHECKPOINT == 0)
+            c8e::save_snapshot(&input->checkpoints[g_fuzz_frame / FUZZ_CHECKPOINT]);
+        fuzz_keys(input->keys[g_fuzz_frame]);
+        c8e::run_frame();
+    }
+    c8e::coverage.enabled = false;
+    return true;
+}
+
+// ORs run into total. True if run had a bit total did not.
+static bool fuzz_merge_new(c8e::Coverage* total, const c8e::Coverage* run)
+{
+    uint64_t added = 0;
+    for(int word = 0; word < c8e::MEMORY_SIZE / 64; word++)
+    {
+        added |= run->executed[word] & ~total->executed[word];
+        added |= run->skipped[word] & ~total->skipped[word];
+        added |= run->fell_through[word] & ~total->fell_through[word];
+    }
+    if(added)
+        c8e::coverage_merge(total, run);
+    return added != 0;
+}
+
+static int count_bits(const uint64_t* words, int count)
+{
+    int bits = 0;
+    for(int n = 0; n < count; n++)
+    {
+        for(uint64_t word = words[n]; word; word &= word - 1)
+            bits++;
+    }
+    return bits;
+}
+
+// Records the input from reset() up to the frame that crashed as a movie, next to the patched
+// ROM it runs against. The movie ends after that frame, so replaying it trips the same assert.
+static bool fuzz_write_crash(const FuzzInput* input, int crash_frame, int rom_size, const char* prefix, int number,
+                             char* rom_path, char* movie_path, int path_size)
+{
+    snprintf(rom_path, path_size, "%s%d.ch8", prefix, number);
+    snprintf(movie_path, path_size, "%s%d.c8m", prefix, number);
+
+    fuzz_reset(input);
+    c8e::Movie* movie = &c8e::movie_state;
+    if(!c8e::movie_record_start(movie, false, 60))
+        return false;
+    bool reproduced = false;
+    if(setjmp(g_fuzz_jump))
+    {
+        reproduced = g_fuzz_frame == crash_frame;
+        c8e::movie_end_frame(movie);
+    }
+    else
+    {
+        for(g_fuzz_frame = 0; g_fuzz_frame <= crash_frame; g_fuzz_frame++)
+        {
+            fuzz_keys(input->keys[g_fuzz_frame]);
+            c8e::movie_run_frame(movie);
+        }
+    }
+    c8e::movie_record_stop(movie);
+
+    plat::FilePath rom = {strlen(rom_path), rom_path};
+    plat::FilePath path = {strlen(movie_path), movie_path};
+    bool written = plat::write_entire_file(rom, c8e::c8.rom, rom_size) &&
+                   plat::write_entire_file(path, movie->data, movie->size);
+    c8e::movie_free(movie);
+    return written && reproduced;
+}
+
+// Mutates child, a copy of parent, and returns the first frame that changed, or -1 when a ROM byte
+// changed and the run has to start from reset().
+static int fuzz_mutate(FuzzInput* child, const FuzzInput* other, int frames, int rom_size, bool rom_bytes, uint32_t* r)
+{
+    int from = fuzz_random(r) % frames;
+    int length = 1 + fuzz_random(r) % (FUZZ_CHECKPOINT * 2);
+    int end = from + length < frames ? from + length : frames;
+    switch(fuzz_random(r) % (rom_bytes ? 5 : 4))
+    {
+        case 0: // hold one key, or none
+        case 1:
+        {
+            uint32_t pick = fuzz_random(r);
+            uint16_t keys = (pick & 3) ? (uint16_t)(1 << ((pick >> 2) & 0xF)) : 0;
+            for(int f = from; f < end; f++)
+                child->keys[f] = keys;
+            break;
+        }
+        case 2: // press or release one key on top of what is there
+        {
+            uint16_t key = (uint16_t)(1 << (fuzz_random(r) & 0xF));
+            for(int f = from; f < end; f++)
+                child->keys[f] ^= key;
+            break;
+        }
+        case 3: // the rest of another input
+        {
+            memcpy(child->keys + from, other->keys + from, (frames - from) * sizeof(*child->keys));
+            break;
+        }
+        case 4: // a ROM byte
+        {
+            int n = child->patch_count < FUZZ_MAX_PATCHES ? child->patch_count++ : (int)(fuzz_random(r) % FUZZ_MAX_PATCHES);
+            uint16_t addr = (uint16_t)(c8e::PROGRAM_OFFSET + fuzz_random(r) % rom_size);
+            uint32_t pick = fuzz_random(r);
+            child->patch_addr[n] = addr;
+            child->patch_value[n] = (pick & 1) ? (uint8_t)(pick >> 8) : (uint8_t)(g_fuzz_rom[addr - c8e::PROGRAM_OFFSET] ^ (1 << ((pick >> 1) & 7)));
+            return -1;
+        }
+    }
+    return from;
+}
+
+static int fuzz_command(int argc, char** argv)
+{
+    double seconds = 10;
+    long long max_execs = 0;
+    int frames = 600;
+    uint32_t seed = 1;
+    bool rom_bytes = false;
+    bool fork = true;
+    const char* prefix = "crash-";
+    const char* rom_path = 0;
+    for(int n = 0; n < argc; n++)
+    {
+        if(strcmp(argv[n], "--seconds") == 0 && n + 1 < argc)
+            seconds = atof(argv[++n]);
+        else if(strcmp(argv[n], "--execs") == 0 && n + 1 < argc)
+            max_execs = atoll(argv[++n]);
+        else if(strcmp(argv[n], "--frames") == 0 && n + 1 < argc)
+            frames = atoi(argv[++n]);
+        else if(strcmp(argv[n], "--seed") == 0 && n + 1 < argc)
+            seed = (uint32_t)strtoul(argv[++n], 0, 0);
+        else if(strcmp(argv[n], "--out") == 0 && n + 1 < argc)
+            prefix = argv[++n];
+        else if(strcmp(argv[n], "--rom-bytes") == 0)
+            rom_bytes = true;
+        else if(strcmp(argv[n], "--no-fork") == 0)
+            fork = false;
+        else
+            rom_path = argv[n];
+    }
+    if(frames < 1)
+        frames = 1;
+    if(!seed)
+        seed = 1;
+
+    memset(&c8e::c8, 0, sizeof(c8e::c8));
+    if(rom_path)
+    {
+        plat::FilePath path = {strlen(rom_path), (char*)rom_path};
+        c8e::load_rom(path);
+    }
+    else
+    {
+        load_program(FUZZ_PROGRAM, sizeof(FUZZ_PROGRAM)/sizeof(*FUZZ_PROGRAM));
+    }
+    memcpy(g_fuzz_rom, c8e::c8.rom, sizeof(g_fuzz_rom));
+    int rom_size = sizeof(g_fuzz_rom);
+    while(rom_size > 2 && !g_fuzz_rom[rom_size - 1])
+        rom_size--;
+
+    static FuzzInput corpus[FUZZ_MAX_CORPUS];
+    static FuzzCrash crashes[FUZZ_MAX_CRASHES];
+    static c8e::Coverage total;
+    FuzzInput child;
+    int corpus_count = 0;
+    int crash_count = 0;
+    long long crash_execs = 0;
+    long long execs = 0;
+    long long frames_run = 0;
+    c8e::coverage_clear(&total);
+    if(!fuzz_alloc(&child, frames))
+    {
+        fprintf(stderr, "ERROR: Out of memory.\n");
+        return 1;
+    }
+
+    // Nobody reads the zones here, and recording them costs more than the frames do.
+#ifdef USE_ZONES
+    bool zones = c8e::zone_state.enabled.load();
+    c8e::zone_state.enabled.store(false);
+#endif
+
+    // The first input presses nothing; everything else descends from it.
+    c8e::assert_handler = fuzz_assert_handler;
+    uint32_t r = seed;
+    double start = get_time();
+    while(max_execs ? execs < max_execs : get_time() - start < seconds)
+    {
+        int from = 0;
+        const FuzzInput* parent = 0;
+        if(corpus_count)
+        {
+            parent = &corpus[fuzz_random(&r) % corpus_count];
+            memcpy(child.keys, parent->keys, frames * sizeof(*child.keys));
+            child.patch_count = parent->patch_count;
+            memcpy(child.patch_addr, parent->patch_addr, sizeof(child.patch_addr));
+            memcpy(child.patch_value, parent->patch_value, sizeof(child.patch_value));
+            from = fuzz_mutate(&child, &corpus[fuzz_random(&r) % corpus_count], frames, rom_size, rom_bytes, &r);
+            if(from < 0 || !fork)
+            {
+                parent = 0;
+                from = 0;
+            }
+        }
+
+        bool finished = fuzz_run(&child, parent, from, frames);
+        execs++;
+        frames_run += (finished ? frames : g_fuzz_frame + 1) - (parent ? from - from % FUZZ_CHECKPOINT : 0);
+        if(!finished)
+        {
+            crash_execs++;
+            uint16_t pc = c8e::c8.pc;
+            bool known = false;
+            for(int n = 0; n < crash_count; n++)
+                known |= crashes[n].line == g_fuzz_line && crashes[n].pc == pc;
+            if(!known && crash_count < FUZZ_MAX_CRASHES)
+            {
+                crashes[crash_count].line = g_fuzz_line;
+                crashes[crash_count].pc = pc;
+                const char* expression = g_fuzz_expression;
+                int crash_frame = g_fuzz_frame;
+                char crash_rom[1024];
+                char crash_movie[1024];
+                bool reproduced = fuzz_write_crash(&child, crash_frame, rom_size, prefix, crash_count, crash_rom, crash_movie, sizeof(crash_rom));
+                printf("{\"crash\": %d, \"assert\": \"%s\", \"line\": %d, \"pc\": \"%03X\", \"frame\": %d, \"exec\": %lld, "
+                       "\"rom\": \"%s\", \"movie\": \"%s\", \"reproduced\": %s}\n",
+                       crash_count, expression, crashes[crash_count].line, pc, crash_frame, execs, crash_rom, crash_movie,
+                       reproduced ? "true" : "false");
+                fflush(stdout);
+                crash_count++;
+            }
+            continue;
+        }
+
+        if(fuzz_merge_new(&total, &c8e::coverage) && corpus_count < FUZZ_MAX_CORPUS)
+        {
+            FuzzInput* added = &corpus[corpus_count];
+            if(!fuzz_alloc(added, frames))
+                break;
+            memcpy(added->keys, child.keys, frames * sizeof(*child.keys));
+            int first = parent ? from / FUZZ_CHECKPOINT : 0;
+            int count = (frames + FUZZ_CHECKPOINT - 1) / FUZZ_CHECKPOINT;
+            if(first)
+                memcpy(added->checkpoints, parent->checkpoints, first * sizeof(c8e::Snapshot));
+            memcpy(added->checkpoints + first, child.checkpoints + first, (count - first) * sizeof(c8e::Snapshot));
+            added->patch_count = child.patch_count;
+            memcpy(added->patch_addr, child.patch_addr, sizeof(added->patch_addr));
+            memcpy(added->patch_value, child.patch_value, sizeof(added->patch_value));
+            corpus_count++;
+        }
+    }
+    double elapsed = get_time() - start;
+    c8e::assert_handler = 0;
+#ifdef USE_ZONES
+    c8e::zone_state.enabled.store(zones);
+#endif
+
+    printf("{\"command\": \"fuzz\", \"execs\": %lld, \"seconds\": %.3f, \"execs_per_second\": %.0f, \"frames_per_second\": %.0f, "
+           "\"forked\": %s, \"corpus\": %d, \"addresses\": %d, \"skip_directions\": %d, \"crashes\": %d, \"crash_execs\": %lld}\n",
+           execs, elapsed, execs / elapsed, frames_run / elapsed, fork ? "true" : "false", corpus_count,
+           count_bits(total.executed, c8e::MEMORY_SIZE / 64),
+           count_bits(total.skipped, c8e::MEMORY_SIZE / 64) + count_bits(total.fell_through, c8e::MEMORY_SIZE / 64),
+           crash_count, crash_execs);
+
+    for(int n = 0; n < corpus_count; n++)
+        fuzz_free(&corpus[n]);
+    fuzz_free(&child);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        print_usage();
+        return 1;
+    }
+
+    if(strcmp(argv[1], "bench") == 0)
+    {
+        return bench_suite(argc - 2, argv + 2);
+    }
+
+    if(strcmp(argv[1], "bench-snapshot") == 0)
+    {
+        return bench_snapshot(argc > 2 ? argv[2] : 0);
+    }
+
+    if(strcmp(argv[1], "bench-rewind") == 0)
+    {
+        return bench_rewind(argc > 2 ? argv[2] : 0);
+    }
+
+    if(strcmp(argv[1], "bench-run-ahead") == 0)
+    {
+        return bench_run_ahead(argc > 2 ? argv[2] : 0, 4);
+    }
+
+    if(strcmp(argv[1], "bench-reverse") == 0)
+    {
+        return bench_reverse(argc > 2 ? argv[2] : 0, argc > 3 ? atoi(argv[3]) : 10);
+    }
+
+    if(strcmp(argv[1], "bench-breakpoints") == 0)
+    {
+        return bench_breakpoints();
+    }
+
+    if(strcmp(argv[1], "bench-disasm") == 0)
+    {
+        return bench_disasm(argc > 2 ? argv[2] : 0);
+    }
+
+    if(strcmp(argv[1], "bench-memview") == 0)
+    {
+        return bench_memview();
+    }
+
+    if(strcmp(argv[1], "bench-search") == 0)
+    {
+        return bench_search();
+    }
+
+    if(strcmp(argv[1], "bench-coverage") == 0)
+    {
+        return bench_coverage();
+    }
+
+    if(strcmp(argv[1], "fuzz") == 0)
+    {
+        return fuzz_command(argc - 2, argv + 2);
+    }
+
+    if(strcmp(argv[1], "coverage") == 0)
+    {
+        return coverage_command(argc - 2, argv + 2);
+    }
+
+    if(strcmp(argv[1], "bench-expr") == 0)
+    {
+        return bench_expr();
+    }
+
+    if(strcmp(argv[1], "bench-writes") == 0)
+    {
+        return bench_writes(argc > 2 && argv[2][0] ? argv[2] : 0, argc > 3 ? atoi(argv[3]) : 60);
+    }
+
+    if(strcmp(argv[1], "bench-hash") == 0)
+    {
+        return bench_hash(argc > 2 ? argv[2] : 0);
+    }
+
+    if(strcmp(argv[1], "perf") == 0)
+    {
+        return perf_stats_command(argc - 2, argv + 2);
+    }
+
+    if(strcmp(argv[1], "record-trace") == 0 && argc > 2)
+    {
+        static char rom_path[1024];
+        char* movie_path = 0;
+        if(argc > 3)
+        {
+            snprintf(rom_path, sizeof(rom_path), "%s", argv[3]);
+            movie_path = strchr(rom_path, ':');
+            if(movie_path)
+                *movie_path++ = 0;
+        }
+        return record_trace(argv[2], argc > 3 ? rom_path : 0, movie_path, 60*60);
+    }
+
+    if(strcmp(argv[1], "dump-trace") == 0 && argc > 2)
+    {
+        return dump_trace(argv[2], argc > 3 ? strtoull(argv[3], 0, 0) : 0, argc > 4 ? atoll(argv[4]) : 32);
+    }
+
+    if(strcmp(argv[1], "seek-trace") == 0 && argc > 2)
+    {
+        return seek_trace(argv[2], argc > 3 ? atoi(argv[3]) : 100);
+    }
+
+#ifdef USE_ZONES
+    if(strcmp(argv[1], "trace") == 0 && argc > 2)
+    {
+        static char rom_path[1024];
+        char* movie_path = 0;
+        if(argc > 3)
+        {
+            snprintf(rom_path, sizeof(rom_path), "%s", argv[3]);
+            movie_path = strchr(rom_path, ':');
+            if(movie_path)
+                *movie_path++ = 0;
+        }
+        return trace_rom(argv[2], argc > 3 ? rom_path : 0, movie_path, 60*60);
+    }
+#endif
+
+    if(strcmp(argv[1], "op-stats") == 0 || strcmp(argv[1], "profile") == 0)
+    {
+        // rom.ch8:movie.c8m
+        static char rom_path[1024];
+        char* movie_path = 0;
+        if(argc > 2)
+        {
+            snprintf(rom_path, sizeof(rom_path), "%s", argv[2]);
+            movie_path = strchr(rom_path, ':');
+            if(movie_path)
+                *movie_path++ = 0;
+        }
+        if(strcmp(argv[1], "profile") == 0)
+            return profile_rom(argc > 2 ? rom_path : 0, movie_path, 60*60*10);
+        return op_stats(argc > 2 ? rom_path : 0, movie_path, 60*60*10);
+    }
+
+    if(strcmp(argv[1], "record") == 0 && argc >= 5)
+    {
+        return record_random_movie(argv[2], argv[3], atoi(argv[4]), argc > 5 ? (uint32_t)strtoul(argv[5], 0, 0) : 1);
+    }
+
+    if(strcmp(argv[1], "replay") == 0 && argc >= 4)
+    {
+        return replay_movie(argv[2], argv[3]);
+    }
+
+    print_usage();
+    return 1;
+}
@@ -0,0 +1,188 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_memview.h"
+#include "chip8emu_writelog.h"
+#include "chip8emu_platform.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace c8e
+{
+
+void memview_reset()
+{
+    MemoryView* view = &memview;
+    memcpy(view->previous, c8.memory, sizeof(view->previous));
+    memset(view->changed_frame, 0xFF, sizeof(view->changed_frame));
+    view->last_frame = c8.frame;
+    view->changed = 0;
+    view->primed = true;
+}
+
+int memview_compare()
+{
+    MemoryView* view = &memview;
+    if(!view->primed || c8.frame < view->last_frame)
+    {
+        memview_reset();
+        return 0;
+    }
+
+    uint64_t start_ticks = plat::get_ticks();
+    int changed = 0;
+    // 64 bytes at a time: the XORs are ORed together so an unchanged block is one test. The
+    // compiler turns the inner loop into vector code where it can.
+    for(int block = 0; block < MEMORY_SIZE; block += 64)
+    {
+        uint64_t now[8];
+        uint64_t before[8];
+        memcpy(now, c8.memory + block, 64);
+        memcpy(before, view->previous + block, 64);
+        uint64_t any = 0;
+        for(int w = 0; w < 8; w++)
+            any |= now[w] ^ before[w];
+        if(!any)
+            continue;
+
+        for(int w = 0; w < 8; w++)
+        {
+            uint64_t diff = now[w] ^ before[w];
+            for(int b = 0; diff; b++, diff >>= 8)
+            {
+                if(diff & 0xFF)
+                {
+                    view->changed_frame[block + w*8 + b] = c8.frame;
+                    changed++;
+                }
+            }
+        }
+        memcpy(view->previous + block, now, 64);
+    }
+    view->last_frame = c8.frame;
+    view->changed = changed;
+    view->compare_us = (plat::get_ticks() - start_ticks) * 1000000.0 / plat::get_ticks_per_second();
+    return changed;
+}
+
+#ifdef USE_IMGUI
+static bool g_show_memview = false;
+
+void imgui_memview_menu()
+{
+    if(ImGui::BeginMenu("Debug"))
+    {
+        ImGui::MenuItem("Memory", 0, &g_show_memview);
+        ImGui::EndMenu();
+    }
+}
+
+void imgui_memview_windows()
+{
+    if(!g_show_memview)
+    {
+        memview.primed = false;
+        return;
+    }
+
+    static uint16_t goto_addr = PROGRAM_OFFSET;
+    static int scroll_to_row = -1;
+
+    ImGui::SetNextWindowSize(ImVec2(560, 420), ImGuiCond_FirstUseEver);
+    if(ImGui::Begin("Memory", &g_show_memview))
+    {
+        MemoryView* view = &memview;
+        memview_compare();
+
+        ImGui::SetNextItemWidth(50);
+        ImGui::InputScalar("##goto", ImGuiDataType_U16, &goto_addr, 0, 0, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+        ImGui::SameLine();
+        if(ImGui::Button("Go to"))
+            scroll_to_row = (goto_addr % MEMORY_SIZE) / MEMVIEW_BYTES_PER_ROW;
+        ImGui::SameLine();
+        if(ImGui::Button("Clear highlights"))
+            memview_reset();
+        ImGui::SameLine();
+        ImGui::TextDisabled("%d changed, compared in %.2f us", view->changed, view->compare_us);
+
+        ImGui::BeginChild("bytes", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
+        float row_height = ImGui::GetTextLineHeightWithSpacing();
+        float char_width = ImGui::CalcTextSize("F").x;
+        if(scroll_to_row >= 0)
+        {
+            ImGui::SetScrollY(scroll_to_row * row_height);
+            scroll_to_row = -1;
+        }
+
+        ImDrawList* draw = ImGui::GetWindowDrawList();
+        const ImVec4 changed_color = ImVec4(1.0f, 0.75f, 0.2f, 0.6f);
+        const ImU32 pc_color = IM_COL32(80, 200, 120, 255);
+        const ImU32 i_color = IM_COL32(90, 150, 255, 255);
+        const int prefix = 5; // "XXX: "
+        ImGuiListClipper clipper;
+        clipper.Begin(MEMORY_SIZE / MEMVIEW_BYTES_PER_ROW, row_height);
+        while(clipper.Step())
+        {
+            for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+            {
+                int first = row * MEMVIEW_BYTES_PER_ROW;
+                char line[prefix + MEMVIEW_BYTES_PER_ROW*4 + 2];
+                int length = snprintf(line, sizeof(line), "%03X: ", first);
+                for(int b = 0; b < MEMVIEW_BYTES_PER_ROW; b++)
+                    length += snprintf(line + length, sizeof(line) - length, "%02X ", c8.memory[first + b]);
+                line[length++] = ' ';
+                for(int b = 0; b < MEMVIEW_BYTES_PER_ROW; b++)
+                {
+                    uint8_t value = c8.memory[first + b];
+                    line[length++] = value >= 0x20 && value < 0x7F ? (char)value : '.';
+                }
+                line[length] = 0;
+
+                ImVec2 origin = ImGui::GetCursorScreenPos();
+                for(int b = 0; b < MEMVIEW_BYTES_PER_ROW; b++)
+                {
+                    int addr = first + b;
+                    float x = origin.x + (prefix + b*3) * char_width;
+                    ImVec2 min = ImVec2(x - 1, origin.y);
+                    ImVec2 max = ImVec2(x + 2*char_width + 1, origin.y + ImGui::GetTextLineHeight());
+                    uint64_t age = c8.frame - view->changed_frame[addr];
+                    if(view->changed_frame[addr] <= c8.frame && age < (uint64_t)MEMVIEW_FADE_FRAMES)
+                    {
+                        ImVec4 color = changed_color;
+                        color.w *= 1.0f - (float)age / MEMVIEW_FADE_FRAMES;
+                        draw->AddRectFilled(min, max, ImGui::ColorConvertFloat4ToU32(color));
+                    }
+                    if(addr == c8.pc || addr == c8.pc + 1)
+                        draw->AddRect(min, max, pc_color);
+                    else if(addr == c8.i)
+                        draw->AddRect(min, max, i_color);
+                }
+                ImGui::TextUnformatted(line);
+
+                if(ImGui::IsItemHovered())
+                {
+                    int column = (int)((ImGui::GetMousePos().x - origin.x) / char_width) - prefix;
+                    if(column >= 0 && column < MEMVIEW_BYTES_PER_ROW*3)
+                    {
+                        int addr = first + column / 3;
+                        ImGui::BeginTooltip();
+                        ImGui::Text("%03X: %02X (%d)", addr, c8.memory[addr], c8.memory[addr]);
+                        if(view->changed_frame[addr] <= c8.frame)
+                            ImGui::Text("Changed in frame %llu", (unsigned long long)view->changed_frame[addr]);
+                        MemoryWrite write;
+                        if(write_log.file && write_log_last(&write_log, (uint16_t)addr, c8.cycle, &write))
+                            ImGui::Text("Last written by %03X at cycle %llu", write.pc, (unsigned long long)write.cycle);
+                        ImGui::EndTooltip();
+                    }
+                }
+            }
+        }
+        ImGui::EndChild();
+    }
+    ImGui::End();
+}
+#else
+#define imgui_memview_menu(...)
+#define imgui_memview_windows(...)
+#endif
+
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+
+namespace c8e
+{
+// Hex view of memory that highlights bytes as they change and fades them out over
+// MEMVIEW_FADE_FRAMES emulated frames. While the window is open, memview_compare XORs memory
+// against the copy from last time a word at a time, and only the words that differ are looked
+// at byte by byte. So the cost does not depend on how many writes the program does, and nothing
+// is added to the write path. Going back in time starts over without highlights.
+const int MEMVIEW_BYTES_PER_ROW = 16;
+const int MEMVIEW_FADE_FRAMES = 60;
+
+struct MemoryView
+{
+	bool primed; // previous holds memory as of last_frame
+	uint8_t previous[MEMORY_SIZE];
+	uint64_t changed_frame[MEMORY_SIZE]; // UINT64_MAX for never
+	uint64_t last_frame;
+
+	int changed; // bytes found changed by the last compare
+	double compare_us;
+};
+
+MemoryView memview;
+
+void memview_reset();
+int memview_compare(); // returns the number of bytes changed
+
+void imgui_memview_menu();
+void imgui_memview_windows();
+};
@@ -0,0 +1,379 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_movie.h"
+#include "chip8emu_debugger.h"
+#include "chip8emu_platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace c8e
+{
+
+static inline uint16_t pack_keys()
+{
+    uint16_t keys = 0;
+    for(int k = 0; k < 16; k++)
+    {
+        keys |= (uint16_t)((c8.keys[k] != 0) << k);
+    }
+    return keys;
+}
+
+static inline void unpack_keys(uint16_t keys)
+{
+    for(int k = 0; k < 16; k++)
+    {
+        c8.keys[k] = (keys >> k) & 1;
+    }
+}
+
+static bool reserve_bytes(Movie* movie, size_t count)
+{
+    if(movie->size + count <= movie->capacity)
+        return true;
+
+    size_t capacity = movie->capacity ? movie->capacity : 4096;
+    while(capacity < movie->size + count)
+        capacity *= 2;
+
+    uint8_t* data = (uint8_t*)realloc(movie->data, capacity);
+    if(!data)
+        return false;
+    movie->data = data;
+    movie->capacity = capacity;
+    return true;
+}
+
+static void write_bytes(Movie* movie, const void* bytes, size_t count)
+{
+    if(!reserve_bytes(movie, count))
+        return;
+    memcpy(movie->data + movie->size, bytes, count);
+    movie->size += count;
+}
+
+// Writes a record header: tag, then the frame delta (and cycle delta for keys).
+static void write_record(Movie* movie, int tag)
+{
+    if(!reserve_bytes(movie, 1 + 10 + 10))
+        return;
+    uint8_t* out = movie->data + movie->size;
+    *out++ = (uint8_t)tag;
+    out = write_varint(out, movie->frame - movie->last_frame);
+    if(tag == MOVIE_KEYS)
+    {
+        uint64_t cycle = c8.cycle - movie->start_cycle;
+        out = write_varint(out, cycle - movie->last_cycle);
+        movie->last_cycle = cycle;
+    }
+    movie->size = out - movie->data;
+    movie->last_frame = movie->frame;
+}
+
+bool movie_record_start(Movie* movie, bool from_snapshot, int hash_interval)
+{
+    movie_free(movie);
+
+    if(!from_snapshot)
+    {
+        reset();
+        c8.loaded = true;
+    }
+
+    MovieHeader* header = &movie->header;
+    memcpy(header->magic, MOVIE_MAGIC, 4);
+    header->version = MOVIE_VERSION;
+    header->hash_interval = (uint16_t)hash_interval;
+    header->rom_hash = hash_rom();
+    header->quirks = 0;
+    header->seed = c8.seed;
+    header->ips = c8.ips;
+    header->flags = from_snapshot ? MOVIE_FROM_SNAPSHOT : 0;
+    write_bytes(movie, header, sizeof(*header));
+
+    if(from_snapshot)
+    {
+        Snapshot snapshot;
+        save_snapshot(&snapshot);
+        write_bytes(movie, &snapshot, sizeof(snapshot));
+    }
+    if(!movie->data)
+    {
+        return false;
+    }
+
+    movie->mode = MOVIE_RECORDING;
+    movie->start_cycle = c8.cycle;
+    movie->keys = pack_keys();
+
+    // The first record always carries the starting keys.
+    write_record(movie, MOVIE_KEYS);
+    write_bytes(movie, &movie->keys, sizeof(movie->keys));
+    return true;
+}
+
+void movie_record_stop(Movie* movie)
+{
+    if(movie->mode != MOVIE_RECORDING)
+        return;
+    write_record(movie, MOVIE_END);
+    movie->mode = MOVIE_OFF;
+}
+
+// A record cut short, or data ending without a MOVIE_END record, ends playback as corrupt.
+static void read_next_record(Movie* movie)
+{
+    const uint8_t* in = movie->data + movie->read_pos;
+    const uint8_t* end = movie->data + movie->size;
+    uint64_t delta;
+    if(in >= end || !(in = read_varint_bounded(in + 1, end, &delta)))
+        goto corrupt;
+    movie->next_tag = movie->data[movie->read_pos];
+    movie->next_frame = movie->last_frame + delta;
+    movie->last_frame = movie->next_frame;
+
+    switch(movie->next_tag)
+    {
+        case MOVIE_KEYS:
+            if(!(in = read_varint_bounded(in, end, &delta)) || end - in < (ptrdiff_t)sizeof(movie->next_keys))
+                goto corrupt;
+            movie->next_cycle = movie->last_cycle + delta;
+            movie->last_cycle = movie->next_cycle;
+            memcpy(&movie->next_keys, in, sizeof(movie->next_keys));
+            in += sizeof(movie->next_keys);
+            break;
+        case MOVIE_HASH:
+            if(end - in < (ptrdiff_t)sizeof(movie->next_hash))
+                goto corrupt;
+            memcpy(&movie->next_hash, in, sizeof(movie->next_hash));
+            in += sizeof(movie->next_hash);
+            break;
+        case MOVIE_END:
+            break;
+        default:
+            goto corrupt;
+    }
+    movie->read_pos = in - movie->data;
+    return;
+
+corrupt:
+    movie->corrupt = true;
+    movie->next_tag = MOVIE_END;
+    movie->next_frame = movie->last_frame;
+    movie->read_pos = movie->size;
+}
+
+// Starts playing a movie from memory that must outlive playback. Fails if the header is
+// malformed or was recorded against a different ROM; movie->error then says which.
+bool movie_play_start(Movie* movie, const void* data, size_t size)
+{
+    movie_free(movie);
+
+    movie->error = "not a movie file, or a truncated one";
+    if(size < sizeof(MovieHeader))
+        return false;
+    memcpy(&movie->header, data, sizeof(MovieHeader));
+    MovieHeader* header = &movie->header;
+    if(memcmp(header->magic, MOVIE_MAGIC, 4) != 0)
+        return false;
+    movie->error = "recorded by another version";
+    if(header->version != MOVIE_VERSION)
+        return false;
+    movie->error = "recorded for another ROM";
+    if(header->rom_hash != hash_rom())
+        return false;
+    movie->error = "truncated";
+
+    size_t pos = sizeof(MovieHeader);
+    c8.seed = header->seed;
+    reset();
+    c8.ips = header->ips;
+    c8.loaded = true;
+    if(header->flags & MOVIE_FROM_SNAPSHOT)
+    {
+        if(size < pos + sizeof(Snapshot))
+            return false;
+        Snapshot snapshot;
+        memcpy(&snapshot, (const uint8_t*)data + pos, sizeof(snapshot));
+        load_snapshot(&snapshot);
+        pos += sizeof(Snapshot);
+    }
+
+    movie->error = 0;
+    movie->mode = MOVIE_PLAYING;
+    movie->data = (uint8_t*)data;
+    movie->size = size;
+    movie->read_pos = pos;
+    movie->start_cycle = c8.cycle;
+    read_next_record(movie);
+    return true;
+}
+
+void movie_free(Movie* movie)
+{
+    if(movie->capacity)
+    {
+        free(movie->data);
+    }
+    memset(movie, 0, sizeof(*movie));
+}
+
+// Runs one frame under the movie: logs or applies key changes before it, and records or
+// checks the chained display hash after it.
+int movie_run_frame(Movie* movie)
+{
+    if(movie->mode == MOVIE_RECORDING)
+    {
+        uint16_t keys = pack_keys();
+        if(keys != movie->keys)
+        {
+            movie->keys = keys;
+            write_record(movie, MOVIE_KEYS);
+            write_bytes(movie, &keys, sizeof(keys));
+        }
+    }
+    else if(movie->mode == MOVIE_PLAYING)
+    {
+        while(movie->next_tag == MOVIE_KEYS && movie->next_frame == movie->frame)
+        {
+            if(movie->next_cycle != c8.cycle - movie->start_cycle && !movie->desynced)
+            {
+                movie->desynced = true;
+                movie->desync_frame = movie->frame;
+            }
+            movie->keys = movie->next_keys;
+            read_next_record(movie);
+        }
+        unpack_keys(movie->keys);
+    }
+
+    int ops = run_frame();
+    if(debugger.frame_ops_left == 0)
+    {
+        movie_end_frame(movie);
+    }
+    return ops;
+}
+
+// The rest of movie_run_frame, once the frame is done. A breakpoint can stop it halfway, and
+// then this runs when the debugger finishes it.
+void movie_end_frame(Movie* movie)
+{
+    movie->frame++;
+
+    int interval = movie->header.hash_interval;
+    if(interval && movie->frame % interval == 0)
+    {
+        uint64_t display_hash = hash_display();
+        movie->chain = hash64(&display_hash, sizeof(display_hash), movie->chain);
+        if(movie->mode == MOVIE_RECORDING)
+        {
+            write_record(movie, MOVIE_HASH);
+            write_bytes(movie, &movie->chain, sizeof(movie->chain));
+        }
+        else if(movie->mode == MOVIE_PLAYING && movie->next_tag == MOVIE_HASH && movie->next_frame == movie->frame)
+        {
+            if(movie->next_hash != movie->chain && !movie->desynced)
+            {
+                movie->desynced = true;
+                movie->desync_frame = movie->frame;
+            }
+            read_next_record(movie);
+        }
+    }
+
+    if(movie->mode == MOVIE_PLAYING && movie->next_tag == MOVIE_END && movie->frame >= movie->next_frame)
+    {
+        movie->finished = true;
+        movie->mode = MOVIE_OFF;
+    }
+}
+
+#ifdef USE_IMGUI
+void imgui_movie(Movie* movie)
+{
+    static plat::FileContents playing = {0};
+
+    if(ImGui::BeginMenu("Movie"))
+    {
+        if(movie->mode == MOVIE_OFF)
+        {
+            if(ImGui::MenuItem("Record from reset", 0, false, c8.loaded))
+            {
+                movie_record_start(movie, false, 60);
+            }
+            if(ImGui::MenuItem("Record from here", 0, false, c8.loaded))
+            {
+                movie_record_start(movie, true, 60);
+            }
+            if(ImGui::MenuItem("Play...", 0, false, c8.loaded))
+            {
+                plat::FilePath path = {0};
+                if(plat::show_file_prompt(&path, "c8m"))
+                {
+                    if(playing.data)
+                    {
+                        plat::unload_file(playing);
+                    }
+                    playing = plat::load_entire_file(path);
+                    bool started = playing.data && movie_play_start(movie, playing.data, playing.len);
+                    if(!started)
+                    {
+                        if(playing.data)
+                        {
+                            plat::unload_file(playing);
+                        }
+                        else
+                        {
+                            movie_free(movie);
+                            movie->error = "could not read the file";
+                        }
+                        memset(&playing, 0, sizeof(playing));
+                    }
+                }
+                plat::unload_path(path);
+            }
+        }
+        else if(movie->mode == MOVIE_RECORDING)
+        {
+            if(ImGui::MenuItem("Stop and save..."))
+            {
+                movie_record_stop(movie);
+                plat::FilePath path = {0};
+                if(plat::show_save_prompt(&path, "c8m"))
+                {
+                    plat::write_entire_file(path, movie->data, movie->size);
+                }
+                plat::unload_path(path);
+                movie_free(movie);
+            }
+        }
+        else if(ImGui::MenuItem("Stop playing"))
+        {
+            movie->mode = MOVIE_OFF;
+        }
+
+        if(movie->mode != MOVIE_OFF)
+        {
+            ImGui::Text("Frame %llu", (unsigned long long)movie->frame);
+        }
+        if(movie->desynced)
+        {
+            ImGui::Text("Desynced at frame %llu", (unsigned long long)movie->desync_frame);
+        }
+        if(movie->error)
+        {
+            ImGui::Text("Could not play the movie: %s", movie->error);
+        }
+        if(movie->corrupt)
+        {
+            ImGui::Text("Movie file is corrupt, stopped at frame %llu", (unsigned long long)movie->frame);
+        }
+        ImGui::EndMenu();
+    }
+}
+#else
+#define imgui_movie(...)
+#endif
+
+};
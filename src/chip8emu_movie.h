@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+
+namespace c8e
+{
+
+// Movie files: a MovieHeader, an optional Snapshot to start from, then a stream of records.
+// Each record is a tag byte followed by the frame (and for keys, the cycle) as varint deltas
+// against the previous record, then its payload.
+const char MOVIE_MAGIC[4] = {'C', '8', 'M', 'V'};
+const uint16_t MOVIE_VERSION = 2;
+
+enum MovieRecord
+{
+	MOVIE_KEYS = 1, // varint frame delta, varint cycle delta, u16 keys
+	MOVIE_HASH = 2, // varint frame delta, u64 chain of hash_display() values
+	MOVIE_END  = 3, // varint frame delta
+};
+
+struct MovieHeader
+{
+	char magic[4];
+	uint16_t version;
+	uint16_t hash_interval; // frames between MOVIE_HASH records
+	uint64_t rom_hash;
+	uint32_t quirks; // there are no quirk profiles yet, always 0
+	uint32_t seed;
+	int64_t ips;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+const uint32_t MOVIE_FROM_SNAPSHOT = 1; // a Snapshot follows the header, otherwise the movie starts from reset()
+
+enum MovieMode
+{
+	MOVIE_OFF,
+	MOVIE_RECORDING,
+	MOVIE_PLAYING,
+};
+
+struct Movie
+{
+	MovieMode mode;
+
+	uint8_t* data;
+	size_t size;
+	size_t capacity; // 0 while playing, the data is borrowed
+	size_t read_pos;
+
+	MovieHeader header;
+	uint64_t frame; // frames since the movie started
+	uint64_t start_cycle;
+	uint64_t last_frame; // of the last record written or read
+	uint64_t last_cycle;
+	uint16_t keys;
+	uint64_t chain; // chained display hash
+
+	// Next record while playing.
+	int next_tag;
+	uint64_t next_frame;
+	uint64_t next_cycle;
+	uint16_t next_keys;
+	uint64_t next_hash;
+
+	bool finished;
+	bool desynced;
+	bool corrupt; // a record ran past the end of the data, or the end record is missing
+	const char* error; // why movie_play_start refused the data, 0 otherwise
+	uint64_t desync_frame;
+};
+
+bool movie_record_start(Movie* movie, bool from_snapshot, int hash_interval);
+void movie_record_stop(Movie* movie);
+bool movie_play_start(Movie* movie, const void* data, size_t size);
+void movie_free(Movie* movie);
+int movie_run_frame(Movie* movie);
+void movie_end_frame(Movie* movie);
+void imgui_movie(Movie* movie);
+
+Movie movie_state;
+};
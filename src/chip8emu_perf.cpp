@@ -0,0 +1,157 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_perf.h"
+#include "chip8emu_platform.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace c8e
+{
+
+void perf_reset()
+{
+    memset(&perf_stats, 0, sizeof(perf_stats));
+}
+
+void perf_push(PerfMetric metric, float value)
+{
+    PerfHistory* history = &perf_stats.history[metric];
+    history->values[history->head] = value;
+    history->head = (history->head + 1) % PERF_HISTORY_SIZE;
+    if(history->count < PERF_HISTORY_SIZE)
+        history->count++;
+}
+
+static float ticks_to_ms(uint64_t ticks)
+{
+    return (float)(ticks * 1000.0 / plat::get_ticks_per_second());
+}
+
+// Call with the emulation lock held, after the frame ran.
+void perf_emu_frame(int ops, uint64_t start_ticks, uint64_t end_ticks, uint64_t lock_wait_ticks)
+{
+    if(perf_stats.last_frame_ticks)
+    {
+        uint64_t interval = start_ticks - perf_stats.last_frame_ticks;
+        perf_push(PERF_FRAME_INTERVAL_MS, ticks_to_ms(interval));
+        if(interval > 0)
+            perf_push(PERF_ACHIEVED_IPS, (float)(ops * (double)plat::get_ticks_per_second() / interval));
+    }
+    perf_stats.last_frame_ticks = start_ticks;
+    perf_push(PERF_TARGET_IPS, (float)c8.ips);
+    perf_push(PERF_EMU_MS, ticks_to_ms(end_ticks - start_ticks));
+    perf_push(PERF_EMU_LOCK_WAIT_MS, ticks_to_ms(lock_wait_ticks));
+
+    uint64_t hash = hash_display();
+    if(hash != perf_stats.last_display_hash)
+    {
+        perf_stats.last_display_hash = hash;
+        // Nothing counts as dropped before the first present (or without a presenter).
+        if(perf_stats.last_present_ticks && perf_stats.display_frames > perf_stats.presented_display_frames)
+            perf_stats.dropped++;
+        perf_stats.display_frames++;
+    }
+}
+
+// Call with the emulation lock held, right after presenting.
+void perf_present(uint64_t ticks, uint64_t lock_wait_ticks)
+{
+    if(perf_stats.last_present_ticks)
+    {
+        perf_push(PERF_PRESENT_INTERVAL_MS, ticks_to_ms(ticks - perf_stats.last_present_ticks));
+    }
+    perf_stats.last_present_ticks = ticks;
+    perf_push(PERF_UI_LOCK_WAIT_MS, ticks_to_ms(lock_wait_ticks));
+
+    if(perf_stats.display_frames == perf_stats.presented_display_frames)
+        perf_stats.duplicated++;
+    perf_stats.presented_display_frames = perf_stats.display_frames;
+}
+
+void get_perf_summary(PerfSummary* summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    for(int m = 0; m < PERF_METRIC_COUNT; m++)
+    {
+        PerfHistory* history = &perf_stats.history[m];
+        summary->count[m] = history->count;
+        if(!history->count)
+            continue;
+
+        double sum = 0.0;
+        summary->min[m] = summary->max[m] = history->values[0];
+        for(int n = 0; n < history->count; n++)
+        {
+            float value = history->values[n];
+            sum += value;
+            if(value < summary->min[m])
+                summary->min[m] = value;
+            if(value > summary->max[m])
+                summary->max[m] = value;
+        }
+        summary->mean[m] = (float)(sum / history->count);
+    }
+    summary->dropped = perf_stats.dropped;
+    summary->duplicated = perf_stats.duplicated;
+}
+
+#ifdef USE_IMGUI
+static bool g_show_perf_overlay = false;
+
+static void imgui_perf_plot(const char* label, PerfMetric metric, float scale_max, const char* format)
+{
+    PerfHistory* history = &perf_stats.history[metric];
+    int offset = history->count < PERF_HISTORY_SIZE ? 0 : history->head;
+    float last = history->count ? history->values[(history->head + PERF_HISTORY_SIZE - 1) % PERF_HISTORY_SIZE] : 0.0f;
+
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), format, last);
+    ImGui::PlotLines(label, history->values, history->count, offset, overlay, 0.0f, scale_max, ImVec2(240, 40));
+}
+
+void imgui_perf_menu()
+{
+    ImGui::MenuItem("Performance overlay", 0, &g_show_perf_overlay);
+}
+
+void imgui_perf_overlay()
+{
+    if(!g_show_perf_overlay)
+        return;
+
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(ImVec2(viewport->WorkPos.x + viewport->WorkSize.x - 10.0f, viewport->WorkPos.y + 10.0f), ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::SetNextWindowBgAlpha(0.35f);
+    ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
+                             ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove;
+    if(ImGui::Begin("Performance overlay", &g_show_perf_overlay, flags))
+    {
+        PerfSummary summary;
+        get_perf_summary(&summary);
+
+        // Target ips as the top of the scale, so falling behind shows as a dip.
+        float target = summary.max[PERF_TARGET_IPS] > 0.0f ? summary.max[PERF_TARGET_IPS] : 1.0f;
+        imgui_perf_plot("ips", PERF_ACHIEVED_IPS, target * 1.25f, "%.0f");
+        ImGui::Text("target %.0f, mean %.0f, min %.0f", target, summary.mean[PERF_ACHIEVED_IPS], summary.min[PERF_ACHIEVED_IPS]);
+
+        imgui_perf_plot("emu ms", PERF_EMU_MS, 16.7f, "%.3f ms");
+        imgui_perf_plot("frame ms", PERF_FRAME_INTERVAL_MS, 33.3f, "%.2f ms");
+        imgui_perf_plot("present ms", PERF_PRESENT_INTERVAL_MS, 33.3f, "%.2f ms");
+        ImGui::Text("dropped %llu, duplicated %llu", (unsigned long long)summary.dropped, (unsigned long long)summary.duplicated);
+
+        imgui_perf_plot("emu lock wait", PERF_EMU_LOCK_WAIT_MS, 4.0f, "%.3f ms");
+        imgui_perf_plot("ui lock wait", PERF_UI_LOCK_WAIT_MS, 4.0f, "%.3f ms");
+
+        if(ImGui::SmallButton("Reset"))
+        {
+            perf_reset();
+        }
+    }
+    ImGui::End();
+}
+#else
+#define imgui_perf_menu(...)
+#define imgui_perf_overlay(...)
+#endif
+
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+
+namespace c8e
+{
+// Host-side frame statistics kept in rolling buffers for the overlay. The emulation thread
+// reports each frame and the UI thread each present, both with the emulation lock held, so
+// the buffers need no locking of their own.
+const int PERF_HISTORY_SIZE = 240; // 4 seconds of frames
+
+enum PerfMetric
+{
+	PERF_ACHIEVED_IPS, // instructions over wall time since the previous frame
+	PERF_TARGET_IPS,
+	PERF_EMU_MS, // time spent emulating the frame, including run-ahead
+	PERF_FRAME_INTERVAL_MS,
+	PERF_PRESENT_INTERVAL_MS,
+	PERF_EMU_LOCK_WAIT_MS,
+	PERF_UI_LOCK_WAIT_MS,
+	PERF_METRIC_COUNT
+};
+
+const char* PERF_METRIC_NAMES[PERF_METRIC_COUNT] =
+{
+	"achieved_ips", "target_ips", "emu_ms", "frame_interval_ms", "present_interval_ms", "emu_lock_wait_ms", "ui_lock_wait_ms",
+};
+
+struct PerfHistory
+{
+	float values[PERF_HISTORY_SIZE];
+	int head; // next slot to write
+	int count;
+};
+
+struct PerfStats
+{
+	PerfHistory history[PERF_METRIC_COUNT];
+
+	// A frame is dropped when its display change is overwritten before being presented,
+	// and duplicated when a present shows nothing new.
+	uint64_t display_frames; // frames that changed the display
+	uint64_t presented_display_frames; // display_frames at the last present
+	uint64_t dropped;
+	uint64_t duplicated;
+	uint64_t last_display_hash;
+
+	uint64_t last_frame_ticks;
+	uint64_t last_present_ticks;
+};
+
+struct PerfSummary
+{
+	int count[PERF_METRIC_COUNT];
+	float mean[PERF_METRIC_COUNT];
+	float min[PERF_METRIC_COUNT];
+	float max[PERF_METRIC_COUNT];
+	uint64_t dropped;
+	uint64_t duplicated;
+};
+
+PerfStats perf_stats;
+
+void perf_reset();
+void perf_push(PerfMetric metric, float value);
+void perf_emu_frame(int ops, uint64_t start_ticks, uint64_t end_ticks, uint64_t lock_wait_ticks);
+void perf_present(uint64_t ticks, uint64_t lock_wait_ticks);
+void get_perf_summary(PerfSummary* summary);
+
+void imgui_perf_menu();
+void imgui_perf_overlay();
+};
@@ -1,4 +1,6 @@
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
 
 namespace plat 
 {
@@ -10,12 +12,32 @@ struct FPtr
 };
 typedef FPtr<char> FilePath;
 typedef FPtr<void> FileContents;
+typedef void* FileHandle; // 0 when the file could not be opened
 
-bool show_file_prompt(FilePath* path);
+bool show_file_prompt(FilePath* path, const char* extension); // extension without the dot
+bool show_save_prompt(FilePath* path, const char* extension);
 void unload_path(FilePath path);
 
 FileContents load_entire_file(FilePath path);
 void unload_file(FileContents contents);
+bool write_entire_file(FilePath path, const void* data, size_t size);
+
+// Read-only, for files too big to load. unload_file must not be used on these.
+FileContents map_file(FilePath path);
+void unmap_file(FileContents contents);
+
+// For files written a piece at a time, like traces.
+FileHandle open_file_for_writing(FilePath path);
+bool write_file(FileHandle file, const void* data, size_t size);
+void close_file(FileHandle file);
+
+// Scratch files, read and written at any offset and deleted when closed.
+FileHandle open_temp_file();
+bool read_file_at(FileHandle file, uint64_t offset, void* data, size_t size);
+bool write_file_at(FileHandle file, uint64_t offset, const void* data, size_t size);
 
 void update_input();
+
+uint64_t get_ticks();
+uint64_t get_ticks_per_second();
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+// USDT static tracepoints (systemtap sys/sdt.h) in the core. Each one is a single NOP until a
+// tracer attaches, so they stay in release builds. Compile out with -DNO_PROBES.
+//
+//   chip8emu:frame_start      frame, ops          chip8emu:frame_end      frame, ops
+//   chip8emu:load_rom         size                chip8emu:reset
+//   chip8emu:key_wait_block   pc, x               chip8emu:key_wait_unblock  pc, key
+//   chip8emu:timer_expired    timer (0 = delay, 1 = sound), frame
+//   chip8emu:display_update   pc, frame
+//
+// e.g. bpftrace -e 'usdt:./main_headless:chip8emu:frame_end { @ops = hist(arg1); }'
+#if defined(__linux__) && !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define USE_PROBES
+#endif
+#endif
+
+#ifdef USE_PROBES
+#define C8E_PROBE(name) DTRACE_PROBE(chip8emu, name)
+#define C8E_PROBE1(name, a) DTRACE_PROBE1(chip8emu, name, a)
+#define C8E_PROBE2(name, a, b) DTRACE_PROBE2(chip8emu, name, a, b)
+#else
+#define C8E_PROBE(name)
+#define C8E_PROBE1(name, a)
+#define C8E_PROBE2(name, a, b)
+#endif
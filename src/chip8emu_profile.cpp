@@ -0,0 +1,362 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_profile.h"
+#include "chip8emu_platform.h"
+#include "chip8emu_zones.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace c8e
+{
+
+#ifdef USE_OP_COUNTERS
+// op_class of every opcode, so counting a class is one load. Filled by the first timed op, which
+// is the first op after a reset.
+static uint8_t g_op_class_table[0x10000];
+static bool g_op_class_table_filled = false;
+
+static void time_op(uint16_t op)
+{
+    if(!g_op_class_table_filled)
+    {
+        for(uint32_t n = 0; n < 0x10000; n++)
+            g_op_class_table[n] = (uint8_t)op_class((uint16_t)n);
+        g_op_class_table_filled = true;
+    }
+    OpClass cls = (OpClass)g_op_class_table[op];
+    op_counters.class_count[cls]++;
+
+    uint64_t start = plat::get_ticks();
+    execute_op(op);
+    uint64_t ticks = plat::get_ticks() - start;
+    op_counters.sampled_ticks[cls] += ticks;
+    op_counters.samples[cls]++;
+    int bucket = 0;
+    while(bucket < OP_HISTOGRAM_BUCKETS - 1 && ticks + 1 >= (2ull << bucket))
+        bucket++;
+    op_counters.histogram[cls][bucket]++;
+
+    // Uniform in [1, 2*OP_TIMING_INTERVAL), so one in OP_TIMING_INTERVAL on average.
+    uint32_t r = op_counters.rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    op_counters.rng = r;
+    op_counters.next_sample = 1 + r % (2*OP_TIMING_INTERVAL - 1);
+}
+
+static inline void count_op(uint16_t op)
+{
+    op_counters.pc_count[c8.pc]++;
+    if(--op_counters.next_sample == 0)
+    {
+        time_op(op);
+        return;
+    }
+    op_counters.class_count[g_op_class_table[op]]++;
+    execute_op(op);
+}
+
+// The first round warms the clock up and is thrown away.
+static double measure_timer_overhead()
+{
+    const int pairs = 4096;
+    uint64_t ticks = 0;
+    for(int round = 0; round < 2; round++)
+    {
+        ticks = 0;
+        for(int n = 0; n < pairs; n++)
+        {
+            uint64_t start = plat::get_ticks();
+            ticks += plat::get_ticks() - start;
+        }
+    }
+    return (double)ticks / pairs;
+}
+
+void reset_op_counters()
+{
+    memset(&op_counters, 0, sizeof(op_counters));
+    op_counters.rng = 0x9E3779B9;
+    op_counters.next_sample = 1;
+    op_counters.overhead_ticks = measure_timer_overhead();
+}
+
+static int compare_op_class_stats(const void* a, const void* b)
+{
+    uint64_t ca = ((const OpClassStats*)a)->count;
+    uint64_t cb = ((const OpClassStats*)b)->count;
+    return (ca < cb) - (ca > cb);
+}
+
+int get_op_class_stats(OpClassStats* stats)
+{
+    if(op_counters.overhead_ticks == 0.0)
+        op_counters.overhead_ticks = measure_timer_overhead();
+    double ticks_per_second = (double)plat::get_ticks_per_second();
+    int ran = 0;
+    for(int n = 0; n < OP_CLASS_COUNT; n++)
+    {
+        stats[n].op_class = (OpClass)n;
+        stats[n].count = op_counters.class_count[n];
+        stats[n].seconds = 0.0;
+        if(op_counters.samples[n])
+        {
+            double ticks_per_op = (double)op_counters.sampled_ticks[n] / op_counters.samples[n] - op_counters.overhead_ticks;
+            if(ticks_per_op > 0.0)
+                stats[n].seconds = ticks_per_op / ticks_per_second * stats[n].count;
+        }
+        ran += stats[n].count != 0;
+    }
+
+    qsort(stats, OP_CLASS_COUNT, sizeof(*stats), compare_op_class_stats);
+    return ran;
+}
+
+// The most executed addresses, hottest first.
+int get_hot_pcs(uint16_t* pcs, int max_pcs)
+{
+    int count = 0;
+    for(int pc = 0; pc < MEMORY_SIZE; pc++)
+    {
+        uint64_t hits = op_counters.pc_count[pc];
+        if(!hits)
+            continue;
+
+        // Insertion into a short sorted list.
+        int at = count < max_pcs ? count++ : max_pcs;
+        while(at > 0 && op_counters.pc_count[pcs[at - 1]] < hits)
+        {
+            if(at < max_pcs)
+                pcs[at] = pcs[at - 1];
+            at--;
+        }
+        if(at < max_pcs)
+            pcs[at] = (uint16_t)pc;
+    }
+    return count;
+}
+#endif
+
+// For the platform's periodic timer (timer thread, signal handler, ...). Racy on purpose: a torn or
+// stale pc only misplaces one sample. A paused guest would pile every sample onto one address.
+void sample_guest_from_timer()
+{
+    if(!sampler.enabled.load(std::memory_order_relaxed) || debugger.paused)
+        return;
+    uint16_t pc = *(volatile uint16_t*)&c8.pc;
+    uint16_t i = *(volatile uint16_t*)&c8.i;
+    sampler.pc_samples[pc % MEMORY_SIZE].fetch_add(1, std::memory_order_relaxed);
+    sampler.i_samples[i % MEMORY_SIZE].fetch_add(1, std::memory_order_relaxed);
+    sampler.total.fetch_add(1, std::memory_order_relaxed);
+}
+
+void reset_sampler()
+{
+    for(int a = 0; a < MEMORY_SIZE; a++)
+    {
+        sampler.pc_samples[a].store(0, std::memory_order_relaxed);
+        sampler.i_samples[a].store(0, std::memory_order_relaxed);
+    }
+    sampler.total.store(0, std::memory_order_relaxed);
+}
+
+// The most sampled code addresses, hottest first.
+int get_hot_samples(uint16_t* addresses, int max_addresses)
+{
+    int count = 0;
+    for(int pc = 0; pc < MEMORY_SIZE; pc++)
+    {
+        uint32_t hits = sampler.pc_samples[pc];
+        if(!hits)
+            continue;
+
+        int at = count < max_addresses ? count++ : max_addresses;
+        while(at > 0 && sampler.pc_samples[addresses[at - 1]] < hits)
+        {
+            if(at < max_addresses)
+                addresses[at] = addresses[at - 1];
+            at--;
+        }
+        if(at < max_addresses)
+            addresses[at] = (uint16_t)pc;
+    }
+    return count;
+}
+
+#ifdef USE_IMGUI
+#ifdef USE_OP_COUNTERS
+static bool g_show_op_counters = false;
+#endif
+static bool g_show_guest_profile = false;
+
+// 64x64 cells, one per byte of memory, shaded by log(samples).
+static void imgui_heatmap(const std::atomic<uint32_t>* samples)
+{
+    const float cell = 5.0f;
+    ImDrawList* draw_list = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("heatmap", ImVec2(cell*64, cell*64));
+
+    uint32_t max_samples = 1;
+    for(int a = 0; a < MEMORY_SIZE; a++)
+    {
+        if(samples[a] > max_samples)
+            max_samples = samples[a];
+    }
+    float scale = 1.0f / logf(1.0f + max_samples);
+
+    for(int a = 0; a < MEMORY_SIZE; a++)
+    {
+        if(!samples[a])
+            continue;
+        float t = logf(1.0f + samples[a]) * scale;
+        ImVec2 min = ImVec2(origin.x + (a % 64)*cell, origin.y + (a / 64)*cell);
+        ImVec2 max = ImVec2(min.x + cell, min.y + cell);
+        draw_list->AddRectFilled(min, max, ImGui::ColorConvertFloat4ToU32(ImVec4(t, t*0.5f, 1.0f - t, 1.0f)));
+    }
+
+    if(ImGui::IsItemHovered())
+    {
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+        int col = (int)((mouse.x - origin.x) / cell);
+        int row = (int)((mouse.y - origin.y) / cell);
+        if(col >= 0 && col < 64 && row >= 0 && row < 64)
+        {
+            int a = row*64 + col;
+            char text[32];
+            disassemble((c8.memory[a] << 8) | c8.memory[(a + 1) % MEMORY_SIZE], text, sizeof(text));
+            ImGui::SetTooltip("%03X: %u samples\n%s", a, samples[a].load(), text);
+        }
+    }
+}
+
+void imgui_profile_menu()
+{
+    ImGui::MenuItem("Guest profile", 0, &g_show_guest_profile);
+#ifdef USE_OP_COUNTERS
+    ImGui::MenuItem("Op counters", 0, &g_show_op_counters);
+#endif
+#ifdef USE_ZONES
+    ImGui::Separator();
+    bool record_zones = zone_state.enabled.load();
+    if(ImGui::MenuItem("Record zones", 0, &record_zones))
+        zone_state.enabled.store(record_zones);
+    if(ImGui::MenuItem("Save zone trace"))
+    {
+        // The last ZONE_RING_SIZE events of each thread, next to the executable.
+        char name[] = "chip8emu_trace.json";
+        plat::FilePath path = {sizeof(name) - 1, name};
+        zone_write_chrome_trace(path);
+    }
+#endif
+}
+
+void imgui_profile_windows()
+{
+    if(g_show_guest_profile)
+    {
+        if(ImGui::Begin("Guest profile", &g_show_guest_profile))
+        {
+            static bool show_i = false;
+            bool sampling = sampler.enabled.load();
+            if(ImGui::Checkbox("Sampling", &sampling))
+                sampler.enabled.store(sampling);
+            ImGui::SameLine();
+            ImGui::Checkbox("Show I instead of PC", &show_i);
+            ImGui::SameLine();
+            if(ImGui::Button("Reset"))
+            {
+                reset_sampler();
+            }
+            uint32_t total = sampler.total.load();
+            ImGui::Text("%u samples", total);
+
+            imgui_heatmap(show_i ? sampler.i_samples : sampler.pc_samples);
+            ImGui::SameLine();
+
+            ImGui::BeginChild("hot", ImVec2(0, 0));
+            uint16_t addresses[32];
+            int hot = get_hot_samples(addresses, 32);
+            for(int n = 0; n < hot; n++)
+            {
+                uint16_t a = addresses[n];
+                char text[32];
+                disassemble((c8.memory[a] << 8) | c8.memory[(a + 1) % MEMORY_SIZE], text, sizeof(text));
+                ImGui::Text("%03X  %5.1f%%  %s", a, total ? 100.0f * sampler.pc_samples[a].load() / total : 0.0f, text);
+            }
+            ImGui::EndChild();
+        }
+        ImGui::End();
+    }
+
+#ifdef USE_OP_COUNTERS
+    if(g_show_op_counters)
+    {
+        if(ImGui::Begin("Op counters", &g_show_op_counters))
+        {
+            if(ImGui::Button("Reset"))
+            {
+                reset_op_counters();
+            }
+
+            static OpClassStats stats[OP_CLASS_COUNT];
+            int ran = get_op_class_stats(stats);
+            uint64_t total = 0;
+            for(int n = 0; n < ran; n++)
+            {
+                total += stats[n].count;
+            }
+
+            if(ImGui::BeginTable("classes", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders))
+            {
+                ImGui::TableSetupColumn("Class");
+                ImGui::TableSetupColumn("Count");
+                ImGui::TableSetupColumn("Share");
+                ImGui::TableSetupColumn("Est. host ms");
+                ImGui::TableHeadersRow();
+                for(int n = 0; n < ran; n++)
+                {
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(OP_CLASS_NAMES[stats[n].op_class]);
+                    if(ImGui::IsItemHovered() && op_counters.samples[stats[n].op_class])
+                    {
+                        float buckets[OP_HISTOGRAM_BUCKETS];
+                        for(int b = 0; b < OP_HISTOGRAM_BUCKETS; b++)
+                            buckets[b] = (float)op_counters.histogram[stats[n].op_class][b];
+                        ImGui::BeginTooltip();
+                        ImGui::Text("%llu timed, clock overhead %.0f ticks taken off", (unsigned long long)op_counters.samples[stats[n].op_class],
+                                    op_counters.overhead_ticks);
+                        ImGui::PlotHistogram("##ticks", buckets, OP_HISTOGRAM_BUCKETS, 0, "ticks, log2 buckets", 0.0f, FLT_MAX, ImVec2(240, 60));
+                        ImGui::EndTooltip();
+                    }
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%llu", (unsigned long long)stats[n].count);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.1f%%", total ? 100.0 * stats[n].count / total : 0.0);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.3f", stats[n].seconds * 1000.0);
+                }
+                ImGui::EndTable();
+            }
+
+            uint16_t pcs[16];
+            int hot = get_hot_pcs(pcs, 16);
+            ImGui::Text("Hot addresses");
+            for(int n = 0; n < hot; n++)
+            {
+                ImGui::Text("%03X  %llu", pcs[n], (unsigned long long)op_counters.pc_count[pcs[n]]);
+            }
+        }
+        ImGui::End();
+    }
+#endif
+}
+#else
+#define imgui_profile_menu(...)
+#define imgui_profile_windows(...)
+#endif
+
+};
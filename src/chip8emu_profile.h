@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "chip8emu.h"
+
+namespace c8e
+{
+
+#ifdef USE_OP_COUNTERS
+// Compiled in with -DUSE_OP_COUNTERS. Every instruction is counted by address and by class.
+// Host time is read for about one instruction in OP_TIMING_INTERVAL, at random gaps so the
+// samples don't lock onto a loop, and scaled up. What reading the clock costs is measured once
+// and taken off each class's average.
+const uint32_t OP_TIMING_INTERVAL = 256;
+const int OP_HISTOGRAM_BUCKETS = 16; // sampled ticks, bucket n holds [2^n - 1, 2^(n+1) - 1)
+
+struct OpCounters
+{
+	uint64_t pc_count[MEMORY_SIZE];
+	uint64_t class_count[OP_CLASS_COUNT];
+	uint64_t sampled_ticks[OP_CLASS_COUNT];
+	uint64_t samples[OP_CLASS_COUNT];
+	uint32_t histogram[OP_CLASS_COUNT][OP_HISTOGRAM_BUCKETS];
+	uint32_t next_sample; // instructions until the next timed one
+	uint32_t rng;
+	double overhead_ticks; // of a get_ticks pair around nothing
+};
+
+struct OpClassStats
+{
+	OpClass op_class;
+	uint64_t count;
+	double seconds; // estimated from the samples
+};
+
+OpCounters op_counters = {{0}, {0}, {0}, {0}, {{0}}, 1, 0x9E3779B9, 0.0};
+
+static inline void count_op(uint16_t op);
+void reset_op_counters();
+int get_op_class_stats(OpClassStats* stats); // fills OP_CLASS_COUNT entries sorted by count, returns how many ran
+int get_hot_pcs(uint16_t* pcs, int max_pcs);
+#endif
+
+// Statistical profile of where the guest spends its time. A host timer (1 kHz on win32, SIGPROF
+// in headless) calls sample_guest_from_timer, which reads pc and I without taking the emulation
+// lock. The counters are atomic because the timer runs beside the UI thread that resets them.
+// Off until switched on: on win32 the timer needs the system timer resolution raised.
+struct Sampler
+{
+	std::atomic<bool> enabled;
+	std::atomic<uint32_t> pc_samples[MEMORY_SIZE];
+	std::atomic<uint32_t> i_samples[MEMORY_SIZE];
+	std::atomic<uint32_t> total;
+};
+
+Sampler sampler;
+
+void sample_guest_from_timer();
+void reset_sampler();
+int get_hot_samples(uint16_t* addresses, int max_addresses);
+
+void imgui_profile_menu();
+void imgui_profile_windows();
+};
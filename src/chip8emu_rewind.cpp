@@ -0,0 +1,293 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_rewind.h"
+#include "chip8emu_zones.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace c8e
+{
+
+// Worst case for one encoded snapshot: every byte is a literal, plus the run headers.
+static const uint32_t MAX_ENCODED_SIZE = sizeof(Snapshot) + 16;
+
+// Encodes current XOR base as (zero run length, literal length, literal bytes) triples.
+// Most of a frame's delta is zero, so the scan works a word at a time.
+static uint32_t rewind_encode(const Snapshot* current, const Snapshot* base, uint8_t* out)
+{
+    const uint8_t* a = (const uint8_t*)current;
+    const uint8_t* b = (const uint8_t*)base;
+    const uint32_t size = sizeof(Snapshot);
+    uint8_t* start = out;
+
+    uint32_t pos = 0;
+    while(pos < size)
+    {
+        uint32_t zero_start = pos;
+        while(pos + 8 <= size)
+        {
+            uint64_t wa, wb;
+            memcpy(&wa, a + pos, 8);
+            memcpy(&wb, b + pos, 8);
+            if(wa != wb)
+                break;
+            pos += 8;
+        }
+        while(pos < size && a[pos] == b[pos])
+            pos++;
+        uint32_t zeros = pos - zero_start;
+
+        // Literals run until at least 4 equal bytes in a row, since a shorter zero run costs more to encode.
+        uint32_t literal_start = pos;
+        uint32_t equal = 0;
+        while(pos < size && equal < 4)
+        {
+            equal = (a[pos] == b[pos]) ? equal + 1 : 0;
+            pos++;
+        }
+        if(equal)
+        {
+            pos -= equal;
+        }
+        uint32_t literals = pos - literal_start;
+
+        out = write_varint(out, zeros);
+        out = write_varint(out, literals);
+        for(uint32_t n = 0; n < literals; n++)
+        {
+            out[n] = a[literal_start + n] ^ b[literal_start + n];
+        }
+        out += literals;
+    }
+
+    return (uint32_t)(out - start);
+}
+
+// Inverse of rewind_encode: result = base XOR decoded delta. False if a run goes past the end of
+// the entry or of the snapshot, in which case result is partly written.
+static bool rewind_decode(const uint8_t* in, uint32_t in_size, const Snapshot* base, Snapshot* result)
+{
+    if(result != base)
+    {
+        memcpy(result, base, sizeof(Snapshot));
+    }
+    uint8_t* out = (uint8_t*)result;
+    const uint8_t* end = in + in_size;
+
+    uint32_t pos = 0;
+    while(in < end)
+    {
+        uint64_t zeros, literals;
+        in = read_varint_bounded(in, end, &zeros);
+        if(!in)
+            return false;
+        in = read_varint_bounded(in, end, &literals);
+        if(!in)
+            return false;
+        if(zeros > sizeof(Snapshot) - pos || literals > sizeof(Snapshot) - pos - zeros || literals > (uint64_t)(end - in))
+            return false;
+        pos += (uint32_t)zeros;
+        for(uint64_t n = 0; n < literals; n++)
+        {
+            out[pos + n] ^= in[n];
+        }
+        in += literals;
+        pos += (uint32_t)literals;
+    }
+    return true;
+}
+
+bool rewind_init(Rewind* rewind, int max_frames, uint32_t buffer_size)
+{
+    memset(rewind, 0, sizeof(*rewind));
+    if(buffer_size < MAX_ENCODED_SIZE * 2 || max_frames < 2)
+    {
+        return false;
+    }
+
+    rewind->buffer = (uint8_t*)malloc(buffer_size);
+    rewind->entries = (RewindEntry*)malloc(max_frames * sizeof(*rewind->entries));
+    if(!rewind->buffer || !rewind->entries)
+    {
+        rewind_free(rewind);
+        return false;
+    }
+
+    rewind->buffer_size = buffer_size;
+    rewind->max_entries = max_frames;
+    rewind->keyframe_interval = 60;
+    return true;
+}
+
+void rewind_free(Rewind* rewind)
+{
+    free(rewind->buffer);
+    free(rewind->entries);
+    memset(rewind, 0, sizeof(*rewind));
+}
+
+void rewind_clear(Rewind* rewind)
+{
+    rewind->head = 0;
+    rewind->first = 0;
+    rewind->count = 0;
+}
+
+static inline RewindEntry* entry_at(Rewind* rewind, int index)
+{
+    return &rewind->entries[(rewind->first + index) % rewind->max_entries];
+}
+
+static void drop_oldest(Rewind* rewind)
+{
+    // A delta is useless without its keyframe, so the whole group goes.
+    do
+    {
+        rewind->first = (rewind->first + 1) % rewind->max_entries;
+        rewind->count--;
+    }
+    while(rewind->count > 0 && entry_at(rewind, 0)->group_index != 0);
+}
+
+// Makes room for one entry of at most MAX_ENCODED_SIZE bytes at head.
+static void reserve(Rewind* rewind)
+{
+    if(rewind->count == rewind->max_entries)
+    {
+        drop_oldest(rewind);
+    }
+
+    if(rewind->head + MAX_ENCODED_SIZE > rewind->buffer_size)
+    {
+        // Everything past head was written before anything in front of it, so it is the oldest.
+        while(rewind->count > 0 && entry_at(rewind, 0)->offset >= rewind->head)
+        {
+            drop_oldest(rewind);
+        }
+        rewind->head = 0;
+    }
+
+    uint32_t end = rewind->head + MAX_ENCODED_SIZE;
+    while(rewind->count > 0)
+    {
+        RewindEntry* oldest = entry_at(rewind, 0);
+        if(oldest->offset >= end || oldest->offset + oldest->size <= rewind->head)
+            break;
+        drop_oldest(rewind);
+    }
+}
+
+void rewind_push(Rewind* rewind)
+{
+    C8E_ZONE("rewind_push");
+    if(!rewind->buffer)
+        return;
+
+    save_snapshot(&rewind->scratch);
+
+    uint32_t group_index = 0;
+    if(rewind->count > 0)
+    {
+        group_index = entry_at(rewind, rewind->count - 1)->group_index + 1;
+        if(group_index >= (uint32_t)rewind->keyframe_interval)
+            group_index = 0;
+    }
+
+    reserve(rewind);
+    if(rewind->count == 0)
+    {
+        // The group this delta belonged to was just dropped.
+        group_index = 0;
+    }
+
+    uint8_t* out = rewind->buffer + rewind->head;
+    uint32_t size;
+    if(group_index == 0)
+    {
+        static const Snapshot zero = {};
+        size = rewind_encode(&rewind->scratch, &zero, out);
+        memcpy(&rewind->keyframe, &rewind->scratch, sizeof(Snapshot));
+    }
+    else
+    {
+        size = rewind_encode(&rewind->scratch, &rewind->keyframe, out);
+    }
+
+    RewindEntry* entry = &rewind->entries[(rewind->first + rewind->count) % rewind->max_entries];
+    entry->offset = rewind->head;
+    entry->size = size;
+    entry->group_index = group_index;
+    rewind->count++;
+    rewind->head += size;
+}
+
+// Drops the newest entry (the current state) and restores the one before it. An entry that
+// doesn't decode clears the history and leaves the machine as it is.
+bool rewind_step_back(Rewind* rewind)
+{
+    if(rewind->count < 2)
+        return false;
+
+    RewindEntry* dropped = entry_at(rewind, rewind->count - 1);
+    rewind->count--;
+    rewind->head = dropped->offset;
+
+    RewindEntry* entry = entry_at(rewind, rewind->count - 1);
+    if(dropped->group_index == 0)
+    {
+        // Left the newest group, so decode the keyframe of the one before it.
+        RewindEntry* keyframe = entry_at(rewind, rewind->count - 1 - entry->group_index);
+        static const Snapshot zero = {};
+        if(!rewind_decode(rewind->buffer + keyframe->offset, keyframe->size, &zero, &rewind->keyframe))
+        {
+            rewind_clear(rewind);
+            return false;
+        }
+    }
+
+    if(entry->group_index == 0)
+    {
+        load_snapshot(&rewind->keyframe);
+    }
+    else
+    {
+        if(!rewind_decode(rewind->buffer + entry->offset, entry->size, &rewind->keyframe, &rewind->scratch))
+        {
+            rewind_clear(rewind);
+            return false;
+        }
+        load_snapshot(&rewind->scratch);
+    }
+    return true;
+}
+
+uint32_t rewind_bytes_used(const Rewind* rewind)
+{
+    uint32_t used = 0;
+    for(int n = 0; n < rewind->count; n++)
+    {
+        used += rewind->entries[(rewind->first + n) % rewind->max_entries].size;
+    }
+    return used;
+}
+
+#ifdef USE_IMGUI
+void imgui_rewind(Rewind* rewind)
+{
+    if(ImGui::BeginMenu("Rewind"))
+    {
+        ImGui::MenuItem("Enabled", 0, &rewind->enabled);
+        ImGui::Text("Hold Backspace to rewind");
+        ImGui::Text("%.1f s recorded, %.2f MB", rewind->count / 60.0f, rewind_bytes_used(rewind) / (1024.0f*1024.0f));
+        if(ImGui::MenuItem("Clear"))
+        {
+            rewind_clear(rewind);
+        }
+        ImGui::EndMenu();
+    }
+}
+#else
+#define imgui_rewind(...)
+#endif
+
+};
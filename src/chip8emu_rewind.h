@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+
+namespace c8e
+{
+
+// One recorded frame. Keyframes hold a whole snapshot; every other entry holds the XOR against
+// the keyframe before it. Both are run-length encoded, see rewind_encode.
+struct RewindEntry
+{
+	uint32_t offset; // into Rewind::buffer
+	uint32_t size;
+	uint32_t group_index; // 0 for keyframes, n for the nth delta after its keyframe
+};
+
+// Frame history kept in a ring of entries whose encoded bytes live in a second, byte-sized ring.
+// The oldest entries are dropped when either ring runs out of room.
+struct Rewind
+{
+	uint8_t* buffer;
+	uint32_t buffer_size;
+	uint32_t head; // where the next entry is written
+
+	RewindEntry* entries;
+	int max_entries;
+	int first; // oldest entry
+	int count;
+
+	int keyframe_interval;
+
+	Snapshot keyframe; // decoded keyframe of the newest entry's group
+	Snapshot scratch;
+
+	bool enabled;
+	bool rewinding; // set by the platform while the rewind key is held
+};
+
+bool rewind_init(Rewind* rewind, int max_frames, uint32_t buffer_size);
+void rewind_free(Rewind* rewind);
+void rewind_clear(Rewind* rewind);
+void rewind_push(Rewind* rewind);
+bool rewind_step_back(Rewind* rewind);
+uint32_t rewind_bytes_used(const Rewind* rewind);
+void imgui_rewind(Rewind* rewind);
+
+Rewind rewind_history;
+};
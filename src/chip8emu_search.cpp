@@ -0,0 +1,254 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_search.h"
+#include "chip8emu_expr.h"
+#include "chip8emu_breakpoints.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef USE_SEARCH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace c8e
+{
+
+bool search_begin(MemorySearch* search, const uint8_t* const* memories, int instances)
+{
+    search_free(search);
+    if(instances < 1 || instances > SEARCH_MAX_INSTANCES)
+        return false;
+    search->previous = (uint8_t*)malloc((size_t)instances * MEMORY_SIZE);
+    if(!search->previous)
+        return false;
+    for(int k = 0; k < instances; k++)
+        memcpy(search->previous + (size_t)k * MEMORY_SIZE, memories[k], MEMORY_SIZE);
+    search->instances = instances;
+    memset(search->candidates, 0xFF, sizeof(search->candidates));
+    for(int a = 0; a < MEMORY_SIZE; a++)
+        search->results[a] = (uint16_t)a;
+    search->result_count = MEMORY_SIZE;
+    search->filters = 0;
+    return true;
+}
+
+void search_free(MemorySearch* search)
+{
+    free(search->previous);
+    search->previous = 0;
+    search->instances = 0;
+    search->result_count = 0;
+}
+
+static inline bool search_match(SearchCondition condition, uint8_t now, uint8_t before, uint8_t value)
+{
+    switch(condition)
+    {
+        case SEARCH_EQUAL_TO: return now == value;
+        case SEARCH_NOT_EQUAL_TO: return now != value;
+        case SEARCH_GREATER_THAN: return now > value;
+        case SEARCH_LESS_THAN: return now < value;
+        case SEARCH_UNCHANGED: return now == before;
+        case SEARCH_CHANGED: return now != before;
+        case SEARCH_INCREASED: return now > before;
+        case SEARCH_DECREASED: return now < before;
+        case SEARCH_INCREASED_BY: return (uint8_t)(now - before) == value;
+        case SEARCH_DECREASED_BY: return (uint8_t)(before - now) == value;
+        default: return false;
+    }
+}
+
+static void search_filter_scalar(MemorySearch* search, const uint8_t* const* memories, SearchCondition condition, uint8_t value)
+{
+    for(int k = 0; k < search->instances; k++)
+    {
+        const uint8_t* now = memories[k];
+        const uint8_t* before = search->previous + (size_t)k * MEMORY_SIZE;
+        for(int a = 0; a < MEMORY_SIZE; a++)
+        {
+            if(search->candidates[a] && !search_match(condition, now[a], before[a], value))
+                search->candidates[a] = 0;
+        }
+    }
+}
+
+#ifdef USE_SEARCH_SSE2
+// All ones where the condition holds. SSE2 has no unsigned byte compare: a > b is a saturating
+// a - b that is not zero.
+static inline __m128i search_mask(SearchCondition condition, __m128i now, __m128i before, __m128i value)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(-1);
+    switch(condition)
+    {
+        case SEARCH_EQUAL_TO: return _mm_cmpeq_epi8(now, value);
+        case SEARCH_NOT_EQUAL_TO: return _mm_xor_si128(_mm_cmpeq_epi8(now, value), ones);
+        case SEARCH_GREATER_THAN: return _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(now, value), zero), ones);
+        case SEARCH_LESS_THAN: return _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(value, now), zero), ones);
+        case SEARCH_UNCHANGED: return _mm_cmpeq_epi8(now, before);
+        case SEARCH_CHANGED: return _mm_xor_si128(_mm_cmpeq_epi8(now, before), ones);
+        case SEARCH_INCREASED: return _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(now, before), zero), ones);
+        case SEARCH_DECREASED: return _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(before, now), zero), ones);
+        case SEARCH_INCREASED_BY: return _mm_cmpeq_epi8(_mm_sub_epi8(now, before), value);
+        case SEARCH_DECREASED_BY: return _mm_cmpeq_epi8(_mm_sub_epi8(before, now), value);
+        default: return zero;
+    }
+}
+
+// A chunk at a time across all the instances, so the candidates are loaded and stored once.
+static void search_filter_sse2(MemorySearch* search, const uint8_t* const* memories, SearchCondition condition, uint8_t value)
+{
+    const __m128i values = _mm_set1_epi8((char)value);
+    for(int a = 0; a < MEMORY_SIZE; a += 16)
+    {
+        __m128i candidates = _mm_loadu_si128((const __m128i*)(search->candidates + a));
+        if(!_mm_movemask_epi8(candidates))
+            continue;
+        for(int k = 0; k < search->instances; k++)
+        {
+            __m128i now = _mm_loadu_si128((const __m128i*)(memories[k] + a));
+            __m128i before = _mm_loadu_si128((const __m128i*)(search->previous + (size_t)k * MEMORY_SIZE + a));
+            candidates = _mm_and_si128(candidates, search_mask(condition, now, before, values));
+            if(!_mm_movemask_epi8(candidates))
+                break;
+        }
+        _mm_storeu_si128((__m128i*)(search->candidates + a), candidates);
+    }
+}
+#endif
+
+int search_filter(MemorySearch* search, const uint8_t* const* memories, SearchCondition condition, uint8_t value)
+{
+    if(!search->instances)
+        return 0;
+#ifdef USE_SEARCH_SSE2
+    if(!search->scalar)
+        search_filter_sse2(search, memories, condition, value);
+    else
+#endif
+        search_filter_scalar(search, memories, condition, value);
+
+    // Eight addresses at a time, skipping the empty ones; appending is branch-free.
+    int count = 0;
+    for(int a = 0; a < MEMORY_SIZE; a += 8)
+    {
+        uint64_t word;
+        memcpy(&word, search->candidates + a, 8);
+        if(!word)
+            continue;
+        for(int b = 0; b < 8; b++)
+        {
+            search->results[count] = (uint16_t)(a + b);
+            count += search->candidates[a + b] != 0;
+        }
+    }
+    search->result_count = count;
+    for(int k = 0; k < search->instances; k++)
+        memcpy(search->previous + (size_t)k * MEMORY_SIZE, memories[k], MEMORY_SIZE);
+    search->filters++;
+    return search->result_count;
+}
+
+#ifdef USE_IMGUI
+static bool g_show_search = false;
+
+void imgui_search_menu()
+{
+    if(ImGui::BeginMenu("Debug"))
+    {
+        ImGui::MenuItem("Memory search", 0, &g_show_search);
+        ImGui::EndMenu();
+    }
+}
+
+void imgui_search_windows()
+{
+    if(!g_show_search)
+        return;
+
+    static int condition = SEARCH_INCREASED;
+    static uint8_t value = 0;
+    MemorySearch* search = &memory_search;
+    const uint8_t* live[1] = {c8.memory};
+
+    ImGui::SetNextWindowSize(ImVec2(360, 400), ImGuiCond_FirstUseEver);
+    if(ImGui::Begin("Memory search", &g_show_search))
+    {
+        if(ImGui::Button(search->instances ? "Start over" : "Start"))
+            search_begin(search, live, 1);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120);
+        ImGui::Combo("##condition", &condition, SEARCH_CONDITION_NAMES, SEARCH_CONDITION_COUNT);
+        bool uses_value = condition <= SEARCH_LESS_THAN || condition >= SEARCH_INCREASED_BY;
+        ImGui::SameLine();
+        ImGui::BeginDisabled(!uses_value);
+        ImGui::SetNextItemWidth(50);
+        ImGui::InputScalar("##value", ImGuiDataType_U8, &value);
+        ImGui::EndDisabled();
+        ImGui::SameLine();
+        ImGui::BeginDisabled(!search->instances);
+        if(ImGui::Button("Filter"))
+            search_filter(search, live, (SearchCondition)condition, value);
+        ImGui::EndDisabled();
+
+        if(!search->instances)
+        {
+            ImGui::TextWrapped("Start, let the value change in the game, then filter by how it changed. Repeat until few are left.");
+        }
+        else
+        {
+            ImGui::Text("%d candidates after %d filters", search->result_count, search->filters);
+            ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersV;
+            if(ImGui::BeginTable("candidates", 4, flags))
+            {
+                ImGui::TableSetupScrollFreeze(0, 1);
+                ImGui::TableSetupColumn("Addr");
+                ImGui::TableSetupColumn("Was");
+                ImGui::TableSetupColumn("Now");
+                ImGui::TableSetupColumn("");
+                ImGui::TableHeadersRow();
+
+                ImGuiListClipper clipper;
+                clipper.Begin(search->result_count);
+                while(clipper.Step())
+                {
+                    for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+                    {
+                        uint16_t addr = search->results[row];
+                        uint8_t was = search->previous[addr];
+                        ImGui::TableNextRow();
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%03X", addr);
+                        ImGui::TableNextColumn();
+                        ImGui::Text("%d", was);
+                        ImGui::TableNextColumn();
+                        if(c8.memory[addr] != was)
+                            ImGui::TextColored(ImVec4(1.0f, 0.75f, 0.2f, 1.0f), "%d", c8.memory[addr]);
+                        else
+                            ImGui::Text("%d", c8.memory[addr]);
+                        ImGui::TableNextColumn();
+                        ImGui::PushID(row);
+                        if(ImGui::SmallButton("Watch"))
+                        {
+                            char text[EXPR_MAX_TEXT];
+                            snprintf(text, sizeof(text), "mem[0x%03X]", addr);
+                            watch_add(text);
+                        }
+                        ImGui::SameLine();
+                        if(ImGui::SmallButton("Break on write"))
+                            break_add_watch(addr, addr, BREAK_WRITE);
+                        ImGui::PopID();
+                    }
+                }
+                ImGui::EndTable();
+            }
+        }
+    }
+    ImGui::End();
+}
+#else
+#define imgui_search_menu(...)
+#define imgui_search_windows(...)
+#endif
+
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+
+// SSE2 is there on every x64 target; elsewhere (32-bit builds without it, WASM) the plain loop is used.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SEARCH_SSE2
+#endif
+
+namespace c8e
+{
+// Memory search, for finding things like score or lives counters. search_begin takes the memory
+// of one or more instances (the live machine, snapshots of runs with different input) and makes
+// every address a candidate. Each search_filter keeps the addresses where the condition holds in
+// every instance, comparing against that instance's memory at the previous call.
+//
+// Candidates are a byte mask, so a compare is 16 addresses per SSE2 instruction and the result
+// is ANDed straight in. Chunks with no candidates left are skipped, so later filters get cheaper.
+const int SEARCH_MAX_INSTANCES = 64;
+
+enum SearchCondition
+{
+	SEARCH_EQUAL_TO, SEARCH_NOT_EQUAL_TO, SEARCH_GREATER_THAN, SEARCH_LESS_THAN, // the value
+	SEARCH_UNCHANGED, SEARCH_CHANGED, SEARCH_INCREASED, SEARCH_DECREASED, // since the last filter
+	SEARCH_INCREASED_BY, SEARCH_DECREASED_BY, // exactly the value, wrapping around
+	SEARCH_CONDITION_COUNT,
+};
+
+const char* const SEARCH_CONDITION_NAMES[SEARCH_CONDITION_COUNT] =
+{
+	"Equal to", "Not equal to", "Greater than", "Less than",
+	"Unchanged", "Changed", "Increased", "Decreased",
+	"Increased by", "Decreased by",
+};
+
+struct MemorySearch
+{
+	int instances; // 0 before search_begin
+	bool scalar; // forces the plain loop, for checking the vector one
+	uint8_t candidates[MEMORY_SIZE]; // 0xFF while the address is one
+	uint8_t* previous; // instances * MEMORY_SIZE, memory at the last filter
+
+	uint16_t results[MEMORY_SIZE]; // the candidates in address order
+	int result_count;
+	int filters;
+};
+
+MemorySearch memory_search;
+
+bool search_begin(MemorySearch* search, const uint8_t* const* memories, int instances);
+int search_filter(MemorySearch* search, const uint8_t* const* memories, SearchCondition condition, uint8_t value);
+void search_free(MemorySearch* search);
+
+void imgui_search_menu();
+void imgui_search_windows();
+};
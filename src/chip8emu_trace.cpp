@@ -0,0 +1,768 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_trace.h"
+#include "chip8emu_platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace c8e
+{
+
+static inline TraceEvent* trace_begin(uint16_t op)
+{
+    uint32_t head = tracer.head.load(std::memory_order_relaxed);
+    if(head - tracer.tail.load(std::memory_order_acquire) >= TRACE_RING_SIZE)
+    {
+        // Frames longer than the ring: the emulation thread is the consumer as well, so
+        // drain in place instead of dropping.
+        trace_drain();
+    }
+
+    if((head & (TRACE_SNAPSHOT_INTERVAL - 1)) == 0)
+    {
+        save_snapshot(&tracer.snapshots[(head / TRACE_SNAPSHOT_INTERVAL) & 1]);
+    }
+
+    TraceEvent* event = &tracer.ring[head & (TRACE_RING_SIZE - 1)];
+    event->cycle = c8.cycle;
+    event->pc = c8.pc;
+    event->op = op;
+    memcpy(tracer.v_before, c8.v, sizeof(tracer.v_before));
+    return event;
+}
+
+static inline void trace_end(TraceEvent* event)
+{
+    event->i = c8.i;
+    event->reg = TRACE_NO_REGISTER;
+    if(memcmp(tracer.v_before, c8.v, sizeof(tracer.v_before)) != 0)
+    {
+        for(int x = 0; x < 16; x++)
+        {
+            if(tracer.v_before[x] != c8.v[x] && (x != 0xF || event->reg == TRACE_NO_REGISTER))
+            {
+                event->reg = (uint8_t)x;
+                event->value = c8.v[x];
+                if(x != 0xF)
+                    break;
+            }
+        }
+    }
+    tracer.head.store(tracer.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void trace_codec_init(TraceCodec* codec, uint64_t first_cycle)
+{
+    codec->cycle = first_cycle - 1;
+    codec->pc = UINT32_MAX; // the first record always carries pc and I
+    codec->i = UINT32_MAX;
+}
+
+uint8_t* trace_encode(TraceCodec* codec, const TraceEvent* event, uint8_t* out)
+{
+    uint8_t* flags = out++;
+    *flags = 0;
+    if(event->pc != codec->pc + 2)
+    {
+        *flags |= TRACE_PC_JUMP;
+        out = write_varint(out, event->pc);
+    }
+    *out++ = (uint8_t)(event->op >> 8);
+    *out++ = (uint8_t)event->op;
+    if(event->i != codec->i)
+    {
+        *flags |= TRACE_I_CHANGED;
+        out = write_varint(out, event->i);
+    }
+    if(event->reg != TRACE_NO_REGISTER)
+    {
+        *flags |= TRACE_REG_CHANGED;
+        *out++ = event->reg;
+        *out++ = event->value;
+    }
+    if(event->cycle != codec->cycle + 1)
+    {
+        *flags |= TRACE_CYCLE_GAP;
+        out = write_varint(out, event->cycle - codec->cycle - 1);
+    }
+
+    codec->cycle = event->cycle;
+    codec->pc = event->pc;
+    codec->i = event->i;
+    return out;
+}
+
+const uint8_t* trace_decode(TraceCodec* codec, const uint8_t* in, const uint8_t* end, TraceEvent* event)
+{
+    if(in >= end)
+        return 0;
+    uint8_t flags = *in++;
+    uint64_t value;
+
+    event->pc = (uint16_t)(codec->pc + 2);
+    if(flags & TRACE_PC_JUMP)
+    {
+        if(!(in = read_varint_bounded(in, end, &value)))
+            return 0;
+        event->pc = (uint16_t)value;
+    }
+    if(end - in < 2)
+        return 0;
+    event->op = (uint16_t)((in[0] << 8) | in[1]);
+    in += 2;
+    event->i = (uint16_t)codec->i;
+    if(flags & TRACE_I_CHANGED)
+    {
+        if(!(in = read_varint_bounded(in, end, &value)))
+            return 0;
+        event->i = (uint16_t)value;
+    }
+    event->reg = TRACE_NO_REGISTER;
+    event->value = 0;
+    if(flags & TRACE_REG_CHANGED)
+    {
+        if(end - in < 2)
+            return 0;
+        event->reg = in[0];
+        event->value = in[1];
+        in += 2;
+    }
+    event->cycle = codec->cycle + 1;
+    if(flags & TRACE_CYCLE_GAP)
+    {
+        if(!(in = read_varint_bounded(in, end, &value)))
+            return 0;
+        event->cycle += value;
+    }
+
+    codec->cycle = event->cycle;
+    codec->pc = event->pc;
+    codec->i = event->i;
+    return in;
+}
+
+static void trace_flush()
+{
+    if(tracer.spill_size && !tracer.failed)
+    {
+        if(!plat::write_file(tracer.file, tracer.spill, tracer.spill_size))
+        {
+            tracer.failed = true;
+            tracer.enabled = false;
+        }
+        else
+        {
+            tracer.bytes += tracer.spill_size;
+        }
+    }
+    tracer.spill_size = 0;
+}
+
+bool trace_start(plat::FilePath path)
+{
+    trace_stop();
+
+    tracer.file = plat::open_file_for_writing(path);
+    if(!tracer.file)
+        return false;
+
+    TraceFileHeader header = {0};
+    memcpy(header.magic, TRACE_MAGIC, 4);
+    header.version = TRACE_VERSION;
+    header.rom_hash = hash_rom();
+    header.first_cycle = c8.cycle;
+
+    tracer.head.store(0);
+    tracer.tail.store(0);
+    memcpy(tracer.spill, &header, sizeof(header));
+    tracer.spill_size = sizeof(header);
+    tracer.block_count = 0;
+    tracer.events = 0;
+    tracer.bytes = 0;
+    tracer.failed = false;
+    tracer.out_of_memory = false;
+    tracer.enabled = true;
+    return true;
+}
+
+void trace_stop()
+{
+    if(!tracer.file)
+        return;
+    tracer.enabled = false;
+    trace_drain();
+    trace_flush();
+
+    if(!tracer.failed)
+    {
+        static const uint8_t padding[8] = {0};
+        TraceFileFooter footer = {0};
+        footer.index_offset = (tracer.bytes + 7) & ~7ull;
+        footer.block_count = tracer.block_count;
+        footer.event_count = tracer.events;
+        memcpy(footer.magic, TRACE_FOOTER_MAGIC, 4);
+        footer.version = TRACE_VERSION;
+
+        size_t index_size = (size_t)tracer.block_count * sizeof(TraceIndexEntry);
+        if(!plat::write_file(tracer.file, padding, (size_t)(footer.index_offset - tracer.bytes)) ||
+           !plat::write_file(tracer.file, tracer.index, index_size) ||
+           !plat::write_file(tracer.file, &footer, sizeof(footer)))
+        {
+            tracer.failed = true;
+        }
+        tracer.bytes = footer.index_offset + index_size + sizeof(footer);
+    }
+
+    plat::close_file(tracer.file);
+    tracer.file = 0;
+    free(tracer.index);
+    tracer.index = 0;
+    tracer.index_capacity = 0;
+}
+
+// Every block restarts the delta encoding, so a reader can start decoding at any of them. False
+// when the index can't grow, which stops tracing like a failed write.
+static bool trace_begin_block(const TraceEvent* event)
+{
+    if(tracer.block_count == tracer.index_capacity)
+    {
+        uint64_t capacity = tracer.index_capacity ? tracer.index_capacity*2 : 1024;
+        TraceIndexEntry* index = (TraceIndexEntry*)realloc(tracer.index, capacity * sizeof(TraceIndexEntry));
+        if(!index)
+        {
+            tracer.failed = true;
+            tracer.out_of_memory = true;
+            tracer.enabled = false;
+            return false;
+        }
+        tracer.index = index;
+        tracer.index_capacity = capacity;
+    }
+    TraceIndexEntry* entry = &tracer.index[tracer.block_count++];
+    entry->first_cycle = event->cycle;
+    entry->snapshot_offset = 0;
+
+    if((tracer.events & (TRACE_SNAPSHOT_INTERVAL - 1)) == 0)
+    {
+        if(tracer.spill_size + sizeof(Snapshot) > TRACE_SPILL_SIZE)
+            trace_flush();
+        entry->snapshot_offset = tracer.bytes + tracer.spill_size;
+        memcpy(tracer.spill + tracer.spill_size, &tracer.snapshots[(tracer.events / TRACE_SNAPSHOT_INTERVAL) & 1], sizeof(Snapshot));
+        tracer.spill_size += sizeof(Snapshot);
+    }
+    entry->offset = tracer.bytes + tracer.spill_size;
+    trace_codec_init(&tracer.codec, event->cycle);
+    return true;
+}
+
+// Called by the emulation thread at the end of each frame, and whenever the ring fills up.
+void trace_drain()
+{
+    if(!tracer.file)
+        return;
+
+    uint32_t tail = tracer.tail.load(std::memory_order_relaxed);
+    uint32_t head = tracer.head.load(std::memory_order_acquire);
+    for(; tail != head; tail++)
+    {
+        const TraceEvent* event = &tracer.ring[tail & (TRACE_RING_SIZE - 1)];
+        if((tracer.events & (TRACE_BLOCK_EVENTS - 1)) == 0 && !trace_begin_block(event))
+        {
+            tail = head;
+            break;
+        }
+        if(tracer.spill_size > TRACE_SPILL_SIZE - TRACE_MAX_RECORD_SIZE)
+            trace_flush();
+        uint8_t* out = trace_encode(&tracer.codec, event, tracer.spill + tracer.spill_size);
+        tracer.spill_size = (uint32_t)(out - tracer.spill);
+        tracer.events++;
+    }
+    tracer.tail.store(tail, std::memory_order_release);
+}
+
+bool trace_open(TraceReader* reader, plat::FilePath path)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->file = plat::map_file(path);
+    const uint8_t* data = (const uint8_t*)reader->file.data;
+    size_t size = reader->file.len;
+    if(!data || size < sizeof(TraceFileHeader) + sizeof(TraceFileFooter))
+        goto error;
+
+    memcpy(&reader->header, data, sizeof(reader->header));
+    memcpy(&reader->footer, data + size - sizeof(reader->footer), sizeof(reader->footer));
+    if(memcmp(reader->header.magic, TRACE_MAGIC, 4) != 0 || reader->header.version != TRACE_VERSION)
+        goto error;
+    if(memcmp(reader->footer.magic, TRACE_FOOTER_MAGIC, 4) != 0 || reader->footer.version != TRACE_VERSION)
+        goto error;
+    if(reader->footer.index_offset % 8 != 0 || reader->footer.index_offset > size - sizeof(reader->footer) ||
+       reader->footer.block_count != (size - sizeof(reader->footer) - reader->footer.index_offset) / sizeof(TraceIndexEntry) ||
+       reader->footer.block_count != (reader->footer.event_count + TRACE_BLOCK_EVENTS - 1) / TRACE_BLOCK_EVENTS)
+        goto error;
+
+    reader->index = (const TraceIndexEntry*)(data + reader->footer.index_offset);
+    return true;
+
+error:
+    trace_close(reader);
+    return false;
+}
+
+void trace_close(TraceReader* reader)
+{
+    if(reader->file.data)
+        plat::unmap_file(reader->file);
+    memset(reader, 0, sizeof(*reader));
+}
+
+// Decodes from the start of the block holding first_event; at most one block is skipped over.
+int trace_read(const TraceReader* reader, uint64_t first_event, TraceEvent* events, int count)
+{
+    if(first_event >= reader->footer.event_count)
+        return 0;
+    if((uint64_t)count > reader->footer.event_count - first_event)
+        count = (int)(reader->footer.event_count - first_event);
+
+    const uint8_t* data = (const uint8_t*)reader->file.data;
+    const uint8_t* end = data + reader->footer.index_offset;
+    uint64_t block = first_event / TRACE_BLOCK_EVENTS;
+    uint64_t event = block * TRACE_BLOCK_EVENTS;
+    int read = 0;
+    while(read < count)
+    {
+        const TraceIndexEntry* entry = &reader->index[block];
+        if(entry->offset >= reader->footer.index_offset)
+            break;
+        TraceCodec codec;
+        trace_codec_init(&codec, entry->first_cycle);
+        const uint8_t* in = data + entry->offset;
+        for(uint32_t n = 0; n < TRACE_BLOCK_EVENTS && read < count; n++, event++)
+        {
+            TraceEvent decoded;
+            in = trace_decode(&codec, in, end, &decoded);
+            if(!in)
+                return read;
+            if(event >= first_event)
+                events[read++] = decoded;
+        }
+        block++;
+    }
+    return read;
+}
+
+// Binary search over the block index. Assumes cycles only go up, which holds unless the
+// recording spans a rewind or a snapshot load.
+uint64_t trace_find_cycle(const TraceReader* reader, uint64_t cycle)
+{
+    uint64_t low = 0;
+    uint64_t high = reader->footer.block_count;
+    while(low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        if(reader->index[mid].first_cycle <= cycle)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if(low == 0)
+        return 0;
+
+    uint64_t event = (low - 1) * TRACE_BLOCK_EVENTS;
+    TraceEvent events[256];
+    for(;;)
+    {
+        int read = trace_read(reader, event, events, 256);
+        if(read == 0)
+            return event;
+        for(int n = 0; n < read; n++)
+        {
+            if(events[n].cycle >= cycle)
+                return event + n;
+        }
+        event += read;
+    }
+}
+
+bool trace_read_snapshot(const TraceReader* reader, uint64_t event, Snapshot* snapshot, uint64_t* snapshot_event)
+{
+    if(reader->footer.event_count == 0)
+        return false;
+    if(event >= reader->footer.event_count)
+        event = reader->footer.event_count - 1;
+
+    uint64_t first = event / TRACE_SNAPSHOT_INTERVAL * TRACE_SNAPSHOT_INTERVAL;
+    uint64_t offset = reader->index[first / TRACE_BLOCK_EVENTS].snapshot_offset;
+    if(!offset || offset + sizeof(Snapshot) > reader->footer.index_offset)
+        return false;
+    memcpy(snapshot, (const uint8_t*)reader->file.data + offset, sizeof(Snapshot));
+    *snapshot_event = first;
+    return true;
+}
+
+#ifdef USE_IMGUI
+// Rows are shown a page at a time: ImGui scroll positions are floats, and past a few million
+// rows they can no longer land on a row.
+const uint64_t TRACE_VIEW_PAGE_ROWS = 1 << 20;
+const int TRACE_VIEW_CACHE_BLOCKS = 4;
+const uint32_t TRACE_VIEW_FILTER_EVENTS_PER_FRAME = 1 << 17;
+
+struct TraceView
+{
+	bool open;
+	TraceReader reader;
+
+	// Decoded blocks for the visible rows, replaced round robin.
+	uint64_t cached_block[TRACE_VIEW_CACHE_BLOCKS];
+	TraceEvent cache[TRACE_VIEW_CACHE_BLOCKS][TRACE_BLOCK_EVENTS];
+	int next_cache;
+
+	// Filters; the matching events are collected a slice per frame.
+	int filter_class; // -1 for any
+	int filter_register; // -1 for any
+	uint16_t filter_pc_min;
+	uint16_t filter_pc_max;
+	bool filtered;
+	uint64_t* matches;
+	uint64_t match_count;
+	uint64_t match_capacity;
+	uint64_t scanned;
+	bool filter_out_of_memory; // the matches could not grow, filtering stopped early
+	TraceEvent scan[TRACE_BLOCK_EVENTS];
+
+	uint64_t page;
+	uint64_t goto_cycle;
+	int64_t scroll_to_row; // within the page, -1 for none
+};
+
+static TraceView g_trace_view = {false, {}, {}, {}, 0, -1, -1, 0, 0xFFF};
+
+static void trace_view_reset_filter(TraceView* view)
+{
+    view->filtered = view->filter_class >= 0 || view->filter_register >= 0 || view->filter_pc_min > 0 || view->filter_pc_max < 0xFFF;
+    view->match_count = 0;
+    view->scanned = 0;
+    view->filter_out_of_memory = false;
+    view->page = 0;
+}
+
+static void trace_view_close(TraceView* view)
+{
+    trace_close(&view->reader);
+    free(view->matches);
+    view->matches = 0;
+    view->match_capacity = 0;
+    trace_view_reset_filter(view);
+}
+
+static void trace_view_open(TraceView* view, plat::FilePath path)
+{
+    trace_view_close(view);
+    trace_open(&view->reader, path);
+    for(int n = 0; n < TRACE_VIEW_CACHE_BLOCKS; n++)
+        view->cached_block[n] = UINT64_MAX;
+    view->scroll_to_row = -1;
+}
+
+static const TraceEvent* trace_view_event(TraceView* view, uint64_t event)
+{
+    uint64_t block = event / TRACE_BLOCK_EVENTS;
+    int slot = -1;
+    for(int n = 0; n < TRACE_VIEW_CACHE_BLOCKS; n++)
+    {
+        if(view->cached_block[n] == block)
+            slot = n;
+    }
+    if(slot < 0)
+    {
+        slot = view->next_cache;
+        view->next_cache = (view->next_cache + 1) % TRACE_VIEW_CACHE_BLOCKS;
+        view->cached_block[slot] = block;
+        trace_read(&view->reader, block * TRACE_BLOCK_EVENTS, view->cache[slot], TRACE_BLOCK_EVENTS);
+    }
+    return &view->cache[slot][event % TRACE_BLOCK_EVENTS];
+}
+
+static bool trace_view_matches(const TraceView* view, const TraceEvent* event)
+{
+    if(view->filter_class >= 0 && op_class(event->op) != view->filter_class)
+        return false;
+    if(view->filter_register >= 0 && event->reg != view->filter_register)
+        return false;
+    return event->pc >= view->filter_pc_min && event->pc <= view->filter_pc_max;
+}
+
+// Scans a slice of the trace for the filter, so the frame time stays flat on huge traces.
+static void trace_view_filter_step(TraceView* view)
+{
+    uint64_t event_count = view->reader.footer.event_count;
+    uint32_t budget = TRACE_VIEW_FILTER_EVENTS_PER_FRAME;
+    while(view->filtered && view->scanned < event_count && budget >= TRACE_BLOCK_EVENTS)
+    {
+        int read = trace_read(&view->reader, view->scanned, view->scan, TRACE_BLOCK_EVENTS);
+        if(read == 0)
+        {
+            view->scanned = event_count;
+            break;
+        }
+        for(int n = 0; n < read; n++)
+        {
+            if(!trace_view_matches(view, &view->scan[n]))
+                continue;
+            if(view->match_count == view->match_capacity)
+            {
+                uint64_t capacity = view->match_capacity ? view->match_capacity*2 : 4096;
+                uint64_t* matches = (uint64_t*)realloc(view->matches, capacity * sizeof(uint64_t));
+                if(!matches)
+                {
+                    // Keeps what was found so far and ends the filter there.
+                    view->filter_out_of_memory = true;
+                    view->scanned = event_count;
+                    return;
+                }
+                view->matches = matches;
+                view->match_capacity = capacity;
+            }
+            view->matches[view->match_count++] = view->scanned + n;
+        }
+        view->scanned += read;
+        budget -= TRACE_BLOCK_EVENTS;
+    }
+}
+
+// Shows row (over the whole trace or the matches) on the right page.
+static void trace_view_goto_row(TraceView* view, uint64_t row)
+{
+    view->page = row / TRACE_VIEW_PAGE_ROWS;
+    view->scroll_to_row = (int64_t)(row % TRACE_VIEW_PAGE_ROWS);
+}
+
+static void imgui_trace_viewer()
+{
+    TraceView* view = &g_trace_view;
+    if(!view->open)
+    {
+        if(view->reader.file.data)
+            trace_view_close(view);
+        return;
+    }
+
+    ImGui::SetNextWindowSize(ImVec2(640, 480), ImGuiCond_FirstUseEver);
+    if(!ImGui::Begin("Trace viewer", &view->open))
+    {
+        ImGui::End();
+        return;
+    }
+
+    if(ImGui::Button("Open..."))
+    {
+        plat::FilePath path = {0};
+        if(plat::show_file_prompt(&path, "c8t"))
+        {
+            trace_view_open(view, path);
+        }
+        plat::unload_path(path);
+    }
+    TraceReader* reader = &view->reader;
+    if(!reader->file.data)
+    {
+        ImGui::SameLine();
+        ImGui::Text("No trace open (a stopped recording from the Trace menu)");
+        ImGui::End();
+        return;
+    }
+    ImGui::SameLine();
+    ImGui::Text("%llu instructions, cycles %llu..", (unsigned long long)reader->footer.event_count,
+                (unsigned long long)(reader->footer.block_count ? reader->index[0].first_cycle : 0));
+
+    // Filters
+    bool changed = false;
+    ImGui::SetNextItemWidth(100);
+    if(ImGui::BeginCombo("Class", view->filter_class < 0 ? "Any" : OP_CLASS_NAMES[view->filter_class]))
+    {
+        if(ImGui::Selectable("Any", view->filter_class < 0))
+        {
+            view->filter_class = -1;
+            changed = true;
+        }
+        for(int c = 0; c < OP_CLASS_COUNT; c++)
+        {
+            if(ImGui::Selectable(OP_CLASS_NAMES[c], view->filter_class == c))
+            {
+                view->filter_class = c;
+                changed = true;
+            }
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(70);
+    const char* registers = "Any\0V0\0V1\0V2\0V3\0V4\0V5\0V6\0V7\0V8\0V9\0VA\0VB\0VC\0VD\0VE\0VF\0";
+    int register_item = view->filter_register + 1;
+    if(ImGui::Combo("Writes", &register_item, registers))
+    {
+        view->filter_register = register_item - 1;
+        changed = true;
+    }
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(50);
+    changed |= ImGui::InputScalar("PC from", ImGuiDataType_U16, &view->filter_pc_min, 0, 0, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(50);
+    changed |= ImGui::InputScalar("to", ImGuiDataType_U16, &view->filter_pc_max, 0, 0, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+    if(changed)
+    {
+        trace_view_reset_filter(view);
+    }
+    trace_view_filter_step(view);
+
+    uint64_t rows = view->filtered ? view->match_count : reader->footer.event_count;
+    uint64_t pages = (rows + TRACE_VIEW_PAGE_ROWS - 1) / TRACE_VIEW_PAGE_ROWS;
+    if(view->filtered)
+    {
+        ImGui::Text("%llu matches%s", (unsigned long long)view->match_count,
+                    view->filter_out_of_memory ? ", out of memory, the rest of the trace was not filtered" :
+                    view->scanned < reader->footer.event_count ? ", filtering..." : "");
+        if(view->scanned < reader->footer.event_count)
+        {
+            ImGui::SameLine();
+            ImGui::ProgressBar((float)view->scanned / reader->footer.event_count, ImVec2(120, 0));
+        }
+    }
+
+    // Navigation
+    ImGui::SetNextItemWidth(120);
+    ImGui::InputScalar("##cycle", ImGuiDataType_U64, &view->goto_cycle);
+    ImGui::SameLine();
+    if(ImGui::Button("Go to cycle"))
+    {
+        uint64_t event = trace_find_cycle(reader, view->goto_cycle);
+        if(!view->filtered)
+        {
+            trace_view_goto_row(view, event);
+        }
+        else
+        {
+            // First match at or after the event.
+            uint64_t low = 0;
+            uint64_t high = view->match_count;
+            while(low < high)
+            {
+                uint64_t mid = low + (high - low) / 2;
+                if(view->matches[mid] < event)
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            if(low < view->match_count)
+                trace_view_goto_row(view, low);
+        }
+    }
+    if(pages > 1)
+    {
+        ImGui::SameLine();
+        int page = (int)view->page;
+        ImGui::SetNextItemWidth(120);
+        if(ImGui::SliderInt("Page", &page, 0, (int)pages - 1))
+            view->page = (uint64_t)page;
+    }
+    if(view->page >= pages)
+        view->page = pages ? pages - 1 : 0;
+
+    uint64_t page_first = view->page * TRACE_VIEW_PAGE_ROWS;
+    uint64_t page_rows = rows - page_first < TRACE_VIEW_PAGE_ROWS ? rows - page_first : TRACE_VIEW_PAGE_ROWS;
+
+    ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersV | ImGuiTableFlags_Resizable;
+    if(ImGui::BeginTable("trace", 6, flags))
+    {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Cycle");
+        ImGui::TableSetupColumn("PC");
+        ImGui::TableSetupColumn("Op");
+        ImGui::TableSetupColumn("Instruction");
+        ImGui::TableSetupColumn("I");
+        ImGui::TableSetupColumn("Writes");
+        ImGui::TableHeadersRow();
+
+        float row_height = ImGui::GetTextLineHeight() + ImGui::GetStyle().CellPadding.y * 2.0f;
+        if(view->scroll_to_row >= 0)
+        {
+            ImGui::SetScrollY(view->scroll_to_row * row_height);
+            view->scroll_to_row = -1;
+        }
+
+        ImGuiListClipper clipper;
+        clipper.Begin((int)page_rows, row_height);
+        while(clipper.Step())
+        {
+            for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+            {
+                uint64_t index = page_first + row;
+                const TraceEvent* event = trace_view_event(view, view->filtered ? view->matches[index] : index);
+                char text[32];
+                disassemble(event->op, text, sizeof(text));
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)event->cycle);
+                ImGui::TableNextColumn();
+                ImGui::Text("%03X", event->pc);
+                ImGui::TableNextColumn();
+                ImGui::Text("%04X", event->op);
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(text);
+                ImGui::TableNextColumn();
+                ImGui::Text("%03X", event->i);
+                ImGui::TableNextColumn();
+                if(event->reg != TRACE_NO_REGISTER)
+                    ImGui::Text("V%X = %02X", event->reg, event->value);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
+void imgui_trace_windows()
+{
+    imgui_trace_viewer();
+}
+
+void imgui_trace_menu()
+{
+    if(ImGui::BeginMenu("Trace"))
+    {
+        if(!tracer.file)
+        {
+            if(ImGui::MenuItem("Record instructions..."))
+            {
+                plat::FilePath path = {0};
+                if(plat::show_save_prompt(&path, "c8t"))
+                {
+                    trace_start(path);
+                }
+                plat::unload_path(path);
+            }
+        }
+        else if(ImGui::MenuItem("Stop recording"))
+        {
+            trace_stop();
+        }
+        ImGui::MenuItem("Trace viewer", 0, &g_trace_view.open);
+
+        if(tracer.file || tracer.events)
+        {
+            ImGui::Text("%llu instructions, %.1f MB, %.2f bytes each", (unsigned long long)tracer.events,
+                        (tracer.bytes + tracer.spill_size) / (1024.0 * 1024.0),
+                        tracer.events ? (double)(tracer.bytes + tracer.spill_size) / tracer.events : 0.0);
+            if(tracer.failed)
+                ImGui::Text(tracer.out_of_memory ? "Out of memory, recording stopped" : "Write failed, recording stopped");
+        }
+        ImGui::EndMenu();
+    }
+}
+#else
+#define imgui_trace_menu(...)
+#define imgui_trace_windows(...)
+#endif
+
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "chip8emu.h"
+#include "chip8emu_platform.h"
+
+namespace c8e
+{
+// Instruction trace recorder. next_op writes one event per instruction into a fixed ring
+// (single producer, single consumer, no locks); trace_drain encodes whatever is there into
+// the spill buffer at frame end and writes it out when full. Nothing is allocated per event.
+// Rewinding or loading a snapshot while recording shows up as a cycle jump (mod 2^64).
+// Instructions the debugger re-runs while replaying its history are not recorded again.
+//
+// File: TraceFileHeader, then blocks of TRACE_BLOCK_EVENTS records. Each block restarts the
+// delta encoding, and every TRACE_SNAPSHOT_INTERVAL events the block is preceded by a
+// Snapshot of the machine before its first instruction. One record per event:
+//   flags byte (TraceFlags)
+//   [varint pc]                  TRACE_PC_JUMP, otherwise the previous pc + 2
+//   op, 2 bytes big-endian
+//   [varint I]                   TRACE_I_CHANGED
+//   [register, value]            TRACE_REG_CHANGED
+//   [varint cycles skipped]      TRACE_CYCLE_GAP, otherwise the previous cycle + 1
+// A straight-line instruction that only touches one register is 5 bytes. After the last
+// block, padded to 8 bytes: a TraceIndexEntry per block and the TraceFileFooter, so a reader
+// can map the file and seek without scanning it. A trace that was never stopped has no
+// footer and can't be opened.
+#define TRACE_MAGIC "C8TR"
+#define TRACE_FOOTER_MAGIC "C8TI"
+const uint32_t TRACE_VERSION = 2;
+const uint32_t TRACE_RING_SIZE = 1 << 16; // events, power of two
+const uint32_t TRACE_SPILL_SIZE = 1 << 16; // bytes
+const uint32_t TRACE_MAX_RECORD_SIZE = 1 + 3 + 2 + 3 + 2 + 10;
+const uint32_t TRACE_BLOCK_EVENTS = 4096;
+const uint32_t TRACE_SNAPSHOT_INTERVAL = 1 << 16; // events, a multiple of the block size and at least the ring size
+const uint8_t TRACE_NO_REGISTER = 0xFF;
+
+enum TraceFlags
+{
+	TRACE_PC_JUMP = 1 << 0,
+	TRACE_I_CHANGED = 1 << 1,
+	TRACE_REG_CHANGED = 1 << 2,
+	TRACE_CYCLE_GAP = 1 << 3,
+};
+
+struct TraceFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t rom_hash;
+	uint64_t first_cycle;
+};
+
+struct TraceIndexEntry
+{
+	uint64_t first_cycle;
+	uint64_t offset; // of the block's first record
+	uint64_t snapshot_offset; // 0 when the block has none
+};
+
+struct TraceFileFooter
+{
+	uint64_t index_offset;
+	uint64_t block_count;
+	uint64_t event_count;
+	char magic[4];
+	uint32_t version;
+};
+
+// reg is the register the instruction changed, VF only when nothing else changed (8xy4 and
+// friends change both). Fx65 loads several, only the first is kept.
+struct TraceEvent
+{
+	uint64_t cycle;
+	uint16_t pc;
+	uint16_t op;
+	uint16_t i;
+	uint8_t reg;
+	uint8_t value;
+};
+
+// Running state of the delta encoding, the same on both ends.
+struct TraceCodec
+{
+	uint64_t cycle;
+	uint32_t pc;
+	uint32_t i;
+};
+
+struct Tracer
+{
+	bool enabled; // checked by next_op
+	std::atomic<uint32_t> head; // written by next_op
+	std::atomic<uint32_t> tail; // written by trace_drain
+	TraceEvent ring[TRACE_RING_SIZE];
+	uint8_t v_before[16];
+	Snapshot snapshots[2]; // taken by next_op at each TRACE_SNAPSHOT_INTERVAL, alternating
+
+	plat::FileHandle file;
+	TraceCodec codec;
+	uint8_t spill[TRACE_SPILL_SIZE];
+	uint32_t spill_size;
+	TraceIndexEntry* index;
+	uint64_t index_capacity;
+	uint64_t block_count;
+
+	uint64_t events;
+	uint64_t bytes;
+	bool failed; // a write failed, tracing stopped
+	bool out_of_memory; // so did growing the block index
+};
+
+// A finished trace file, mapped. Nothing is decoded until asked for.
+struct TraceReader
+{
+	plat::FileContents file;
+	TraceFileHeader header;
+	TraceFileFooter footer;
+	const TraceIndexEntry* index;
+};
+
+Tracer tracer;
+
+bool trace_start(plat::FilePath path);
+void trace_stop();
+static inline TraceEvent* trace_begin(uint16_t op);
+static inline void trace_end(TraceEvent* event);
+void trace_drain();
+
+void trace_codec_init(TraceCodec* codec, uint64_t first_cycle);
+uint8_t* trace_encode(TraceCodec* codec, const TraceEvent* event, uint8_t* out);
+const uint8_t* trace_decode(TraceCodec* codec, const uint8_t* in, const uint8_t* end, TraceEvent* event); // 0 when truncated
+
+bool trace_open(TraceReader* reader, plat::FilePath path);
+void trace_close(TraceReader* reader);
+int trace_read(const TraceReader* reader, uint64_t first_event, TraceEvent* events, int count); // returns how many were read
+uint64_t trace_find_cycle(const TraceReader* reader, uint64_t cycle); // first event at or after cycle
+bool trace_read_snapshot(const TraceReader* reader, uint64_t event, Snapshot* snapshot, uint64_t* snapshot_event); // latest one at or before event
+
+void imgui_trace_menu();
+void imgui_trace_windows();
+};
@@ -4,6 +4,7 @@
 
 #include "chip8emu_platform.h"
 #include "chip8emu.h"
+#include "chip8emu_zones.h"
 
 #include <d3d11.h>
 #include <limits.h>
@@ -23,23 +24,48 @@
 
 static CRITICAL_SECTION g_critical_section;
 
+// Time each thread spent blocked on g_critical_section, drained into the perf stats.
+static thread_local uint64_t g_lock_wait_ticks = 0;
+
+// Takes g_critical_section, recording a zone only when the other thread held it.
+static void lock_emulation()
+{
+    if(TryEnterCriticalSection(&g_critical_section))
+        return;
+    C8E_ZONE("lock wait");
+    uint64_t start = plat::get_ticks();
+    EnterCriticalSection(&g_critical_section);
+    g_lock_wait_ticks += plat::get_ticks() - start;
+}
+
 static HINSTANCE g_hinstance;
 static HWND g_hwnd;
 
 namespace plat
 {
 
-bool show_file_prompt(FilePath* path)
+// "*.ext\0*.ext\0All Files (*.*)\0*.*\0\0"
+static void make_file_filter(char* filter, const char* extension)
+{
+    int at = snprintf(filter, 32, "*.%s", extension) + 1;
+    at += snprintf(filter + at, 32, "*.%s", extension) + 1;
+    memcpy(filter + at, "All Files (*.*)\0*.*\0", sizeof("All Files (*.*)\0*.*\0"));
+}
+
+bool show_file_prompt(FilePath* path, const char* extension)
 {
     char* buf = (char*)malloc(MAX_PATH * sizeof(*buf));
     ZeroMemory(buf, MAX_PATH*sizeof(*buf));
 
+    char filter[128] = {0};
+    make_file_filter(filter, extension);
+
     OPENFILENAMEA ofn = {0};
     ofn.lStructSize = sizeof(ofn);
     ofn.hInstance = g_hinstance;
     ofn.hwndOwner = g_hwnd;
     ofn.lpstrTitle = "Open File";
-    ofn.lpstrFilter = "CHIP-8 Programs (*.ch8)\0*.ch8\0All Files (*.*)\0*.*\0";
+    ofn.lpstrFilter = filter;
     ofn.lpstrFile = buf;
     ofn.nMaxFile = MAX_PATH;
 
@@ -55,6 +81,38 @@ bool show_file_prompt(FilePath* path)
     }
 }
 
+bool show_save_prompt(FilePath* path, const char* extension)
+{
+    char* buf = (char*)malloc(MAX_PATH * sizeof(*buf));
+    ZeroMemory(buf, MAX_PATH*sizeof(*buf));
+
+    char filter[128] = {0};
+    make_file_filter(filter, extension);
+
+    OPENFILENAMEA ofn = {0};
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hInstance = g_hinstance;
+    ofn.hwndOwner = g_hwnd;
+    ofn.lpstrTitle = "Save File";
+    ofn.lpstrFilter = filter;
+    ofn.lpstrDefExt = extension;
+    ofn.lpstrFile = buf;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.Flags = OFN_OVERWRITEPROMPT;
+
+    if(GetSaveFileNameA(&ofn) && path)
+    {
+        path->data = buf;
+        path->len = strlen(path->data);
+        return true;
+    }
+    else
+    {
+        free(buf);
+        return false;
+    }
+}
+
 void unload_path(FilePath path)
 {
     if(path.data)
@@ -114,7 +172,116 @@ FileContents load_entire_file(FilePath path)
 }
 void unload_file(FileContents contents)
 {
-    VirtualFree(contents.data, contents.len, MEM_DECOMMIT | MEM_RELEASE);
+    VirtualFree(contents.data, 0, MEM_RELEASE);
+}
+
+bool write_entire_file(FilePath path, const void* data, size_t size)
+{
+    HANDLE file = CreateFileA(path.data, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    if(size > UINT32_MAX)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    DWORD bytes_written;
+    bool result = WriteFile(file, data, (DWORD)size, &bytes_written, 0) && bytes_written == size;
+    CloseHandle(file);
+    return result;
+}
+
+FileContents map_file(FilePath path)
+{
+    FileContents contents = {0};
+
+    HANDLE file = CreateFileA(path.data, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return contents;
+    }
+
+    LARGE_INTEGER size;
+    if(GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+        if(mapping)
+        {
+            contents.data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if(contents.data)
+                contents.len = (size_t)size.QuadPart;
+            // The view keeps the mapping alive.
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    return contents;
+}
+
+void unmap_file(FileContents contents)
+{
+    if(contents.data)
+        UnmapViewOfFile(contents.data);
+}
+
+FileHandle open_file_for_writing(FilePath path)
+{
+    HANDLE file = CreateFileA(path.data, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+    return file;
+}
+
+bool write_file(FileHandle file, const void* data, size_t size)
+{
+    DWORD bytes_written;
+    return size <= UINT32_MAX && WriteFile((HANDLE)file, data, (DWORD)size, &bytes_written, 0) && bytes_written == size;
+}
+
+void close_file(FileHandle file)
+{
+    if(file)
+        CloseHandle((HANDLE)file);
+}
+
+FileHandle open_temp_file()
+{
+    char dir[MAX_PATH];
+    char path[MAX_PATH];
+    if(!GetTempPathA(MAX_PATH, dir) || !GetTempFileNameA(dir, "c8e", 0, path))
+    {
+        return 0;
+    }
+    HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, 0);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+    return file;
+}
+
+bool read_file_at(FileHandle file, uint64_t offset, void* data, size_t size)
+{
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD bytes_read;
+    return size <= UINT32_MAX && ReadFile((HANDLE)file, data, (DWORD)size, &bytes_read, &overlapped) && bytes_read == size;
+}
+
+bool write_file_at(FileHandle file, uint64_t offset, const void* data, size_t size)
+{
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = (DWORD)offset;
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD bytes_written;
+    return size <= UINT32_MAX && WriteFile((HANDLE)file, data, (DWORD)size, &bytes_written, &overlapped) && bytes_written == size;
 }
 
 void update_input()
@@ -122,7 +289,10 @@ void update_input()
     ImGuiIO& io = ImGui::GetIO();
     io.WantCaptureKeyboard = true;
 
-    EnterCriticalSection(&g_critical_section);
+    lock_emulation();
+    // Keys only change between frames, also when the debugger stopped in the middle of one,
+    // or replaying it would take different input.
+    if(c8e::debugger.frame_ops_left == 0)
     {
         c8e::c8.keys[0]   = ImGui::IsKeyDown(ImGuiKey_X);
         c8e::c8.keys[1]   = ImGui::IsKeyDown(ImGuiKey_1);
@@ -141,11 +311,26 @@ void update_input()
         c8e::c8.keys[0xE] = ImGui::IsKeyDown(ImGuiKey_F);
         c8e::c8.keys[0xF] = ImGui::IsKeyDown(ImGuiKey_V);
     }
+    c8e::rewind_history.rewinding = ImGui::IsKeyDown(ImGuiKey_Backspace);
     LeaveCriticalSection(&g_critical_section);
 
     io.WantCaptureKeyboard = false;
 }
 
+uint64_t get_ticks()
+{
+    LARGE_INTEGER ticks;
+    QueryPerformanceCounter(&ticks);
+    return ticks.QuadPart;
+}
+
+uint64_t get_ticks_per_second()
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    return freq.QuadPart;
+}
+
 };
 
 // Data
@@ -178,6 +363,35 @@ static inline double get_elapsed(LARGE_INTEGER start, LARGE_INTEGER end, LARGE_I
     return elapsed_mus.QuadPart / 1000000.0;
 }
 
+static VOID CALLBACK SampleTimerProc(PVOID param, BOOLEAN fired)
+{
+    c8e::sample_guest_from_timer();
+}
+
+// The 1 kHz sampling timer only exists while the sampler is on, since timeBeginPeriod(1) raises the
+// timer resolution for the whole system.
+static void update_sample_timer(HANDLE* timer, bool on)
+{
+    if(on == (*timer != 0))
+        return;
+    if(on)
+    {
+        timeBeginPeriod(1);
+        if(!CreateTimerQueueTimer(timer, 0, SampleTimerProc, 0, 1, 1, WT_EXECUTEINTIMERTHREAD))
+        {
+            *timer = 0;
+            timeEndPeriod(1);
+            c8e::sampler.enabled.store(false);
+        }
+    }
+    else
+    {
+        DeleteTimerQueueTimer(0, *timer, INVALID_HANDLE_VALUE);
+        *timer = 0;
+        timeEndPeriod(1);
+    }
+}
+
 DWORD WINAPI ThreadProc(LPVOID param)
 {
     LARGE_INTEGER start_second, start_timer;
@@ -189,16 +403,20 @@ DWORD WINAPI ThreadProc(LPVOID param)
     QueryPerformanceCounter(&start_second);
 
     static int debug_de_facto_ips = 0;
+    static int debug_presented_frames = 0;
+    static int debug_run_ahead_ops = 0;
+    static LONGLONG debug_run_ahead_ticks = 0;
 
     HANDLE timer = CreateWaitableTimerA(0, TRUE, 0);
     LARGE_INTEGER due_time;
     due_time.QuadPart = -166666LL;
 
     SetWaitableTimer(timer, &due_time, 0, 0, 0, 0);
+    C8E_ZONE_THREAD("emulation");
 
     for(;;)
     {
-        EnterCriticalSection(&g_critical_section);
+        lock_emulation();
         {
             if(!c8e::c8.loaded)
             {
@@ -209,23 +427,65 @@ DWORD WINAPI ThreadProc(LPVOID param)
         }
         LeaveCriticalSection(&g_critical_section);
 
-        EnterCriticalSection(&g_critical_section);
-            c8e::update_timers();
-        LeaveCriticalSection(&g_critical_section);
-
-        double ipt_d = c8e::c8.ips / 60.0;
-        static double carry = 0.0; 
-        carry += ipt_d - (long long)ipt_d;
-        long long ipt = (c8e::c8.ips / 60) + (carry >= 1.0);
-        while(carry >= 1.0)
-            carry -= 1.0;
-        for(int i = 0; i < ipt; i++)
+        // The whole frame runs under one lock, so input only changes between frames.
+        lock_emulation();
         {
-            EnterCriticalSection(&g_critical_section);
-                c8e::next_op();
-            LeaveCriticalSection(&g_critical_section);
-            debug_de_facto_ips++;
+            C8E_ZONE("emu frame");
+            uint64_t frame_start = plat::get_ticks();
+            int frame_ops = 0;
+            bool movie_active = c8e::movie_state.mode != c8e::MOVIE_OFF;
+            if(c8e::debugger.paused)
+            {
+                // The debugger steps from the UI thread.
+            }
+            else if(c8e::debugger.frame_ops_left > 0)
+            {
+                frame_ops = c8e::debug_finish_frame();
+                if(c8e::debugger.frame_ops_left == 0)
+                {
+                    if(movie_active)
+                        c8e::movie_end_frame(&c8e::movie_state);
+                    else if(c8e::rewind_history.enabled)
+                        c8e::rewind_push(&c8e::rewind_history);
+                }
+            }
+            else if(c8e::rewind_history.rewinding && c8e::rewind_history.enabled && !movie_active)
+            {
+                c8e::rewind_step_back(&c8e::rewind_history);
+            }
+            else if(movie_active)
+            {
+                frame_ops = c8e::movie_run_frame(&c8e::movie_state);
+            }
+            else
+            {
+                frame_ops = c8e::run_frame();
+                if(c8e::rewind_history.enabled && c8e::debugger.frame_ops_left == 0)
+                {
+                    c8e::rewind_push(&c8e::rewind_history);
+                }
+            }
+
+            // Speculative frames are never recorded, and rewinding shows the real state.
+            if(c8e::rewind_history.rewinding || c8e::debugger.paused || c8e::run_ahead_state.frames <= 0)
+            {
+                c8e::run_ahead_state.valid = false;
+            }
+            else
+            {
+                LARGE_INTEGER run_ahead_start, run_ahead_end;
+                QueryPerformanceCounter(&run_ahead_start);
+                debug_run_ahead_ops += c8e::run_ahead(&c8e::run_ahead_state);
+                QueryPerformanceCounter(&run_ahead_end);
+                debug_run_ahead_ticks += run_ahead_end.QuadPart - run_ahead_start.QuadPart;
+            }
+            debug_de_facto_ips += frame_ops;
+            debug_presented_frames++;
+
+            c8e::perf_emu_frame(frame_ops, frame_start, plat::get_ticks(), g_lock_wait_ticks);
+            g_lock_wait_ticks = 0;
         }
+        LeaveCriticalSection(&g_critical_section);
         
         QueryPerformanceCounter(&end_second);
         if(get_elapsed(start_second, end_second, freq) >= 1.0)
@@ -234,10 +494,23 @@ DWORD WINAPI ThreadProc(LPVOID param)
             snprintf(buf, 64, "Defacto ips this second: %d\n", debug_de_facto_ips);
             OutputDebugStringA(buf);
             debug_de_facto_ips = 0;
+
+            lock_emulation();
+            {
+                c8e::run_ahead_state.cost_us_per_frame = (float)(debug_run_ahead_ticks * 1000000.0 / freq.QuadPart / debug_presented_frames);
+                c8e::run_ahead_state.ops_per_frame = (float)debug_run_ahead_ops / debug_presented_frames;
+            }
+            LeaveCriticalSection(&g_critical_section);
+            debug_presented_frames = 0;
+            debug_run_ahead_ops = 0;
+            debug_run_ahead_ticks = 0;
             QueryPerformanceCounter(&start_second);
         }
 
-        WaitForSingleObject(timer, INFINITE);
+        {
+            C8E_ZONE("wait frame timer");
+            WaitForSingleObject(timer, INFINITE);
+        }
         SetWaitableTimer(timer, &due_time, 0, 0, 0, 0);
     }
 
@@ -275,9 +548,12 @@ static inline void display_init()
     texture2d_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     texture2d_desc.MiscFlags = 0;
 
+    static uint32_t initial_pixels[64*32];
+    c8e::display_to_rgba(c8e::c8.display, initial_pixels, c8e::c8.display_w);
+
     D3D11_SUBRESOURCE_DATA texture_subresource = {};
-    texture_subresource.pSysMem = c8e::c8.display;
-    texture_subresource.SysMemPitch = c8e::c8.display_w * sizeof(*c8e::c8.display);
+    texture_subresource.pSysMem = initial_pixels;
+    texture_subresource.SysMemPitch = c8e::c8.display_w * sizeof(*initial_pixels);
 
     HRESULT hr = g_pd3dDevice->CreateTexture2D(&texture2d_desc, &texture_subresource, &g_display_texture);
     assert(SUCCEEDED(hr));
@@ -409,14 +685,12 @@ static inline void display_render(RECT display_bounds)
     g_pd3dDeviceContext->PSSetShaderResources(0, 1, &g_display_rec_view);
     g_pd3dDeviceContext->PSSetSamplers(0, 1, &g_display_sampler_state);
 
-    EnterCriticalSection(&g_critical_section);
+    lock_emulation();
     {
-        D3D11_SUBRESOURCE_DATA texture_subresource = {};
-        texture_subresource.pSysMem = c8e::c8.display;
-        texture_subresource.SysMemPitch = c8e::c8.display_w * sizeof(*c8e::c8.display);
+        C8E_ZONE("display upload");
         D3D11_MAPPED_SUBRESOURCE mapped_resource = {0};
         g_pd3dDeviceContext->Map(g_display_texture, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-        memcpy(mapped_resource.pData, c8e::c8.display, c8e::c8.display_w * c8e::c8.display_h * sizeof(*c8e::c8.display));
+        c8e::display_to_rgba(c8e::presented_display(), (uint32_t*)mapped_resource.pData, mapped_resource.RowPitch / sizeof(uint32_t));
         g_pd3dDeviceContext->Unmap(g_display_texture, 0);
     }
     LeaveCriticalSection(&g_critical_section);
@@ -460,6 +734,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 
     ImGuiIO io;
     c8e::initialize(io);
+    c8e::rewind_init(&c8e::rewind_history, 10*60*60, 8*1024*1024); // ten minutes
+    c8e::debug_init(&c8e::debugger, c8e::DEBUG_DEFAULT_BUDGET);
 
     display_init();
 
@@ -483,9 +759,12 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 
     SetThreadPriority(cpu_thread, THREAD_PRIORITY_TIME_CRITICAL);
 
+    HANDLE sample_timer = 0;
+
     ResumeThread(cpu_thread);
     // Main loop
     bool done = false;
+    C8E_ZONE_THREAD("ui");
     while (!done)
     {
         // Poll and handle messages (inputs, window resize, etc.)
@@ -510,11 +789,14 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
         plat::update_input();
 
         // Start the Dear ImGui frame
-        ImGui_ImplDX11_NewFrame();
-        ImGui_ImplWin32_NewFrame();
-        ImGui::NewFrame();
+        {
+            C8E_ZONE("ImGui::NewFrame");
+            ImGui_ImplDX11_NewFrame();
+            ImGui_ImplWin32_NewFrame();
+            ImGui::NewFrame();
+        }
 
-        EnterCriticalSection(&g_critical_section);
+        lock_emulation();
         {
             if(c8e::c8.vs > 0)
             {
@@ -530,10 +812,20 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
         float menubar_h = ImGui::GetWindowHeight();
         ImGui::EndMainMenuBar();
 
-        c8e::imgui_generic();
-        ImGui::Render();
+        // The menus load ROMs and start movies, so keep the emulation thread out meanwhile.
+        lock_emulation();
+        {
+            C8E_ZONE("imgui_generic");
+            c8e::imgui_generic();
+        }
+        LeaveCriticalSection(&g_critical_section);
+        update_sample_timer(&sample_timer, c8e::sampler.enabled.load());
+        {
+            C8E_ZONE("ImGui::Render");
+            ImGui::Render();
+        }
 
-        EnterCriticalSection(&g_critical_section);
+        lock_emulation();
         if(c8e::c8.update_display || message_count > 0)
         {
             c8e::c8.update_display = false;
@@ -547,11 +839,25 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
             GetClientRect(hwnd, &display_bounds);
             display_bounds.top = (LONG)menubar_h;
 
-            display_render(display_bounds);
+            {
+                C8E_ZONE("display_render");
+                display_render(display_bounds);
+            }
+
+            {
+                C8E_ZONE("ImGui_ImplDX11_RenderDrawData");
+                ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+            }
 
-            ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+            {
+                C8E_ZONE("Present");
+                g_pSwapChain->Present(1, 0);
+            }
 
-            g_pSwapChain->Present(1, 0);
+            lock_emulation();
+            c8e::perf_present(plat::get_ticks(), g_lock_wait_ticks);
+            g_lock_wait_ticks = 0;
+            LeaveCriticalSection(&g_critical_section);
         }
         else
         {
@@ -564,6 +870,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
     }
 
     // Cleanup
+    update_sample_timer(&sample_timer, false);
+
     ImGui_ImplDX11_Shutdown();
     ImGui_ImplWin32_Shutdown();
     ImGui::DestroyContext();
@@ -650,7 +958,7 @@ LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
     case WM_SIZE:
         if (g_pd3dDevice != NULL && wParam != SIZE_MINIMIZED)
         {
-            EnterCriticalSection(&g_critical_section);
+            lock_emulation();
             {
                 c8e::c8.update_display = true;
             }
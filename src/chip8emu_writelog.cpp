@@ -0,0 +1,448 @@
+#include "imgui.h"
+#include "chip8emu.h"
+#include "chip8emu_writelog.h"
+#include "chip8emu_debugger.h"
+#include "chip8emu_platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace c8e
+{
+
+static const uint64_t WRITE_LOG_OFFSETS_SIZE = (MEMORY_SIZE + 1) * sizeof(uint32_t);
+static const uint64_t WRITE_LOG_SLOT_SIZE = WRITE_LOG_OFFSETS_SIZE + (uint64_t)WRITE_LOG_SEGMENT_WRITES * sizeof(MemoryWrite);
+
+bool write_log_init(WriteLog* log)
+{
+    write_log_free(log);
+
+    log->open = (MemoryWrite*)malloc(WRITE_LOG_SEGMENT_WRITES * sizeof(MemoryWrite));
+    log->open_prev = (int32_t*)malloc(WRITE_LOG_SEGMENT_WRITES * sizeof(int32_t));
+    log->scratch = (MemoryWrite*)malloc(WRITE_LOG_SEGMENT_WRITES * sizeof(MemoryWrite));
+    log->offsets = (uint32_t*)malloc(WRITE_LOG_OFFSETS_SIZE);
+    log->segments = (WriteSegment*)malloc(WRITE_LOG_MAX_SEGMENTS * sizeof(WriteSegment));
+    log->file = plat::open_temp_file();
+    if(!log->open || !log->open_prev || !log->scratch || !log->offsets || !log->segments || !log->file)
+    {
+        write_log_free(log);
+        return false;
+    }
+
+    memset(log->open_last, 0xFF, sizeof(log->open_last));
+    memcpy(log->shadow, c8.memory, MEMORY_SIZE);
+    log->open_count = 0;
+    log->first_segment = 0;
+    log->segment_end = 0;
+    log->next_cycle = 0;
+    log->skip_until = 0;
+    log->total = 0;
+    log->failed = false;
+    log->enabled = true;
+    return true;
+}
+
+void write_log_free(WriteLog* log)
+{
+    free(log->open);
+    free(log->open_prev);
+    free(log->scratch);
+    free(log->offsets);
+    free(log->segments);
+    plat::close_file(log->file);
+    log->open = 0;
+    log->open_prev = 0;
+    log->scratch = 0;
+    log->offsets = 0;
+    log->segments = 0;
+    log->file = 0;
+    log->open_count = 0;
+    log->first_segment = 0;
+    log->segment_end = 0;
+    log->enabled = false;
+}
+
+// Sorts the open segment by address into scratch and spills it to the next slot.
+static bool seal_open_segment(WriteLog* log)
+{
+    if(log->segment_end - log->first_segment == WRITE_LOG_MAX_SEGMENTS)
+    {
+        log->first_segment++;
+    }
+    uint64_t n = log->segment_end;
+    WriteSegment* segment = &log->segments[n % WRITE_LOG_MAX_SEGMENTS];
+    memset(segment->addresses, 0, sizeof(segment->addresses));
+
+    // Counting sort, stable so each address's writes stay in cycle order.
+    uint32_t* offsets = log->offsets;
+    memset(offsets, 0, WRITE_LOG_OFFSETS_SIZE);
+    for(uint32_t w = 0; w < log->open_count; w++)
+    {
+        offsets[log->open[w].addr + 1]++;
+    }
+    for(int a = 0; a < MEMORY_SIZE; a++)
+    {
+        if(offsets[a + 1])
+            segment->addresses[a / 64] |= 1ull << (a % 64);
+        offsets[a + 1] += offsets[a];
+    }
+    for(uint32_t w = 0; w < log->open_count; w++)
+    {
+        log->scratch[offsets[log->open[w].addr]++] = log->open[w];
+    }
+    // Each offset now points at the end of its address's writes, which is where the next one starts.
+    memmove(offsets + 1, offsets, MEMORY_SIZE * sizeof(uint32_t));
+    offsets[0] = 0;
+
+    uint64_t slot = (n % WRITE_LOG_MAX_SEGMENTS) * WRITE_LOG_SLOT_SIZE;
+    if(!plat::write_file_at(log->file, slot, offsets, WRITE_LOG_OFFSETS_SIZE) ||
+       !plat::write_file_at(log->file, slot + WRITE_LOG_OFFSETS_SIZE, log->scratch, log->open_count * sizeof(MemoryWrite)))
+    {
+        log->failed = true;
+        log->enabled = false;
+        return false;
+    }
+
+    segment->first_cycle = log->open[0].cycle;
+    segment->end_cycle = log->open[log->open_count - 1].cycle + 1;
+    segment->count = log->open_count;
+    log->segment_end++;
+    log->open_count = 0;
+    memset(log->open_last, 0xFF, sizeof(log->open_last));
+    return true;
+}
+
+// Forgets everything logged at or after cycle.
+static void cut_history(WriteLog* log, uint64_t cycle)
+{
+    while(log->open_count > 0 && log->open[log->open_count - 1].cycle >= cycle)
+    {
+        uint32_t w = --log->open_count;
+        log->open_last[log->open[w].addr] = log->open_prev[w];
+    }
+    while(log->open_count == 0 && log->segment_end > log->first_segment)
+    {
+        WriteSegment* segment = &log->segments[(log->segment_end - 1) % WRITE_LOG_MAX_SEGMENTS];
+        if(segment->first_cycle < cycle)
+        {
+            if(segment->end_cycle > cycle)
+                segment->end_cycle = cycle;
+            break;
+        }
+        log->segment_end--;
+    }
+    log->next_cycle = cycle;
+    log->skip_until = 0;
+}
+
+// Called by mark_memory_written, after the bytes were written.
+void write_log_record(WriteLog* log, uint16_t addr, uint16_t count)
+{
+    if(c8.cycle < log->skip_until)
+    {
+        for(uint16_t n = 0; n < count; n++)
+        {
+            uint16_t a = (addr + n) % MEMORY_SIZE;
+            log->shadow[a] = c8.memory[a];
+        }
+        return;
+    }
+
+    for(uint16_t n = 0; n < count; n++)
+    {
+        if(log->open_count == WRITE_LOG_SEGMENT_WRITES && !seal_open_segment(log))
+            return;
+
+        uint16_t a = (addr + n) % MEMORY_SIZE;
+        uint32_t w = log->open_count++;
+        MemoryWrite* write = &log->open[w];
+        write->cycle = c8.cycle;
+        write->pc = c8.pc;
+        write->addr = a;
+        write->old_value = log->shadow[a];
+        write->new_value = c8.memory[a];
+        log->open_prev[w] = log->open_last[a];
+        log->open_last[a] = (int32_t)w;
+        log->shadow[a] = c8.memory[a];
+    }
+    log->total += count;
+    log->next_cycle = c8.cycle + 1;
+}
+
+// Memory was replaced wholesale, or the debugger stopped replaying. Going back in time either
+// replays what is logged already or starts over from here.
+void write_log_resync(WriteLog* log)
+{
+    memcpy(log->shadow, c8.memory, MEMORY_SIZE);
+    if(c8.cycle < log->next_cycle)
+    {
+        if(debugger.replaying)
+            log->skip_until = log->next_cycle;
+        else
+            cut_history(log, c8.cycle);
+    }
+}
+
+static bool read_offsets(WriteLog* log, uint64_t n, uint16_t first_addr, uint16_t last_addr, uint32_t* start, uint32_t* end)
+{
+    uint64_t slot = (n % WRITE_LOG_MAX_SEGMENTS) * WRITE_LOG_SLOT_SIZE;
+    return plat::read_file_at(log->file, slot + first_addr * sizeof(uint32_t), start, sizeof(uint32_t)) &&
+           plat::read_file_at(log->file, slot + (last_addr + 1) * sizeof(uint32_t), end, sizeof(uint32_t));
+}
+
+static bool read_writes(WriteLog* log, uint64_t n, uint32_t first, uint32_t count, MemoryWrite* writes)
+{
+    uint64_t slot = (n % WRITE_LOG_MAX_SEGMENTS) * WRITE_LOG_SLOT_SIZE;
+    return plat::read_file_at(log->file, slot + WRITE_LOG_OFFSETS_SIZE + first * sizeof(MemoryWrite), writes, count * sizeof(MemoryWrite));
+}
+
+static bool touches_range(const WriteSegment* segment, uint16_t first_addr, uint16_t last_addr)
+{
+    for(int word = first_addr / 64; word <= last_addr / 64; word++)
+    {
+        uint64_t mask = ~0ull;
+        if(word == first_addr / 64)
+            mask &= ~0ull << (first_addr % 64);
+        if(word == last_addr / 64)
+            mask &= ~0ull >> (63 - last_addr % 64);
+        if(segment->addresses[word] & mask)
+            return true;
+    }
+    return false;
+}
+
+// The newest write to addr before before_cycle. Walks the open segment's chain for addr, then
+// binary searches the newest spilled segment that has any.
+bool write_log_last(WriteLog* log, uint16_t addr, uint64_t before_cycle, MemoryWrite* write)
+{
+    if(!log->file)
+        return false;
+    addr %= MEMORY_SIZE;
+
+    for(int32_t w = log->open_last[addr]; w >= 0; w = log->open_prev[w])
+    {
+        if(log->open[w].cycle < before_cycle)
+        {
+            *write = log->open[w];
+            return true;
+        }
+    }
+
+    for(uint64_t n = log->segment_end; n-- > log->first_segment; )
+    {
+        const WriteSegment* segment = &log->segments[n % WRITE_LOG_MAX_SEGMENTS];
+        if(segment->first_cycle >= before_cycle || !(segment->addresses[addr / 64] & (1ull << (addr % 64))))
+            continue;
+
+        uint32_t start, end;
+        if(!read_offsets(log, n, addr, addr, &start, &end))
+            return false;
+        uint64_t limit = before_cycle < segment->end_cycle ? before_cycle : segment->end_cycle;
+        uint32_t low = start;
+        uint32_t high = end;
+        while(low < high)
+        {
+            uint32_t mid = low + (high - low) / 2;
+            MemoryWrite probe;
+            if(!read_writes(log, n, mid, 1, &probe))
+                return false;
+            if(probe.cycle < limit)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        if(low > start)
+        {
+            return read_writes(log, n, low - 1, 1, write);
+        }
+    }
+    return false;
+}
+
+static int compare_newest_first(const void* a, const void* b)
+{
+    uint64_t cycle_a = ((const MemoryWrite*)a)->cycle;
+    uint64_t cycle_b = ((const MemoryWrite*)b)->cycle;
+    if(cycle_a != cycle_b)
+        return cycle_a < cycle_b ? 1 : -1;
+    return (int)((const MemoryWrite*)a)->addr - (int)((const MemoryWrite*)b)->addr;
+}
+
+// Spilled segments keep the writes to a range of addresses next to each other, so each one
+// costs a single read.
+int write_log_query(WriteLog* log, uint16_t first_addr, uint16_t last_addr, uint64_t before_cycle, MemoryWrite* writes, int max)
+{
+    if(!log->file || first_addr > last_addr || first_addr >= MEMORY_SIZE)
+        return 0;
+    if(last_addr >= MEMORY_SIZE)
+        last_addr = MEMORY_SIZE - 1;
+
+    int found = 0;
+    for(uint32_t w = log->open_count; w-- > 0 && found < max; )
+    {
+        const MemoryWrite* write = &log->open[w];
+        if(write->cycle < before_cycle && write->addr >= first_addr && write->addr <= last_addr)
+            writes[found++] = *write;
+    }
+
+    for(uint64_t n = log->segment_end; n-- > log->first_segment && found < max; )
+    {
+        const WriteSegment* segment = &log->segments[n % WRITE_LOG_MAX_SEGMENTS];
+        if(segment->first_cycle >= before_cycle || !touches_range(segment, first_addr, last_addr))
+            continue;
+
+        uint32_t start, end;
+        if(!read_offsets(log, n, first_addr, last_addr, &start, &end) || !read_writes(log, n, start, end - start, log->scratch))
+            break;
+        uint64_t limit = before_cycle < segment->end_cycle ? before_cycle : segment->end_cycle;
+        uint32_t kept = 0;
+        for(uint32_t w = 0; w < end - start; w++)
+        {
+            if(log->scratch[w].cycle < limit)
+                log->scratch[kept++] = log->scratch[w];
+        }
+        qsort(log->scratch, kept, sizeof(MemoryWrite), compare_newest_first);
+        for(uint32_t w = 0; w < kept && found < max; w++)
+        {
+            writes[found++] = log->scratch[w];
+        }
+    }
+    return found;
+}
+
+uint64_t write_log_first_cycle(const WriteLog* log)
+{
+    if(log->segment_end > log->first_segment)
+        return log->segments[log->first_segment % WRITE_LOG_MAX_SEGMENTS].first_cycle;
+    if(log->open_count)
+        return log->open[0].cycle;
+    return log->next_cycle;
+}
+
+#ifdef USE_IMGUI
+static bool g_show_write_log = false;
+
+void imgui_write_log_menu()
+{
+    if(ImGui::BeginMenu("Debug"))
+    {
+        ImGui::Separator();
+        ImGui::MenuItem("Memory writes", 0, &g_show_write_log);
+        if(ImGui::MenuItem("Log memory writes", 0, write_log.enabled))
+        {
+            if(write_log.enabled)
+                write_log_free(&write_log);
+            else
+                write_log_init(&write_log);
+        }
+        ImGui::EndMenu();
+    }
+}
+
+void imgui_write_log_windows()
+{
+    if(!g_show_write_log)
+        return;
+
+    const int max_shown = 1024;
+    static MemoryWrite writes[max_shown];
+    static int write_count = 0;
+    static uint16_t first_addr = 0;
+    static uint16_t last_addr = MEMORY_SIZE - 1;
+    static uint64_t queried_total = UINT64_MAX;
+    static uint64_t queried_end = UINT64_MAX;
+
+    ImGui::SetNextWindowSize(ImVec2(460, 360), ImGuiCond_FirstUseEver);
+    if(ImGui::Begin("Memory writes", &g_show_write_log))
+    {
+        bool changed = false;
+        ImGui::SetNextItemWidth(50);
+        changed |= ImGui::InputScalar("to", ImGuiDataType_U16, &first_addr, 0, 0, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(50);
+        changed |= ImGui::InputScalar("##last", ImGuiDataType_U16, &last_addr, 0, 0, "%03X", ImGuiInputTextFlags_CharsHexadecimal);
+
+        if(!write_log.file)
+        {
+            ImGui::Text("Logging is off (Debug > Log memory writes)");
+            write_count = 0;
+            queried_total = UINT64_MAX;
+        }
+        else
+        {
+            uint64_t end = write_log.segment_end * WRITE_LOG_SEGMENT_WRITES + write_log.open_count;
+            if(changed || queried_total != write_log.total || queried_end != end)
+            {
+                write_count = write_log_query(&write_log, first_addr, last_addr, UINT64_MAX, writes, max_shown);
+                queried_total = write_log.total;
+                queried_end = end;
+            }
+            ImGui::Text("%llu writes logged since cycle %llu, %llu segments on disk",
+                        (unsigned long long)write_log.total, (unsigned long long)write_log_first_cycle(&write_log),
+                        (unsigned long long)(write_log.segment_end - write_log.first_segment));
+            if(write_log.failed)
+                ImGui::Text("Spilling to disk failed, logging stopped");
+            if(debugger.enabled)
+                ImGui::TextDisabled("Double-click a write to go to it");
+        }
+
+        ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersV;
+        if(ImGui::BeginTable("writes", 6, flags))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Cycle");
+            ImGui::TableSetupColumn("PC");
+            ImGui::TableSetupColumn("Instruction");
+            ImGui::TableSetupColumn("Addr");
+            ImGui::TableSetupColumn("Old");
+            ImGui::TableSetupColumn("New");
+            ImGui::TableHeadersRow();
+
+            ImGuiListClipper clipper;
+            clipper.Begin(write_count);
+            while(clipper.Step())
+            {
+                for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+                {
+                    const MemoryWrite* write = &writes[row];
+                    char text[32];
+                    uint16_t op = (c8.memory[write->pc] << 8) | c8.memory[(write->pc + 1) % MEMORY_SIZE];
+                    disassemble(op, text, sizeof(text));
+
+                    // Writes ahead of the machine are history the debugger is replaying.
+                    bool ahead = write->cycle >= c8.cycle;
+                    if(ahead)
+                        ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled));
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    char label[32];
+                    snprintf(label, sizeof(label), "%llu##%d", (unsigned long long)write->cycle, row);
+                    if(ImGui::Selectable(label, false, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick) &&
+                       ImGui::IsMouseDoubleClicked(0) && debugger.enabled)
+                    {
+                        debug_seek(write->cycle);
+                    }
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%03X", write->pc);
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(text);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%03X", write->addr);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%02X", write->old_value);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%02X", write->new_value);
+                    if(ahead)
+                        ImGui::PopStyleColor();
+                }
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+#else
+#define imgui_write_log_menu(...)
+#define imgui_write_log_windows(...)
+#endif
+
+};
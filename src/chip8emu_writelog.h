@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu.h"
+#include "chip8emu_platform.h"
+
+namespace c8e
+{
+// Memory-write history, for finding the instruction that last wrote an address.
+// mark_memory_written hands every write to write_log_record, which gets the old values from a
+// shadow copy of memory, so anything that already calls mark_memory_written is covered.
+//
+// Writes go into the open segment in cycle order, each linked to the previous write to the
+// same address. A full segment is sorted by address (cycle order kept within an address) and
+// spilled to a slot of a scratch file, as a table of where each address's writes start and
+// then the writes. Only a bitmap of the addresses it touched stays in memory. The file is a
+// ring of WRITE_LOG_MAX_SEGMENTS slots, so memory and disk stay bounded and the oldest history
+// is dropped first. "Last write to an address" skips the segments whose bitmap misses it, then
+// binary searches one address's writes on disk.
+//
+// Going back in time (rewind, snapshot load, reset) cuts off everything logged from then on,
+// unless the debugger is replaying history: those writes are logged already and get skipped
+// until it goes live again.
+const uint32_t WRITE_LOG_SEGMENT_WRITES = 1 << 16;
+const uint32_t WRITE_LOG_MAX_SEGMENTS = 64; // about 66 MB of scratch file
+
+struct MemoryWrite
+{
+	uint64_t cycle;
+	uint16_t pc;
+	uint16_t addr;
+	uint8_t old_value;
+	uint8_t new_value;
+	uint8_t reserved[2];
+};
+
+struct WriteSegment
+{
+	uint64_t first_cycle;
+	uint64_t end_cycle; // exclusive, lowered when history is cut off
+	uint32_t count;
+	uint64_t addresses[MEMORY_SIZE / 64]; // bitmap
+};
+
+struct WriteLog
+{
+	bool enabled;
+	bool failed; // a spill failed, logging stopped
+	uint8_t shadow[MEMORY_SIZE];
+
+	MemoryWrite* open; // the newest writes, in cycle order
+	int32_t* open_prev; // previous write to the same address in open, -1 for none
+	int32_t open_last[MEMORY_SIZE]; // newest write to each address in open, -1 for none
+	uint32_t open_count;
+
+	plat::FileHandle file;
+	WriteSegment* segments; // segment n is in segments[n % WRITE_LOG_MAX_SEGMENTS] and slot n of the file
+	uint64_t first_segment;
+	uint64_t segment_end;
+	MemoryWrite* scratch; // for sorting and range queries
+	uint32_t* offsets; // MEMORY_SIZE + 1
+
+	uint64_t next_cycle; // newest logged cycle + 1
+	uint64_t skip_until; // replaying writes logged already
+
+	uint64_t total; // writes logged, dropped ones included
+};
+
+WriteLog write_log;
+
+bool write_log_init(WriteLog* log);
+void write_log_free(WriteLog* log);
+void write_log_record(WriteLog* log, uint16_t addr, uint16_t count);
+void write_log_resync(WriteLog* log);
+
+bool write_log_last(WriteLog* log, uint16_t addr, uint64_t before_cycle, MemoryWrite* write);
+int write_log_query(WriteLog* log, uint16_t first_addr, uint16_t last_addr, uint64_t before_cycle, MemoryWrite* writes, int max); // newest first
+uint64_t write_log_first_cycle(const WriteLog* log); // oldest write still kept
+
+void imgui_write_log_menu();
+void imgui_write_log_windows();
+};
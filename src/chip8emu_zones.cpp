@@ -0,0 +1,182 @@
+#include "imgui.h"
+#include "chip8emu_zones.h"
+#include "chip8emu_platform.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef USE_ZONES
+namespace c8e
+{
+
+static ZoneThread* zone_claim_thread(const char* name)
+{
+    int index = zone_state.thread_count.fetch_add(1);
+    if(index >= MAX_ZONE_THREADS)
+    {
+        zone_state.thread_count.store(MAX_ZONE_THREADS);
+        return 0;
+    }
+    ZoneThread* thread = &zone_state.threads[index];
+    thread->name = name;
+    return thread;
+}
+
+void zone_thread_name(const char* name)
+{
+    if(zone_thread)
+        zone_thread->name = name;
+    else
+        zone_thread = zone_claim_thread(name);
+}
+
+static inline void zone_write(const char* name, uint64_t begin, int64_t end_or_value, uint32_t kind)
+{
+    if(!zone_state.enabled.load(std::memory_order_relaxed))
+        return;
+    if(!zone_thread)
+    {
+        zone_thread = zone_claim_thread("thread");
+        if(!zone_thread)
+            return;
+    }
+
+    uint32_t head = zone_thread->head.load(std::memory_order_relaxed);
+    ZoneEvent* event = &zone_thread->events[head & (ZONE_RING_SIZE - 1)];
+    event->name = name;
+    event->begin = begin;
+    event->end_or_value = end_or_value;
+    event->kind = kind;
+    zone_thread->head.store(head + 1, std::memory_order_release);
+}
+
+static inline void zone_counter(const char* name, int64_t value)
+{
+    if(zone_state.enabled.load(std::memory_order_relaxed))
+        zone_write(name, plat::get_ticks(), value, ZONE_EVENT_COUNTER);
+}
+
+struct TraceBuffer
+{
+    char* data;
+    size_t size;
+    size_t capacity;
+    bool failed; // out of memory, the rest is dropped
+};
+
+static void trace_printf(TraceBuffer* buffer, const char* format, ...)
+{
+    if(buffer->failed)
+        return;
+    for(;;)
+    {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(buffer->data + buffer->size, buffer->capacity - buffer->size, format, args);
+        va_end(args);
+        if(written < 0)
+        {
+            buffer->failed = true;
+            return;
+        }
+        if(buffer->size + written < buffer->capacity)
+        {
+            buffer->size += written;
+            return;
+        }
+        size_t capacity = buffer->capacity*2 + written;
+        char* data = (char*)realloc(buffer->data, capacity);
+        if(!data)
+        {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+}
+
+// Timestamps are relative to the oldest event so the viewer starts at zero.
+bool zone_write_chrome_trace(plat::FilePath path)
+{
+    int thread_count = zone_state.thread_count.load();
+    if(thread_count > MAX_ZONE_THREADS)
+        thread_count = MAX_ZONE_THREADS;
+
+    ZoneEvent* copies[MAX_ZONE_THREADS];
+    uint32_t counts[MAX_ZONE_THREADS];
+    uint64_t base = UINT64_MAX;
+    for(int t = 0; t < thread_count; t++)
+    {
+        ZoneThread* thread = &zone_state.threads[t];
+        copies[t] = (ZoneEvent*)malloc(ZONE_RING_SIZE * sizeof(ZoneEvent));
+        counts[t] = 0;
+        if(!copies[t])
+            continue;
+
+        uint32_t head = thread->head.load(std::memory_order_acquire);
+        uint32_t first = head > ZONE_RING_SIZE - ZONE_RING_SLACK ? head - (ZONE_RING_SIZE - ZONE_RING_SLACK) : 0;
+        for(uint32_t n = first; n < head; n++)
+        {
+            copies[t][n - first] = thread->events[n & (ZONE_RING_SIZE - 1)];
+        }
+
+        // Anything the writer lapped while copying is garbage, and so is the slot at new_head it may be
+        // filling right now (it aliases new_head - ZONE_RING_SIZE).
+        uint32_t new_head = thread->head.load(std::memory_order_acquire);
+        uint32_t valid_first = new_head + 1 > ZONE_RING_SIZE ? new_head + 1 - ZONE_RING_SIZE : 0;
+        uint32_t skip = valid_first > first ? valid_first - first : 0;
+        if(skip > head - first)
+            skip = head - first;
+        memmove(copies[t], copies[t] + skip, (head - first - skip) * sizeof(ZoneEvent));
+        counts[t] = head - first - skip;
+
+        for(uint32_t n = 0; n < counts[t]; n++)
+        {
+            if(copies[t][n].begin < base)
+                base = copies[t][n].begin;
+        }
+    }
+
+    double us_per_tick = 1000000.0 / (double)plat::get_ticks_per_second();
+    TraceBuffer buffer = {0};
+    buffer.capacity = 1 << 16;
+    buffer.data = (char*)malloc(buffer.capacity);
+    buffer.failed = !buffer.data;
+
+    trace_printf(&buffer, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first_event = true;
+    for(int t = 0; t < thread_count; t++)
+    {
+        trace_printf(&buffer, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                     first_event ? "" : ",\n", t + 1, zone_state.threads[t].name ? zone_state.threads[t].name : "thread");
+        first_event = false;
+
+        for(uint32_t n = 0; n < counts[t]; n++)
+        {
+            ZoneEvent* event = &copies[t][n];
+            double ts = (double)(event->begin - base) * us_per_tick;
+            if(event->kind == ZONE_EVENT_ZONE)
+            {
+                double dur = (double)((uint64_t)event->end_or_value - event->begin) * us_per_tick;
+                trace_printf(&buffer, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d}",
+                             event->name, ts, dur, t + 1);
+            }
+            else
+            {
+                trace_printf(&buffer, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d, \"args\": {\"value\": %lld}}",
+                             event->name, ts, t + 1, (long long)event->end_or_value);
+            }
+        }
+        free(copies[t]);
+    }
+    trace_printf(&buffer, "\n]}\n");
+
+    bool result = !buffer.failed && plat::write_entire_file(path, buffer.data, buffer.size);
+    free(buffer.data);
+    return result;
+}
+
+};
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+#include "chip8emu_platform.h"
+
+// Tiny built-in instrumentation: scoped zones and counters written to a per-thread ring buffer,
+// dumped as Chrome trace-event JSON (chrome://tracing or ui.perfetto.dev). Compile out with
+// -DNO_ZONES, which turns the macros below into nothing.
+#ifdef USE_ZONES
+#include <atomic>
+
+#define C8E_ZONE_CONCAT2(a, b) a##b
+#define C8E_ZONE_CONCAT(a, b) C8E_ZONE_CONCAT2(a, b)
+// name must be a string literal, only the pointer is stored.
+#define C8E_ZONE(name) c8e::ZoneScope C8E_ZONE_CONCAT(zone_, __LINE__)(name)
+#define C8E_ZONE_COUNTER(name, value) c8e::zone_counter(name, (int64_t)(value))
+#define C8E_ZONE_THREAD(name) c8e::zone_thread_name(name)
+
+namespace c8e
+{
+const uint32_t ZONE_RING_SIZE = 1 << 14; // events per thread, power of two
+const uint32_t ZONE_RING_SLACK = 256; // not read back, the writer may be in there
+const int MAX_ZONE_THREADS = 8;
+
+enum ZoneEventKind
+{
+	ZONE_EVENT_ZONE,
+	ZONE_EVENT_COUNTER,
+};
+
+struct ZoneEvent
+{
+	const char* name;
+	uint64_t begin; // ticks
+	int64_t end_or_value; // end ticks for zones
+	uint32_t kind;
+};
+
+// Only the owning thread writes; readers copy out and drop whatever got overwritten meanwhile.
+struct ZoneThread
+{
+	const char* name;
+	std::atomic<uint32_t> head;
+	ZoneEvent events[ZONE_RING_SIZE];
+};
+
+struct ZoneState
+{
+	std::atomic<bool> enabled; // the UI thread flips it while others record
+	std::atomic<int> thread_count;
+	ZoneThread threads[MAX_ZONE_THREADS];
+};
+
+ZoneState zone_state = {{true}};
+static thread_local ZoneThread* zone_thread = 0;
+
+void zone_thread_name(const char* name);
+static inline void zone_write(const char* name, uint64_t begin, int64_t end_or_value, uint32_t kind);
+static inline void zone_counter(const char* name, int64_t value);
+bool zone_write_chrome_trace(plat::FilePath path);
+
+struct ZoneScope
+{
+	const char* name;
+	uint64_t begin;
+
+	// Reading the clock is most of the cost, so a zone started while recording is off reads it not at all.
+	ZoneScope(const char* zone_name) : name(zone_name), begin(zone_state.enabled.load(std::memory_order_relaxed) ? plat::get_ticks() : 0) {}
+	~ZoneScope() { if(begin) zone_write(name, begin, (int64_t)plat::get_ticks(), ZONE_EVENT_ZONE); }
+};
+};
+#else
+#define C8E_ZONE(name)
+#define C8E_ZONE_COUNTER(name, value)
+#define C8E_ZONE_THREAD(name)
+#endif
@@ -11,8 +11,40 @@
 #endif
 
 #include "chip8emu_platform.h"
+// zones are on unless compiled out with -DNO_ZONES
+#ifndef NO_ZONES
+#define USE_ZONES
+#endif
+#include "chip8emu_zones.h"
 #include "chip8emu.h"
 #include "chip8emu.cpp"
+#include "chip8emu_rewind.h"
+#include "chip8emu_rewind.cpp"
+#include "chip8emu_movie.h"
+#include "chip8emu_movie.cpp"
+#include "chip8emu_profile.h"
+#include "chip8emu_profile.cpp"
+#include "chip8emu_perf.h"
+#include "chip8emu_perf.cpp"
+#include "chip8emu_trace.h"
+#include "chip8emu_trace.cpp"
+#include "chip8emu_debugger.h"
+#include "chip8emu_debugger.cpp"
+#include "chip8emu_writelog.h"
+#include "chip8emu_writelog.cpp"
+#include "chip8emu_expr.h"
+#include "chip8emu_expr.cpp"
+#include "chip8emu_breakpoints.h"
+#include "chip8emu_breakpoints.cpp"
+#include "chip8emu_disasm.h"
+#include "chip8emu_disasm.cpp"
+#include "chip8emu_memview.h"
+#include "chip8emu_memview.cpp"
+#include "chip8emu_search.h"
+#include "chip8emu_search.cpp"
+#include "chip8emu_coverage.h"
+#include "chip8emu_coverage.cpp"
+#include "chip8emu_zones.cpp"
 
 #if defined(PLATFORM_WIN32)
 #include "chip8emu_win32.cpp"
@@ -22,6 +54,9 @@
 
 #elif defined(PLATFORM_WASM)
 
+#elif defined(PLATFORM_HEADLESS)
+// no window or input, used for benchmarks and batch runs
+#include "chip8emu_headless.cpp"
 #elif defined(PLATFORM_GENERIC)
 // some generic 3rd-party cross-platform library impl goes here
 #else